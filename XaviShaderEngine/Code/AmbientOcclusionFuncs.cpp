@@ -0,0 +1,168 @@
+
+#include "AmbientOcclusionFuncs.h"
+#include "BufferSupFuncs.h"
+#include "GBufferLayoutFuncs.h"
+#include "GLStateFuncs.h"
+
+#include <random>
+
+namespace Ssao
+{
+    static const u32 tierSamples[SsaoQuality_Count] = { 8, 16, 32, 64 };
+
+    u32 SampleCount(SsaoQuality quality)
+    {
+        return tierSamples[quality];
+    }
+
+    static void BuildKernel(SsaoKernel& kernel, u32 sampleCount, std::default_random_engine& generator)
+    {
+        std::uniform_real_distribution<f32> randomFloats(0.0f, 1.0f);
+        for (u32 i = 0; i < SSAO_MAX_SAMPLES; ++i)
+        {
+            if (i >= sampleCount)
+            {
+                kernel.samples[i] = vec4(0.0f);
+                continue;
+            }
+
+            vec3 sample(randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator));
+            sample = glm::normalize(sample) * randomFloats(generator);
+
+            // more samples close to the pixel, over the whole radius whatever the tier
+            f32 scale = (f32)i / sampleCount;
+            sample *= glm::mix(0.1f, 1.0f, scale * scale);
+            kernel.samples[i] = vec4(sample, 0.0f);
+        }
+    }
+
+    void Create(AmbientOcclusion& ao)
+    {
+        std::default_random_engine generator;
+
+        SsaoKernel kernels[SsaoQuality_Count];
+        for (u32 i = 0; i < SsaoQuality_Count; ++i)
+            BuildKernel(kernels[i], tierSamples[i], generator);
+
+        glGenBuffers(1, &ao.kernelBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, ao.kernelBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(kernels), kernels, GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        std::uniform_real_distribution<f32> randomFloats(0.0f, 1.0f);
+        vec3 noise[SSAO_NOISE_SIZE * SSAO_NOISE_SIZE];
+        for (u32 i = 0; i < ARRAY_COUNT(noise); ++i)
+            noise[i] = vec3(randomFloats(generator) * 2.0f - 1.0f, randomFloats(generator) * 2.0f - 1.0f, 0.0f);
+
+        glGenTextures(1, &ao.noiseTexture);
+        GLState::BindTexture(GL_TEXTURE_2D, ao.noiseTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SSAO_NOISE_SIZE, SSAO_NOISE_SIZE, 0, GL_RGB, GL_FLOAT, noise);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    ivec2 TargetSize(const AmbientOcclusion& ao, ivec2 renderSize)
+    {
+        if (!ao.halfResolution)
+            return renderSize;
+        return (renderSize + ivec2(1)) / 2;
+    }
+
+    static void DrawFullscreen(GLuint fullscreenVao)
+    {
+        GLState::BindVertexArray(fullscreenVao);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+        GLState::BindVertexArray(0);
+    }
+
+    void Downsample(const AmbientOcclusion& ao, GLuint program, GLuint normals, GLuint depth, const glm::mat4& view, const glm::mat4& projectionInv, GLuint fullscreenVao)
+    {
+        GLState::UseProgram(program);
+
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D, normals);
+        glUniform1i(glGetUniformLocation(program, "uNormals"), 0);
+
+        GLState::ActiveTexture(GL_TEXTURE1);
+        GLState::BindTexture(GL_TEXTURE_2D, depth);
+        glUniform1i(glGetUniformLocation(program, "uDepth"), 1);
+
+        glUniform1i(glGetUniformLocation(program, "uBlockSize"), ao.halfResolution ? 2 : 1);
+        glUniformMatrix4fv(glGetUniformLocation(program, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(program, "uProjectionInv"), 1, GL_FALSE, &projectionInv[0][0]);
+
+        DrawFullscreen(fullscreenVao);
+    }
+
+    void Compute(const AmbientOcclusion& ao, GLuint program, GLuint linearDepth, GLuint viewNormals, const glm::mat4& projection, const glm::mat4& projectionInv, GLuint fullscreenVao)
+    {
+        GLState::UseProgram(program);
+
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D, linearDepth);
+        glUniform1i(glGetUniformLocation(program, "uLinearDepth"), 0);
+
+        GLState::ActiveTexture(GL_TEXTURE1);
+        GLState::BindTexture(GL_TEXTURE_2D, viewNormals);
+        glUniform1i(glGetUniformLocation(program, "uViewNormals"), 1);
+
+        GLState::ActiveTexture(GL_TEXTURE2);
+        GLState::BindTexture(GL_TEXTURE_2D, ao.noiseTexture);
+        glUniform1i(glGetUniformLocation(program, "noiseTexture"), 2);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(2), ao.kernelBuffer, ao.quality * sizeof(SsaoKernel), sizeof(SsaoKernel));
+        glUniform1i(glGetUniformLocation(program, "uSampleCount"), SampleCount(ao.quality));
+
+        glUniform1f(glGetUniformLocation(program, "sampleRadius"), ao.sampleRadius);
+        glUniform1f(glGetUniformLocation(program, "ssaoBias"), ao.bias);
+        glUniformMatrix4fv(glGetUniformLocation(program, "projectionMatrix"), 1, GL_FALSE, &projection[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(program, "uProjectionInv"), 1, GL_FALSE, &projectionInv[0][0]);
+
+        DrawFullscreen(fullscreenVao);
+    }
+
+    void Upsample(GLuint program, GLuint blurredAo, GLuint linearDepth, GLuint depth, const glm::mat4& projectionInv, GLuint fullscreenVao)
+    {
+        GLState::UseProgram(program);
+
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D, blurredAo);
+        glUniform1i(glGetUniformLocation(program, "uAO"), 0);
+
+        GLState::ActiveTexture(GL_TEXTURE1);
+        GLState::BindTexture(GL_TEXTURE_2D, linearDepth);
+        glUniform1i(glGetUniformLocation(program, "uLinearDepth"), 1);
+
+        GLState::ActiveTexture(GL_TEXTURE2);
+        GLState::BindTexture(GL_TEXTURE_2D, depth);
+        glUniform1i(glGetUniformLocation(program, "uDepth"), 2);
+
+        glUniformMatrix4fv(glGetUniformLocation(program, "uProjectionInv"), 1, GL_FALSE, &projectionInv[0][0]);
+
+        DrawFullscreen(fullscreenVao);
+    }
+
+    std::string Report(const AmbientOcclusion& ao, ivec2 renderSize, bool compactGBuffer)
+    {
+        const f64 megabyte = 1024.0 * 1024.0;
+        ivec2 size = TargetSize(ao, renderSize);
+        f64 renderPixels = (f64)renderSize.x * renderSize.y;
+        f64 pixels = (f64)size.x * size.y;
+        u32 samples = SampleCount(ao.quality);
+
+        // R32F linear depth and RGBA8 normals at the AO size, RGBA8 AO
+        const GBufferLayout& layout = GBuffer::Layout(compactGBuffer);
+        f64 downsample = (layout.colorBytes[1] + layout.ssaoDepthBytes) * renderPixels + (4 + 4) * pixels;
+        f64 occlusion = (4 + 4 + 4 * samples + 4) * pixels;
+        f64 blur = (4 * 16 + 4) * pixels;
+        f64 upsample = ao.halfResolution ? (layout.ssaoDepthBytes + 4 * (4 + 4) + 4) * renderPixels : 0.0;
+
+        char line[256];
+        sprintf(line, "%dx%d, %u samples: %.1f M depth taps | downsample %.1f MB, AO %.1f MB, blur %.1f MB, upsample %.1f MB",
+            size.x, size.y, samples, samples * pixels / 1e6, downsample / megabyte, occlusion / megabyte, blur / megabyte, upsample / megabyte);
+        return line;
+    }
+}
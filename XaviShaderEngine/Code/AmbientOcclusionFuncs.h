@@ -0,0 +1,63 @@
+
+#ifndef AMBIENT_OCCLUSION_FUNC
+#define AMBIENT_OCCLUSION_FUNC
+
+#include "Globals.h"
+
+// Slot of every tier in the kernel buffer, same value in SSAO.glsl
+#define SSAO_MAX_SAMPLES 64
+#define SSAO_NOISE_SIZE 4
+
+enum SsaoQuality
+{
+    SsaoQuality_Low, // 8 samples
+    SsaoQuality_Medium, // 16
+    SsaoQuality_High, // 32
+    SsaoQuality_Ultra, // 64
+    SsaoQuality_Count
+};
+
+// std140 mirror of SsaoKernel in SSAO.glsl, xyz is a tangent space offset inside the unit hemisphere
+struct SsaoKernel
+{
+    vec4 samples[SSAO_MAX_SAMPLES];
+};
+
+// SSAO of the main view: the G-buffer is reduced to linear depth and view space normals once, the samples only read
+// that depth. At half resolution a depth aware upsample brings the blurred result back to the render size
+struct AmbientOcclusion
+{
+    SsaoQuality quality = SsaoQuality_High;
+    bool halfResolution = true;
+    f32 sampleRadius = 0.5f;
+    f32 bias = 0.02f;
+
+    // one SsaoKernel per tier, built at start up, the tiers spread their samples over the whole radius
+    GLuint kernelBuffer;
+    GLuint noiseTexture; // rotations of the kernel around the normal, repeated over the screen
+};
+
+namespace Ssao
+{
+    void Create(AmbientOcclusion& ao);
+
+    u32 SampleCount(SsaoQuality quality);
+
+    // Size of the AO targets, half the render size rounded up at half resolution
+    ivec2 TargetSize(const AmbientOcclusion& ao, ivec2 renderSize);
+
+    // Keeps the nearest depth of every block of texels the AO covers, with its normal. The targets are bound, depth
+    // is the hardware depth of the G-buffer
+    void Downsample(const AmbientOcclusion& ao, GLuint program, GLuint normals, GLuint depth, const glm::mat4& view, const glm::mat4& projectionInv, GLuint fullscreenVao);
+
+    // Occlusion of the linear depth and normals Downsample wrote, with the kernel of the current tier
+    void Compute(const AmbientOcclusion& ao, GLuint program, GLuint linearDepth, GLuint viewNormals, const glm::mat4& projection, const glm::mat4& projectionInv, GLuint fullscreenVao);
+
+    // Blurred AO back to the render size, the low resolution texels far in depth from the pixel are left out
+    void Upsample(GLuint program, GLuint blurredAo, GLuint linearDepth, GLuint depth, const glm::mat4& projectionInv, GLuint fullscreenVao);
+
+    // Samples and estimated bytes moved per frame by the AO passes at this render size
+    std::string Report(const AmbientOcclusion& ao, ivec2 renderSize, bool compactGBuffer);
+}
+
+#endif // !AMBIENT_OCCLUSION_FUNC
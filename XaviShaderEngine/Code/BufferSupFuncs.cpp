@@ -1,4 +1,12 @@
 #include "BufferSupFuncs.h"
+#include "platform.h"
+
+// glad is generated for GL 4.3, buffer storage is 4.4 / ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
 
 namespace BufferManager
 {
@@ -60,4 +68,127 @@ namespace BufferManager
         memcpy((u8*)buffer.data + buffer.head, data, size);
         buffer.head += size;
     }
+
+    RingBuffer CreateRingBuffer(u32 regionSize, u32 regionCount, GLenum type)
+    {
+        ASSERT(regionCount > 0 && regionCount <= RING_BUFFER_MAX_REGIONS, "Unsupported ring region count");
+
+        RingBuffer ring = {};
+        ring.regionSize = regionSize;
+        ring.regionCount = regionCount;
+        ring.regionIndex = regionCount - 1;
+        ring.buffer.size = regionSize * regionCount;
+        ring.buffer.type = type;
+
+        bool hasBufferStorage = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) || glfwExtensionSupported("GL_ARB_buffer_storage");
+        PFNGLBUFFERSTORAGEPROC bufferStorage = hasBufferStorage ? (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage") : NULL;
+
+        glGenBuffers(1, &ring.buffer.handle);
+        glBindBuffer(type, ring.buffer.handle);
+        if (bufferStorage)
+        {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(type, ring.buffer.size, NULL, flags);
+            ring.buffer.data = (u8*)glMapBufferRange(type, 0, ring.buffer.size, flags);
+            ring.persistent = ring.buffer.data != NULL;
+        }
+        if (!ring.persistent)
+        {
+            ELOG("Persistent mapping unavailable, the ring buffer falls back to unsynchronized maps");
+            glBufferData(type, ring.buffer.size, NULL, GL_STREAM_DRAW);
+            ring.buffer.data = NULL;
+        }
+        glBindBuffer(type, 0);
+
+        return ring;
+    }
+
+    void DestroyRingBuffer(RingBuffer& ring)
+    {
+        for (u32 i = 0; i < ring.regionCount; ++i)
+        {
+            if (!ring.fences[i])
+                continue;
+
+            GLenum result;
+            do result = glClientWaitSync(ring.fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            while (result == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(ring.fences[i]);
+        }
+
+        if (ring.persistent)
+        {
+            glBindBuffer(ring.buffer.type, ring.buffer.handle);
+            glUnmapBuffer(ring.buffer.type);
+            glBindBuffer(ring.buffer.type, 0);
+        }
+        glDeleteBuffers(1, &ring.buffer.handle);
+        ring = {};
+    }
+
+    void BeginRingRegion(RingBuffer& ring)
+    {
+        ring.regionIndex = (ring.regionIndex + 1) % ring.regionCount;
+        ring.buffer.head = ring.regionIndex * ring.regionSize;
+
+        // the fence was placed the last time this region was filled
+        GLsync& fence = ring.fences[ring.regionIndex];
+        if (fence)
+        {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED)
+            {
+                ++ring.waitCount;
+                do result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                while (result == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    void EndRingRegion(RingBuffer& ring)
+    {
+        ring.fences[ring.regionIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void MapRing(RingBuffer& ring)
+    {
+        if (ring.persistent)
+            return;
+
+        // data is offset back so head keeps being an absolute offset
+        u32 regionEnd = (ring.regionIndex + 1) * ring.regionSize;
+        glBindBuffer(ring.buffer.type, ring.buffer.handle);
+        u8* mapped = (u8*)glMapBufferRange(ring.buffer.type, ring.buffer.head, regionEnd - ring.buffer.head,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        ring.buffer.data = mapped - ring.buffer.head;
+    }
+
+    void UnmapRing(RingBuffer& ring)
+    {
+        if (ring.persistent)
+            return;
+
+        glUnmapBuffer(ring.buffer.type);
+        glBindBuffer(ring.buffer.type, 0);
+        ring.buffer.data = NULL;
+    }
+
+    RingAllocation AllocateRing(RingBuffer& ring, u32 size, u32 alignment)
+    {
+        ASSERT(ring.buffer.data != NULL, "The ring buffer must be mapped first");
+        AlignHead(ring.buffer, alignment);
+        // past the region the writes would land on a region the GPU may still read, or past the mapping
+        if (ring.buffer.head + size > (ring.regionIndex + 1) * ring.regionSize)
+        {
+            ELOG("Ring buffer region overflow, %u bytes do not fit in a region of %u", size, ring.regionSize);
+            RingAllocation failed = { 0, NULL };
+            return failed;
+        }
+
+        RingAllocation allocation = { ring.buffer.head, ring.buffer.data + ring.buffer.head };
+        ring.buffer.head += size;
+        return allocation;
+    }
 }
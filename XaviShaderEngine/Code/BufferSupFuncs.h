@@ -9,12 +9,35 @@
 
     #define PushData(buffer, data, size) BufferManager::PushAlignedData(buffer, data, size, 1)
     #define PushUInt(buffer, value) { u32 v = value; BufferManager::PushAlignedData(buffer, &v, sizeof(v), 4); }
+    #define PushFloat(buffer, value) { f32 v = value; BufferManager::PushAlignedData(buffer, &v, sizeof(v), 4); }
     #define PushVec3(buffer, value) BufferManager::PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
     #define PushVec4(buffer, value) BufferManager::PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
     #define PushMat3(buffer, value) BufferManager::PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
     #define PushMat4(buffer, value) BufferManager::PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
 #define BINDING(b)b
 
+#define RING_BUFFER_MAX_REGIONS 4
+
+// Buffer split in regions that the CPU fills while the GPU still reads the previous ones.
+// With ARB_buffer_storage the whole buffer stays persistently mapped, otherwise every
+// MapRing maps the rest of the current region unsynchronized. Offsets are always absolute.
+struct RingBuffer
+{
+    Buffer buffer;
+    u32 regionSize;
+    u32 regionCount;
+    u32 regionIndex;
+    GLsync fences[RING_BUFFER_MAX_REGIONS];
+    bool persistent;
+    u32 waitCount; // times BeginRingRegion had to wait for the GPU
+};
+
+struct RingAllocation
+{
+    u32 offset;
+    u8* data;
+};
+
 namespace BufferManager
 {
 
@@ -34,6 +57,22 @@ namespace BufferManager
 
     void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
 
+    RingBuffer CreateRingBuffer(u32 regionSize, u32 regionCount, GLenum type);
+
+    // Waits for the GPU to be done with every region, the ring must not be mapped by MapRing
+    void DestroyRingBuffer(RingBuffer& ring);
+
+    void BeginRingRegion(RingBuffer& ring);
+
+    void EndRingRegion(RingBuffer& ring);
+
+    void MapRing(RingBuffer& ring);
+
+    void UnmapRing(RingBuffer& ring);
+
+    // data is NULL when the rest of the current region is too small
+    RingAllocation AllocateRing(RingBuffer& ring, u32 size, u32 alignment);
+
 }
 
 #endif // !BUFFER_MANAGER_FUNC
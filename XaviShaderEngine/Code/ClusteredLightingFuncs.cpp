@@ -0,0 +1,103 @@
+
+#include "ClusteredLightingFuncs.h"
+#include "GLStateFuncs.h"
+
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+namespace ClusteredLighting
+{
+    f32 LightRadius(const vec3& color)
+    {
+        // constant + linear * d + quadratic * d^2 = brightest / (5 / 256)
+        f32 brightest = glm::max(color.r, glm::max(color.g, color.b));
+        f32 c = LIGHT_ATTENUATION_CONSTANT - brightest * 256.0f / 5.0f;
+        if (c >= 0.0f)
+            return 0.0f;
+        f32 b = LIGHT_ATTENUATION_LINEAR;
+        f32 a = LIGHT_ATTENUATION_QUADRATIC;
+        return (-b + sqrtf(b * b - 4.0f * a * c)) / (2.0f * a);
+    }
+
+    void Create(LightClusters& clusters)
+    {
+        glGenBuffers(1, &clusters.lightBuffer);
+        clusters.lightCapacity = 0;
+
+        glGenBuffers(1, &clusters.clusterCountBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.clusterCountBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+
+        glGenBuffers(1, &clusters.clusterIndexBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.clusterIndexBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * CLUSTER_MAX_LIGHTS * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void UploadLights(LightClusters& clusters, const std::vector<Light>& lights)
+    {
+        std::vector<GpuLight> gpuLights;
+        gpuLights.reserve(lights.size());
+        for (u32 pass = 0; pass < 2; ++pass)
+        {
+            LightType type = pass == 0 ? LightType_Directional : LightType_Point;
+            for (u32 i = 0; i < lights.size(); ++i)
+            {
+                const Light& light = lights[i];
+                if (light.type != type)
+                    continue;
+                gpuLights.push_back({ vec4(light.position, light.radius), vec4(light.color, (f32)light.type), vec4(light.direction, (f32)i) });
+            }
+            if (pass == 0)
+                clusters.directionalCount = gpuLights.size();
+        }
+        clusters.lightCount = gpuLights.size();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusters.lightBuffer);
+        if (clusters.lightCount > clusters.lightCapacity)
+        {
+            clusters.lightCapacity = glm::max(clusters.lightCount, clusters.lightCapacity * 2);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, clusters.lightCapacity * sizeof(GpuLight), NULL, GL_DYNAMIC_DRAW);
+        }
+        if (clusters.lightCount > 0)
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, clusters.lightCount * sizeof(GpuLight), gpuLights.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void BuildClusters(const LightClusters& clusters, GLuint binProgram, const glm::mat4& view, const glm::mat4& projection, f32 zNear, f32 zFar)
+    {
+        glm::mat4 inverseProjection = glm::inverse(projection);
+
+        GLState::UseProgram(binProgram);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, clusters.lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, clusters.clusterCountBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, clusters.clusterIndexBuffer);
+
+        glUniformMatrix4fv(glGetUniformLocation(binProgram, "uView"), 1, GL_FALSE, &view[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(binProgram, "uInverseProjection"), 1, GL_FALSE, &inverseProjection[0][0]);
+        glUniform1f(glGetUniformLocation(binProgram, "uZNear"), zNear);
+        glUniform1f(glGetUniformLocation(binProgram, "uZFar"), zFar);
+        glUniform1ui(glGetUniformLocation(binProgram, "uFirstPointLight"), clusters.directionalCount);
+        glUniform1ui(glGetUniformLocation(binProgram, "uLightCount"), clusters.lightCount);
+
+        // a work group per cluster, its threads split the point lights
+        glDispatchCompute(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        GLState::UseProgram(0);
+    }
+
+    void BindForShading(const LightClusters& clusters, GLuint shadingProgram, const glm::mat4& view, ivec2 viewportSize, f32 zNear, f32 zFar)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, clusters.lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, clusters.clusterCountBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, clusters.clusterIndexBuffer);
+
+        glUniformMatrix4fv(glGetUniformLocation(shadingProgram, "uView"), 1, GL_FALSE, &view[0][0]);
+        glUniform2f(glGetUniformLocation(shadingProgram, "uViewportSize"), (f32)viewportSize.x, (f32)viewportSize.y);
+        glUniform1f(glGetUniformLocation(shadingProgram, "uZNear"), zNear);
+        glUniform1f(glGetUniformLocation(shadingProgram, "uZFar"), zFar);
+        glUniform1ui(glGetUniformLocation(shadingProgram, "uDirectionalLightCount"), clusters.directionalCount);
+        glUniform3f(glGetUniformLocation(shadingProgram, "uAttenuation"), LIGHT_ATTENUATION_CONSTANT, LIGHT_ATTENUATION_LINEAR, LIGHT_ATTENUATION_QUADRATIC);
+    }
+}
@@ -0,0 +1,54 @@
+
+#ifndef CLUSTERED_LIGHTING_FUNC
+#define CLUSTERED_LIGHTING_FUNC
+
+#include "Globals.h"
+
+// View-space froxels: screen tiles times exponential depth slices, same values in LightClusters.glsl
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 256 // per cluster, the rest are dropped
+
+// Point light falloff of every deferred lighting shader, uploaded as uAttenuation
+#define LIGHT_ATTENUATION_CONSTANT 1.0f
+#define LIGHT_ATTENUATION_LINEAR 0.09f
+#define LIGHT_ATTENUATION_QUADRATIC 0.032f
+
+// std430 mirror of Light in LightClusters.glsl, FB_TO_BB.glsl and FB_TO_BB_SSAO.glsl
+struct GpuLight
+{
+    vec4 positionRadius;
+    vec4 colorType;
+    vec4 direction; // w is the index in the scene light list, for the point shadow lookup
+};
+
+struct LightClusters
+{
+    GLuint lightBuffer;
+    u32 lightCapacity;
+
+    GLuint clusterCountBuffer;
+    GLuint clusterIndexBuffer; // CLUSTER_MAX_LIGHTS slots per cluster
+
+    // directional lights go first and light every pixel, the point lights after them are binned
+    u32 directionalCount;
+    u32 lightCount;
+};
+
+namespace ClusteredLighting
+{
+    // Distance where the point light attenuation of the lighting shaders drops under 5/256 of its color
+    f32 LightRadius(const vec3& color);
+
+    void Create(LightClusters& clusters);
+
+    void UploadLights(LightClusters& clusters, const std::vector<Light>& lights);
+
+    void BuildClusters(const LightClusters& clusters, GLuint binProgram, const glm::mat4& view, const glm::mat4& projection, f32 zNear, f32 zFar);
+
+    // Buffers and uniforms the lighting pass needs, with its program in use
+    void BindForShading(const LightClusters& clusters, GLuint shadingProgram, const glm::mat4& view, ivec2 viewportSize, f32 zNear, f32 zFar);
+}
+
+#endif // !CLUSTERED_LIGHTING_FUNC
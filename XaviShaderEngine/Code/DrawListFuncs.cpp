@@ -0,0 +1,92 @@
+
+#include "DrawListFuncs.h"
+#include "BufferSupFuncs.h"
+#include "GLStateFuncs.h"
+
+#include <algorithm>
+
+namespace DrawCommands
+{
+    void Begin(DrawList& list, GLuint program)
+    {
+        list.packets.clear();
+        list.mainViewCount = 0;
+        list.waterViewBegin = 0;
+
+        if (list.program != program)
+        {
+            list.program = program;
+            list.textureLocation = glGetUniformLocation(program, "uTexture");
+            list.viewMatrixLocation = glGetUniformLocation(program, "viewMatrix");
+        }
+    }
+
+    void Sort(DrawList& list, u32 begin, u32 end)
+    {
+        std::stable_sort(list.packets.begin() + begin, list.packets.begin() + end, [](const DrawPacket& a, const DrawPacket& b)
+        {
+            return a.vao != b.vao ? a.vao < b.vao : a.textureHandle < b.textureHandle;
+        });
+    }
+
+    void Replay(const DrawList& list, u32 packetCount, const DrawView& view)
+    {
+        ASSERT(packetCount <= list.packets.size(), "Replaying more packets than recorded");
+
+        glUniformMatrix4fv(list.viewMatrixLocation, 1, GL_FALSE, &view.viewMatrix[0][0]);
+        glUniform1i(list.textureLocation, 0);
+        GLState::ActiveTexture(GL_TEXTURE0);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), view.uniformBuffer, view.globalParamsOffset, view.globalParamsSize);
+
+        // VAO and texture changes are filtered by GLState, the uniform ranges are not
+        u32 boundParams = 0xFFFFFFFF;
+        for (u32 i = 0; i < packetCount; ++i)
+        {
+            const DrawPacket& packet = list.packets[i];
+
+            if (packet.paramsOffset != boundParams)
+            {
+                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), view.uniformBuffer, view.localParamsOffset + packet.paramsOffset, view.localParamsSize);
+                boundParams = packet.paramsOffset;
+            }
+            GLState::BindVertexArray(packet.vao);
+            GLState::BindTexture(GL_TEXTURE_2D, packet.textureHandle);
+            glDrawElements(GL_TRIANGLES, packet.indexCount, packet.indexType, (void*)(u64)packet.indexOffset);
+        }
+
+        GLState::BindVertexArray(0);
+    }
+
+    static void BeginSubset(DrawList& subset, const DrawList& list)
+    {
+        subset.program = list.program;
+        subset.textureLocation = list.textureLocation;
+        subset.viewMatrixLocation = list.viewMatrixLocation;
+        subset.packets.clear();
+        subset.mainViewCount = 0;
+        subset.waterViewBegin = 0;
+    }
+
+    void SplitByPlane(const DrawList& list, u32 begin, u32 end, const vec4& plane, f32 margin, const std::vector<vec4>& rowBoundingSpheres,
+        DrawList& front, DrawList& back, DrawList& straddling)
+    {
+        BeginSubset(front, list);
+        BeginSubset(back, list);
+        BeginSubset(straddling, list);
+
+        for (u32 i = begin; i < end; ++i)
+        {
+            const DrawPacket& packet = list.packets[i];
+            const vec4& sphere = rowBoundingSpheres[packet.row];
+            f32 distance = glm::dot(vec3(plane), vec3(sphere)) + plane.w;
+
+            if (distance - sphere.w > margin)
+                front.packets.push_back(packet);
+            else if (distance + sphere.w < -margin)
+                back.packets.push_back(packet);
+            else
+                straddling.packets.push_back(packet);
+        }
+    }
+}
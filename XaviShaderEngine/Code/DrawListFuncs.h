@@ -0,0 +1,59 @@
+
+#ifndef DRAW_LIST_FUNC
+#define DRAW_LIST_FUNC
+
+#include "Globals.h"
+
+// Everything a draw needs, resolved once so the passes only walk a flat array
+struct DrawPacket
+{
+    GLuint vao;
+    GLuint textureHandle;
+    u32 indexCount;
+    u32 indexOffset;
+    GLenum indexType;
+    u32 paramsOffset; // from the start of the local params the pass uploaded
+    u32 row; // entity row, for the passes that cull by its bounds
+};
+
+struct DrawList
+{
+    std::vector<DrawPacket> packets;
+    // the main view draws the first mainViewCount packets, the water views the ones from waterViewBegin to the end.
+    // The rows in both passes are the packets in between
+    u32 mainViewCount;
+    u32 waterViewBegin;
+
+    // VAOs and uniform locations belong to this program
+    GLuint program;
+    GLint textureLocation;
+    GLint viewMatrixLocation;
+};
+
+// Per pass constants swapped between replays of the same list
+struct DrawView
+{
+    GLuint uniformBuffer;
+    u32 globalParamsOffset;
+    u32 globalParamsSize;
+    u32 localParamsOffset;
+    u32 localParamsSize;
+    glm::mat4 viewMatrix;
+};
+
+namespace DrawCommands
+{
+    void Begin(DrawList& list, GLuint program);
+
+    // Groups packets with the same VAO and texture so the replay can skip the rebinds
+    void Sort(DrawList& list, u32 begin, u32 end);
+
+    void Replay(const DrawList& list, u32 packetCount, const DrawView& view);
+
+    // Splits the packets [begin, end) by the side of the plane the bounds of their entity are on, in order. Within
+    // margin of the plane counts as both sides, those go to straddling
+    void SplitByPlane(const DrawList& list, u32 begin, u32 end, const vec4& plane, f32 margin, const std::vector<vec4>& rowBoundingSpheres,
+        DrawList& front, DrawList& back, DrawList& straddling);
+}
+
+#endif // !DRAW_LIST_FUNC
@@ -0,0 +1,171 @@
+
+#include "EntityStoreFuncs.h"
+#include "platform.h"
+
+namespace Entities
+{
+    template <typename T>
+    static void MoveRow(std::vector<T>& column, u32 from, u32 to)
+    {
+        column[to] = column[from];
+        column.pop_back();
+    }
+
+    EntityId Create(EntityStore& store, u32 modelIndex, u32 transformNode, u8 passMask)
+    {
+        EntityId entity;
+        if (!store.freeIds.empty())
+        {
+            entity = store.freeIds.back();
+            store.freeIds.pop_back();
+        }
+        else
+        {
+            entity = store.entityRow.size();
+            store.entityRow.push_back(INVALID_ROW);
+        }
+
+        u32 row = store.rowEntity.size();
+        store.transformNode.push_back(transformNode);
+        store.modelIndex.push_back(modelIndex);
+        store.boundingSphere.push_back(vec4(0.0f));
+        store.passMask.push_back(passMask);
+        store.paramsOffset.push_back(0);
+        store.rowEntity.push_back(entity);
+        store.entityRow[entity] = row;
+
+        if (transformNode >= store.nodeRow.size())
+            store.nodeRow.resize(transformNode + 1, INVALID_ROW);
+        store.nodeRow[transformNode] = row;
+
+        return entity;
+    }
+
+    EntityId CreateRange(EntityStore& store, u32 count, const u32* models, u32 firstNode, u8 passMask)
+    {
+        // fresh ids only, so they stay consecutive
+        EntityId firstEntity = store.entityRow.size();
+        u32 firstRow = store.rowEntity.size();
+        u32 rowCount = firstRow + count;
+
+        store.modelIndex.insert(store.modelIndex.end(), models, models + count);
+        store.boundingSphere.resize(rowCount, vec4(0.0f));
+        store.passMask.resize(rowCount, passMask);
+        store.paramsOffset.resize(rowCount, 0);
+        store.transformNode.resize(rowCount);
+        store.rowEntity.resize(rowCount);
+        store.entityRow.resize(firstEntity + count);
+        if (firstNode + count > store.nodeRow.size())
+            store.nodeRow.resize(firstNode + count, INVALID_ROW);
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            store.transformNode[firstRow + i] = firstNode + i;
+            store.rowEntity[firstRow + i] = firstEntity + i;
+            store.entityRow[firstEntity + i] = firstRow + i;
+            store.nodeRow[firstNode + i] = firstRow + i;
+        }
+
+        return firstEntity;
+    }
+
+    u32 Destroy(EntityStore& store, EntityId entity)
+    {
+        ASSERT(IsAlive(store, entity), "Destroying a dead entity");
+
+        u32 row = store.entityRow[entity];
+        u32 lastRow = store.rowEntity.size() - 1;
+
+        store.nodeRow[store.transformNode[row]] = INVALID_ROW;
+        if (row != lastRow)
+            store.nodeRow[store.transformNode[lastRow]] = row;
+
+        MoveRow(store.transformNode, lastRow, row);
+        MoveRow(store.modelIndex, lastRow, row);
+        MoveRow(store.boundingSphere, lastRow, row);
+        MoveRow(store.passMask, lastRow, row);
+        MoveRow(store.paramsOffset, lastRow, row);
+        MoveRow(store.rowEntity, lastRow, row);
+
+        if (row != lastRow)
+            store.entityRow[store.rowEntity[row]] = row;
+        store.entityRow[entity] = INVALID_ROW;
+        store.freeIds.push_back(entity);
+
+        return row != lastRow ? row : INVALID_ROW;
+    }
+
+    void RowsInPass(const EntityStore& store, u8 passMask, std::vector<u32>& rows)
+    {
+        rows.clear();
+        for (u32 row = 0; row < store.passMask.size(); ++row)
+            if (store.passMask[row] & passMask)
+                rows.push_back(row);
+    }
+
+    std::string RunBenchmark()
+    {
+        const u32 entityCount = 100000;
+        const u32 repetitions = 5;
+
+        // what the old Entity array plus a bounds field looked like to a culling loop
+        struct EntityRecord
+        {
+            Entity entity;
+            vec4 boundingSphere;
+            u8 passMask;
+        };
+
+        std::vector<EntityRecord> records(entityCount);
+        EntityStore store = {};
+        for (u32 i = 0; i < entityCount; ++i)
+        {
+            vec4 sphere = vec4((f32)(i % 100), (f32)((i / 100) % 100), (f32)(i / 10000), 1.0f);
+            records[i].entity.worldMatrix = glm::translate(vec3(sphere));
+            records[i].entity.modelIndex = i % 7;
+            records[i].boundingSphere = sphere;
+            records[i].passMask = RenderPass_All;
+
+            Create(store, i % 7, i, RenderPass_All);
+            store.boundingSphere[i] = sphere;
+        }
+
+        vec4 plane = glm::normalize(vec4(1.0f, 0.5f, 0.25f, -40.0f));
+
+        f64 bestRecords = 1e30;
+        f64 bestColumns = 1e30;
+        u32 visibleRecords = 0;
+        u32 visibleColumns = 0;
+        for (u32 r = 0; r < repetitions; ++r)
+        {
+            f64 start = glfwGetTime();
+            visibleRecords = 0;
+            for (u32 i = 0; i < entityCount; ++i)
+            {
+                const vec4& sphere = records[i].boundingSphere;
+                if ((records[i].passMask & RenderPass_Main) && glm::dot(vec3(plane), vec3(sphere)) + plane.w > -sphere.w)
+                    ++visibleRecords;
+            }
+            bestRecords = glm::min(bestRecords, glfwGetTime() - start);
+
+            start = glfwGetTime();
+            visibleColumns = 0;
+            const vec4* spheres = store.boundingSphere.data();
+            const u8* masks = store.passMask.data();
+            for (u32 i = 0; i < entityCount; ++i)
+            {
+                if ((masks[i] & RenderPass_Main) && glm::dot(vec3(plane), vec3(spheres[i])) + plane.w > -spheres[i].w)
+                    ++visibleColumns;
+            }
+            bestColumns = glm::min(bestColumns, glfwGetTime() - start);
+        }
+        ASSERT(visibleRecords == visibleColumns, "Both sweeps must agree");
+
+        char line[256];
+        sprintf(line, "%u entities, bounds sweep: structs %.3f ms (%u bytes/entity) | columns %.3f ms (%u bytes/entity)\n",
+            entityCount, bestRecords * 1000.0, (u32)sizeof(EntityRecord), bestColumns * 1000.0, (u32)(sizeof(vec4) + sizeof(u8)));
+
+        ILOG("Entity store benchmark\n%s", line);
+        return line;
+    }
+}
@@ -0,0 +1,60 @@
+
+#ifndef ENTITY_STORE_FUNC
+#define ENTITY_STORE_FUNC
+
+#include "Globals.h"
+
+typedef u32 EntityId;
+
+#define INVALID_ENTITY 0xFFFFFFFF
+#define INVALID_ROW 0xFFFFFFFF
+
+enum RenderPassMask
+{
+    RenderPass_Main = 1 << 0,
+    RenderPass_WaterViews = 1 << 1, // the planar reflection
+    RenderPass_All = RenderPass_Main | RenderPass_WaterViews
+};
+
+// Entities as densely packed columns, row i of every column is the same entity.
+// Rows move when an entity is destroyed (the last row fills the hole), ids never do.
+struct EntityStore
+{
+    std::vector<u32> transformNode;
+    std::vector<u32> modelIndex;
+    std::vector<vec4> boundingSphere; // world space, xyz center and w radius
+    std::vector<u8> passMask;
+    std::vector<u32> paramsOffset; // local params block, from the start of what UploadEntityParams writes
+
+    std::vector<EntityId> rowEntity;
+    std::vector<u32> entityRow; // INVALID_ROW once destroyed
+    std::vector<EntityId> freeIds;
+
+    std::vector<u32> nodeRow; // transform node to row, the hierarchy keeps nodes of destroyed entities
+};
+
+namespace Entities
+{
+    EntityId Create(EntityStore& store, u32 modelIndex, u32 transformNode, u8 passMask);
+
+    // count entities at once, entity i uses models[i] and transform node firstNode + i. Returns the first id,
+    // the rest follow in order
+    EntityId CreateRange(EntityStore& store, u32 count, const u32* models, u32 firstNode, u8 passMask);
+
+    // Returns the row that moved into the hole, INVALID_ROW if it was the last one
+    u32 Destroy(EntityStore& store, EntityId entity);
+
+    inline u32 Count(const EntityStore& store) { return store.rowEntity.size(); }
+
+    inline u32 Row(const EntityStore& store, EntityId entity) { return store.entityRow[entity]; }
+
+    inline bool IsAlive(const EntityStore& store, EntityId entity) { return entity < store.entityRow.size() && store.entityRow[entity] != INVALID_ROW; }
+
+    // Rows whose pass mask has any of the given bits, in row order
+    void RowsInPass(const EntityStore& store, u8 passMask, std::vector<u32>& rows);
+
+    // Times a bounds sweep over an array of structs against the bounds column at 100k entities
+    std::string RunBenchmark();
+}
+
+#endif // !ENTITY_STORE_FUNC
@@ -0,0 +1,212 @@
+
+#include "FrameGraphFuncs.h"
+#include "GLStateFuncs.h"
+#include "platform.h"
+
+namespace FrameGraph
+{
+    void Begin(RenderGraph& graph)
+    {
+        graph.resources.clear();
+        graph.passes.clear();
+    }
+
+    u32 Import(RenderGraph& graph, const char* name, GLuint texture)
+    {
+        FrameGraphResource resource = {};
+        resource.name = name;
+        resource.imported = true;
+        resource.texture = texture;
+        graph.resources.push_back(resource);
+        return graph.resources.size() - 1;
+    }
+
+    u32 CreateTexture(RenderGraph& graph, const char* name, const RenderTargetDesc& desc)
+    {
+        FrameGraphResource resource = {};
+        resource.name = name;
+        resource.desc = desc;
+        graph.resources.push_back(resource);
+        return graph.resources.size() - 1;
+    }
+
+    u32 CreateTexture(RenderGraph& graph, const char* name, ivec2 size, GLenum format)
+    {
+        RenderTargetDesc desc = { size, format, 1, 1 };
+        return CreateTexture(graph, name, desc);
+    }
+
+    void MarkOutput(RenderGraph& graph, u32 resource)
+    {
+        graph.resources[resource].output = true;
+    }
+
+    u32 AddPass(RenderGraph& graph, const char* name, const FrameGraphExecute& execute)
+    {
+        FrameGraphPass pass = {};
+        pass.name = name;
+        pass.execute = execute;
+        graph.passes.push_back(pass);
+        return graph.passes.size() - 1;
+    }
+
+    void Read(RenderGraph& graph, u32 pass, u32 resource)
+    {
+        graph.passes[pass].reads.push_back(resource);
+    }
+
+    void Write(RenderGraph& graph, u32 pass, u32 resource)
+    {
+        graph.passes[pass].writes.push_back(resource);
+    }
+
+    static void Touch(FrameGraphResource& resource, u32 pass)
+    {
+        if (resource.firstPass == FRAME_GRAPH_NO_PASS)
+            resource.firstPass = pass;
+        resource.lastPass = pass;
+    }
+
+    void Compile(RenderGraph& graph)
+    {
+        for (u32 i = 0; i < graph.resources.size(); ++i)
+        {
+            FrameGraphResource& resource = graph.resources[i];
+            resource.needed = resource.output;
+            resource.firstPass = FRAME_GRAPH_NO_PASS;
+            resource.lastPass = FRAME_GRAPH_NO_PASS;
+        }
+
+        // the readers come after the writers, so one walk from the back finds everything the outputs depend on
+        graph.culledCount = 0;
+        for (u32 i = graph.passes.size(); i-- > 0;)
+        {
+            FrameGraphPass& pass = graph.passes[i];
+            pass.culled = true;
+            for (u32 w = 0; w < pass.writes.size(); ++w)
+                if (graph.resources[pass.writes[w]].needed)
+                    pass.culled = false;
+
+            if (pass.culled)
+            {
+                ++graph.culledCount;
+                continue;
+            }
+            for (u32 r = 0; r < pass.reads.size(); ++r)
+                graph.resources[pass.reads[r]].needed = true;
+        }
+
+        for (u32 i = 0; i < graph.passes.size(); ++i)
+        {
+            const FrameGraphPass& pass = graph.passes[i];
+            if (pass.culled)
+                continue;
+            for (u32 r = 0; r < pass.reads.size(); ++r)
+                Touch(graph.resources[pass.reads[r]], i);
+            for (u32 w = 0; w < pass.writes.size(); ++w)
+                Touch(graph.resources[pass.writes[w]], i);
+        }
+
+        graph.transientCount = 0;
+        graph.unaliasedBytes = 0;
+        for (u32 i = 0; i < graph.resources.size(); ++i)
+        {
+            const FrameGraphResource& resource = graph.resources[i];
+            if (resource.imported || resource.firstPass == FRAME_GRAPH_NO_PASS)
+                continue;
+            ++graph.transientCount;
+            graph.unaliasedBytes += RenderTargets::Bytes(resource.desc);
+        }
+    }
+
+    void Execute(RenderGraph& graph, RenderTargetPool& pool, GpuTimers& timers)
+    {
+        static std::vector<GLuint> handedOut;
+        handedOut.clear();
+
+        u64 aliveBytes = 0;
+        graph.aliasedCount = 0;
+        graph.transientBytes = 0;
+
+        for (u32 i = 0; i < graph.passes.size(); ++i)
+        {
+            FrameGraphPass& pass = graph.passes[i];
+            if (pass.culled)
+                continue;
+
+            for (u32 r = 0; r < graph.resources.size(); ++r)
+            {
+                FrameGraphResource& resource = graph.resources[r];
+                if (resource.imported || resource.firstPass != i)
+                    continue;
+
+                resource.texture = RenderTargets::Acquire(pool, resource.desc);
+                if (std::find(handedOut.begin(), handedOut.end(), resource.texture) != handedOut.end())
+                    ++graph.aliasedCount;
+                else
+                    handedOut.push_back(resource.texture);
+
+                aliveBytes += RenderTargets::Bytes(resource.desc);
+                graph.transientBytes = glm::max(graph.transientBytes, aliveBytes);
+            }
+
+            u32 scope = GpuProfiler::Begin(timers, pass.name);
+            pass.execute(graph, i);
+            GpuProfiler::End(timers, scope);
+
+            for (u32 r = 0; r < graph.resources.size(); ++r)
+            {
+                FrameGraphResource& resource = graph.resources[r];
+                if (resource.imported || resource.output || resource.lastPass != i)
+                    continue;
+                RenderTargets::Release(pool, resource.texture);
+                aliveBytes -= RenderTargets::Bytes(resource.desc);
+            }
+        }
+
+        // nothing touches them until the next frame takes them again, whoever looks at them after the frame sees them whole
+        for (u32 r = 0; r < graph.resources.size(); ++r)
+        {
+            const FrameGraphResource& resource = graph.resources[r];
+            if (!resource.imported && resource.output && resource.firstPass != FRAME_GRAPH_NO_PASS)
+                RenderTargets::Release(pool, resource.texture);
+        }
+    }
+
+    GLuint Texture(const RenderGraph& graph, u32 resource)
+    {
+        return graph.resources[resource].texture;
+    }
+
+    GLuint Texture(const RenderGraph& graph, const char* name)
+    {
+        for (u32 i = 0; i < graph.resources.size(); ++i)
+            if (strcmp(graph.resources[i].name, name) == 0)
+                return graph.resources[i].texture;
+        return 0;
+    }
+
+    void BindTargets(RenderGraph& graph, u32 pass, const u32* resources, u32 count, GLuint depthStencil)
+    {
+        if (graph.frameBuffers.size() <= pass)
+            graph.frameBuffers.resize(pass + 1, 0);
+        if (graph.frameBuffers[pass] == 0)
+            glGenFramebuffers(1, &graph.frameBuffers[pass]);
+
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, graph.frameBuffers[pass]);
+
+        GLenum drawBuffers[8];
+        ASSERT(count <= ARRAY_COUNT(drawBuffers), "Too many color targets for one pass");
+        for (u32 i = 0; i < count; ++i)
+        {
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+            glFramebufferTexture(GL_FRAMEBUFFER, drawBuffers[i], graph.resources[resources[i]].texture, 0);
+        }
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthStencil, 0);
+        glDrawBuffers(count, drawBuffers);
+
+        GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+            ELOG("Framebuffer of pass %s incomplete (0x%x)", graph.passes[pass].name, framebufferStatus);
+    }
+}
@@ -0,0 +1,94 @@
+
+#ifndef FRAME_GRAPH_FUNC
+#define FRAME_GRAPH_FUNC
+
+#include "Globals.h"
+#include "RenderTargetFuncs.h"
+#include "GpuProfilerFuncs.h"
+#include <functional>
+
+#define FRAME_GRAPH_NO_PASS 0xFFFFFFFF
+
+struct RenderGraph;
+
+typedef std::function<void(RenderGraph& graph, u32 pass)> FrameGraphExecute;
+
+// Something a pass reads or writes. Imported ones live outside the graph (framebuffers, buffers, the back buffer),
+// transient textures come from the render target pool for the passes between their first and last use only
+struct FrameGraphResource
+{
+    const char* name;
+    bool imported;
+    bool output; // needed after the frame, its writers are never culled and its texture is never aliased
+    RenderTargetDesc desc;
+    GLuint texture; // imported handle, or the pool texture of the last Execute
+
+    // filled by Compile
+    bool needed;
+    u32 firstPass;
+    u32 lastPass;
+};
+
+struct FrameGraphPass
+{
+    const char* name;
+    std::vector<u32> reads;
+    std::vector<u32> writes;
+    FrameGraphExecute execute;
+    bool culled;
+};
+
+// Rebuilt every frame, the declarations can depend on the settings of that frame
+struct RenderGraph
+{
+    std::vector<FrameGraphResource> resources;
+    std::vector<FrameGraphPass> passes;
+    std::vector<GLuint> frameBuffers; // by pass index, for BindTargets, kept between frames
+
+    // last Compile and Execute
+    u32 culledCount;
+    u32 transientCount;
+    u32 aliasedCount; // transient textures that took one released earlier in the same frame
+    u64 transientBytes; // peak of the transient textures alive at once
+    u64 unaliasedBytes; // with a texture for each of them
+};
+
+namespace FrameGraph
+{
+    // Forgets the passes and resources of the last frame
+    void Begin(RenderGraph& graph);
+
+    u32 Import(RenderGraph& graph, const char* name, GLuint texture = 0);
+
+    u32 CreateTexture(RenderGraph& graph, const char* name, const RenderTargetDesc& desc);
+
+    u32 CreateTexture(RenderGraph& graph, const char* name, ivec2 size, GLenum format);
+
+    // Kept even when no pass reads it
+    void MarkOutput(RenderGraph& graph, u32 resource);
+
+    // Passes run in the order they are added, the names have to outlive the GPU timers
+    u32 AddPass(RenderGraph& graph, const char* name, const FrameGraphExecute& execute);
+
+    void Read(RenderGraph& graph, u32 pass, u32 resource);
+
+    void Write(RenderGraph& graph, u32 pass, u32 resource);
+
+    // Culls, back to front, the passes whose writes nothing needed reads, then finds the lifetime of every texture
+    void Compile(RenderGraph& graph);
+
+    // Runs the kept passes, each in a GPU scope of its name. A transient texture is taken from the pool before its
+    // first pass and given back after its last one, so a later texture of the same description reuses it
+    void Execute(RenderGraph& graph, RenderTargetPool& pool, GpuTimers& timers);
+
+    GLuint Texture(const RenderGraph& graph, u32 resource);
+
+    // By name, 0 when the last frame did not have it
+    GLuint Texture(const RenderGraph& graph, const char* name);
+
+    // Framebuffer of the pass with the given transient textures as color attachments, in order, and the depth-stencil
+    // texture if there is one
+    void BindTargets(RenderGraph& graph, u32 pass, const u32* resources, u32 count, GLuint depthStencil = 0);
+}
+
+#endif // !FRAME_GRAPH_FUNC
@@ -0,0 +1,80 @@
+
+#include "GBufferLayoutFuncs.h"
+#include "platform.h"
+
+// GL_DEPTH24_STENCIL8, in both layouts
+#define GBUFFER_DEPTH_BYTES 4
+
+namespace GBuffer
+{
+    // albedo, normals, world position, view direction and linear depth
+    static const GBufferLayout fullLayout = {
+        "full",
+        5,
+        { GL_RGBA8, GL_RGBA16F, GL_RGBA16F, GL_RGBA16F, GL_RGBA16F },
+        { 4, 8, 8, 8, 8 },
+        4 + 8 + 8 + 8, // albedo, normals, position and view direction
+        GBUFFER_DEPTH_BYTES, // the hardware depth, the position attachment is not read
+        GBUFFER_DEPTH_BYTES // the hardware depth, as in the compact layout
+    };
+
+    // albedo and octahedral normals, position and view direction come back from the depth and the camera
+    static const GBufferLayout compactLayout = {
+        "compact",
+        2,
+        { GL_RGBA8, GL_RG16 },
+        { 4, 4 },
+        4 + 4 + GBUFFER_DEPTH_BYTES,
+        GBUFFER_DEPTH_BYTES,
+        GBUFFER_DEPTH_BYTES
+    };
+
+    const GBufferLayout& Layout(bool compact)
+    {
+        return compact ? compactLayout : fullLayout;
+    }
+
+    u32 BytesPerPixel(const GBufferLayout& layout)
+    {
+        u32 bytes = GBUFFER_DEPTH_BYTES;
+        for (u32 i = 0; i < layout.colorCount; ++i)
+            bytes += layout.colorBytes[i];
+        return bytes;
+    }
+
+    std::string BandwidthReport(ivec2 size, u32 gBufferCount, bool compactInUse)
+    {
+        const f64 megabyte = 1024.0 * 1024.0;
+        f64 pixels = (f64)size.x * size.y;
+
+        std::string report;
+        char line[256];
+        sprintf(line, "%dx%d, %u G-buffers\n", size.x, size.y, gBufferCount);
+        report += line;
+
+        f64 totals[2];
+        for (u32 compact = 0; compact < 2; ++compact)
+        {
+            const GBufferLayout& layout = Layout(compact != 0);
+            u32 bytesPerPixel = BytesPerPixel(layout);
+
+            f64 memory = bytesPerPixel * pixels * gBufferCount;
+            f64 writes = bytesPerPixel * pixels * gBufferCount;
+            f64 lightingReads = layout.lightingReadBytes * pixels * gBufferCount;
+            f64 ssaoReads = (layout.colorBytes[1] + layout.ssaoDepthBytes) * pixels;
+            f64 waterReads = layout.waterDepthBytes * pixels;
+            totals[compact] = writes + lightingReads + ssaoReads + waterReads;
+
+            sprintf(line, "%s%s: %u bytes/pixel, %.1f MB | per frame: writes %.1f MB, lighting %.1f MB, SSAO %.1f MB, water %.1f MB, total %.1f MB\n",
+                layout.name, (compact != 0) == compactInUse ? " (in use)" : "", bytesPerPixel, memory / megabyte,
+                writes / megabyte, lightingReads / megabyte, ssaoReads / megabyte, waterReads / megabyte, totals[compact] / megabyte);
+            report += line;
+        }
+
+        sprintf(line, "compact moves %.0f%% of the full layout bytes\n", totals[1] / totals[0] * 100.0);
+        report += line;
+
+        ILOG("G-buffer bandwidth\n%s", report.c_str());
+        return report;
+    }
+}
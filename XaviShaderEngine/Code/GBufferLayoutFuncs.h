@@ -0,0 +1,35 @@
+
+#ifndef GBUFFER_LAYOUT_FUNC
+#define GBUFFER_LAYOUT_FUNC
+
+#include "Globals.h"
+
+#define GBUFFER_MAX_COLOR_ATTACHMENTS 5
+
+// Color attachments of the deferred G-buffers, the depth-stencil attachment is the same in both layouts
+struct GBufferLayout
+{
+    const char* name;
+    u32 colorCount;
+    GLenum colorFormats[GBUFFER_MAX_COLOR_ATTACHMENTS];
+    u32 colorBytes[GBUFFER_MAX_COLOR_ATTACHMENTS];
+
+    // per pixel, what the passes that read the G-buffer fetch from it
+    u32 lightingReadBytes;
+    u32 ssaoDepthBytes; // the SSAO downsample reads the depth once per pixel, the samples read its own copy
+    u32 waterDepthBytes; // the water reads the main depth for its tint
+};
+
+namespace GBuffer
+{
+    // Albedo RGBA8, octahedral normal RG16 and the hardware depth, or the old five attachment layout
+    const GBufferLayout& Layout(bool compact);
+
+    u32 BytesPerPixel(const GBufferLayout& layout);
+
+    // Memory and estimated bytes moved per frame of both layouts at this size, every G-buffer written once per
+    // pixel and read by its lighting pass, the main one also by the SSAO downsample and the water
+    std::string BandwidthReport(ivec2 size, u32 gBufferCount, bool compactInUse);
+}
+
+#endif // !GBUFFER_LAYOUT_FUNC
@@ -0,0 +1,171 @@
+
+#include "GLStateFuncs.h"
+
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_UNKNOWN 0xFFFFFFFF
+
+namespace GLState
+{
+    enum TextureTarget
+    {
+        TextureTarget_2D,
+        TextureTarget_2DArray,
+        TextureTarget_Count
+    };
+
+    struct ShadowState
+    {
+        GLuint program;
+        GLuint vao;
+        GLenum activeUnit;
+        GLuint textures[GL_STATE_TEXTURE_UNITS][TextureTarget_Count];
+        GLuint drawFramebuffer;
+        GLuint readFramebuffer;
+        ivec4 viewport;
+        vec4 clearColor;
+        bool viewportKnown;
+        bool clearColorKnown;
+
+        GLStateCounters counters;
+        GLStateCounters lastFrameCounters;
+    };
+
+    static ShadowState GlobalState = {};
+
+    static bool Filter(GLStateCall call, bool redundant)
+    {
+        if (redundant)
+            ++GlobalState.counters.filtered[call];
+        else
+            ++GlobalState.counters.issued[call];
+        return redundant;
+    }
+
+    static i32 TargetIndex(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return TextureTarget_2D;
+        case GL_TEXTURE_2D_ARRAY: return TextureTarget_2DArray;
+        default: return -1;
+        }
+    }
+
+    void BeginFrame()
+    {
+        GlobalState.lastFrameCounters = GlobalState.counters;
+        GlobalState.counters = {};
+        Invalidate();
+    }
+
+    void Invalidate()
+    {
+        GlobalState.program = GL_STATE_UNKNOWN;
+        GlobalState.vao = GL_STATE_UNKNOWN;
+        GlobalState.activeUnit = GL_STATE_UNKNOWN;
+        for (u32 unit = 0; unit < GL_STATE_TEXTURE_UNITS; ++unit)
+            for (u32 target = 0; target < TextureTarget_Count; ++target)
+                GlobalState.textures[unit][target] = GL_STATE_UNKNOWN;
+        GlobalState.drawFramebuffer = GL_STATE_UNKNOWN;
+        GlobalState.readFramebuffer = GL_STATE_UNKNOWN;
+        GlobalState.viewportKnown = false;
+        GlobalState.clearColorKnown = false;
+    }
+
+    void UseProgram(GLuint program)
+    {
+        if (Filter(GLStateCall_UseProgram, GlobalState.program == program))
+            return;
+        GlobalState.program = program;
+        glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vao)
+    {
+        if (Filter(GLStateCall_BindVertexArray, GlobalState.vao == vao))
+            return;
+        GlobalState.vao = vao;
+        glBindVertexArray(vao);
+    }
+
+    void ActiveTexture(GLenum unit)
+    {
+        if (Filter(GLStateCall_ActiveTexture, GlobalState.activeUnit == unit))
+            return;
+        GlobalState.activeUnit = unit;
+        glActiveTexture(unit);
+    }
+
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        u32 unit = GlobalState.activeUnit - GL_TEXTURE0;
+        i32 targetIndex = TargetIndex(target);
+
+        // unknown unit or target, nothing to compare against
+        if (GlobalState.activeUnit == GL_STATE_UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS || targetIndex < 0)
+        {
+            Filter(GLStateCall_BindTexture, false);
+            glBindTexture(target, texture);
+            return;
+        }
+
+        if (Filter(GLStateCall_BindTexture, GlobalState.textures[unit][targetIndex] == texture))
+            return;
+        GlobalState.textures[unit][targetIndex] = texture;
+        glBindTexture(target, texture);
+    }
+
+    void BindFramebuffer(GLenum target, GLuint framebuffer)
+    {
+        bool bindsDraw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+        bool bindsRead = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+        bool redundant = (!bindsDraw || GlobalState.drawFramebuffer == framebuffer) && (!bindsRead || GlobalState.readFramebuffer == framebuffer);
+
+        if (Filter(GLStateCall_BindFramebuffer, redundant))
+            return;
+        if (bindsDraw)
+            GlobalState.drawFramebuffer = framebuffer;
+        if (bindsRead)
+            GlobalState.readFramebuffer = framebuffer;
+        glBindFramebuffer(target, framebuffer);
+    }
+
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        ivec4 viewport = ivec4(x, y, width, height);
+        if (Filter(GLStateCall_Viewport, GlobalState.viewportKnown && GlobalState.viewport == viewport))
+            return;
+        GlobalState.viewport = viewport;
+        GlobalState.viewportKnown = true;
+        glViewport(x, y, width, height);
+    }
+
+    void ClearColor(f32 r, f32 g, f32 b, f32 a)
+    {
+        vec4 clearColor = vec4(r, g, b, a);
+        if (Filter(GLStateCall_ClearColor, GlobalState.clearColorKnown && GlobalState.clearColor == clearColor))
+            return;
+        GlobalState.clearColor = clearColor;
+        GlobalState.clearColorKnown = true;
+        glClearColor(r, g, b, a);
+    }
+
+    const GLStateCounters& LastFrameCounters()
+    {
+        return GlobalState.lastFrameCounters;
+    }
+
+    const char* CallName(GLStateCall call)
+    {
+        static const char* names[GLStateCall_Count] = {
+            "glUseProgram",
+            "glBindVertexArray",
+            "glActiveTexture",
+            "glBindTexture",
+            "glBindFramebuffer",
+            "glViewport",
+            "glClearColor"
+        };
+        return names[call];
+    }
+}
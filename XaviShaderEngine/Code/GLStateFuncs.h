@@ -0,0 +1,54 @@
+
+#ifndef GL_STATE_FUNC
+#define GL_STATE_FUNC
+
+#include "Globals.h"
+
+enum GLStateCall
+{
+    GLStateCall_UseProgram,
+    GLStateCall_BindVertexArray,
+    GLStateCall_ActiveTexture,
+    GLStateCall_BindTexture,
+    GLStateCall_BindFramebuffer,
+    GLStateCall_Viewport,
+    GLStateCall_ClearColor,
+    GLStateCall_Count
+};
+
+struct GLStateCounters
+{
+    u32 issued[GLStateCall_Count];
+    u32 filtered[GLStateCall_Count];
+};
+
+// Shadow copy of the bind state, calls that would not change it never reach the driver.
+// Every bind of this state has to go through here, anything else must call Invalidate after.
+namespace GLState
+{
+    // Forgets the shadow state (ImGui and the init code bind behind its back) and starts new counters
+    void BeginFrame();
+
+    void Invalidate();
+
+    void UseProgram(GLuint program);
+
+    void BindVertexArray(GLuint vao);
+
+    void ActiveTexture(GLenum unit);
+
+    void BindTexture(GLenum target, GLuint texture);
+
+    void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void ClearColor(f32 r, f32 g, f32 b, f32 a);
+
+    // Counters of the last complete frame
+    const GLStateCounters& LastFrameCounters();
+
+    const char* CallName(GLStateCall call);
+}
+
+#endif // !GL_STATE_FUNC
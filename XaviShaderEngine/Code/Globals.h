@@ -134,6 +134,8 @@ struct Model
 {
     u32 meshIdx;
     std::vector<u32> materialIdx;
+    vec3 boundsCenter; // bounding sphere in model space
+    f32  boundsRadius;
 };
 
 enum Mode
@@ -181,6 +183,7 @@ struct Entity {
     u32 modelIndex;
     u32 localParamsOffset;
     u32 localParamsSize;
+    u32 transformNode;
 };
 
 enum LightType {
@@ -193,6 +196,7 @@ struct Light {
     vec3 color;
     vec3 direction;
     vec3 position;
+    float radius; // point lights light nothing past it
 };
 
 struct FrameBuffer
@@ -0,0 +1,68 @@
+
+#include "GpuProfilerFuncs.h"
+
+namespace GpuProfiler
+{
+    void BeginFrame(GpuTimers& timers)
+    {
+        timers.frame++;
+        timers.depth = 0;
+        u32 slot = timers.frame % GPU_PROFILER_FRAMES;
+
+        for (u32 i = 0; i < timers.scopes.size(); ++i)
+        {
+            GpuScope& scope = timers.scopes[i];
+            if (!scope.issued[slot])
+                continue;
+
+            // still not there after the frames in flight, keep the old value instead of stalling
+            GLint available = 0;
+            glGetQueryObjectiv(scope.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(scope.queries[slot][0], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(scope.queries[slot][1], GL_QUERY_RESULT, &end);
+                scope.milliseconds = (f64)(end - begin) / 1000000.0;
+            }
+            scope.issued[slot] = false;
+        }
+    }
+
+    u32 Begin(GpuTimers& timers, const char* name)
+    {
+        u32 index = 0;
+        while (index < timers.scopes.size() && strcmp(timers.scopes[index].name, name) != 0)
+            ++index;
+
+        if (index == timers.scopes.size())
+        {
+            GpuScope scope = {};
+            scope.name = name;
+            glGenQueries(2 * GPU_PROFILER_FRAMES, &scope.queries[0][0]);
+            timers.scopes.push_back(scope);
+        }
+
+        GpuScope& scope = timers.scopes[index];
+        u32 slot = timers.frame % GPU_PROFILER_FRAMES;
+        scope.depth = timers.depth++;
+        glQueryCounter(scope.queries[slot][0], GL_TIMESTAMP);
+        return index;
+    }
+
+    void End(GpuTimers& timers, u32 scope)
+    {
+        u32 slot = timers.frame % GPU_PROFILER_FRAMES;
+        glQueryCounter(timers.scopes[scope].queries[slot][1], GL_TIMESTAMP);
+        timers.scopes[scope].issued[slot] = true;
+        timers.depth--;
+    }
+
+    f64 Milliseconds(const GpuTimers& timers, const char* name)
+    {
+        for (u32 i = 0; i < timers.scopes.size(); ++i)
+            if (strcmp(timers.scopes[i].name, name) == 0)
+                return timers.scopes[i].milliseconds;
+        return 0.0;
+    }
+}
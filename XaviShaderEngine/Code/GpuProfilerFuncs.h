@@ -0,0 +1,41 @@
+
+#ifndef GPU_PROFILER_FUNC
+#define GPU_PROFILER_FUNC
+
+#include "Globals.h"
+
+// Results are read this many frames after they were issued, so the CPU never waits for them
+#define GPU_PROFILER_FRAMES 4
+
+// Timestamps around a named part of the frame, scopes can nest
+struct GpuScope
+{
+    const char* name;
+    GLuint queries[GPU_PROFILER_FRAMES][2]; // begin and end timestamp of every frame in flight
+    bool issued[GPU_PROFILER_FRAMES];
+    u32 depth;
+    f64 milliseconds; // last resolved frame
+};
+
+struct GpuTimers
+{
+    std::vector<GpuScope> scopes;
+    u32 frame;
+    u32 depth;
+};
+
+namespace GpuProfiler
+{
+    // Resolves the scopes issued GPU_PROFILER_FRAMES frames ago and starts a new frame
+    void BeginFrame(GpuTimers& timers);
+
+    // Returns the scope to pass to End, the name has to outlive the timers
+    u32 Begin(GpuTimers& timers, const char* name);
+
+    void End(GpuTimers& timers, u32 scope);
+
+    // Last resolved time of the scope, 0 if it never ran
+    f64 Milliseconds(const GpuTimers& timers, const char* name);
+}
+
+#endif // !GPU_PROFILER_FUNC
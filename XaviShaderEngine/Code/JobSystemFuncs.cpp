@@ -0,0 +1,132 @@
+
+#include "JobSystemFuncs.h"
+#include "platform.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace JobSystem
+{
+    struct WorkerPool
+    {
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+
+        // current ParallelFor, written under the mutex before waking the workers
+        const std::function<void(u32, u32)>* job;
+        u32 count;
+        u32 rangeSize;
+        u32 rangeCount;
+        std::atomic<u32> nextRange;
+        u32 pendingWorkers;
+        u64 generation;
+        bool quit;
+    };
+
+    static WorkerPool* GlobalWorkerPool = NULL;
+
+    static void RunRanges(WorkerPool& pool)
+    {
+        for (u32 range = pool.nextRange++; range < pool.rangeCount; range = pool.nextRange++)
+        {
+            u32 begin = range * pool.rangeSize;
+            u32 end = glm::min(begin + pool.rangeSize, pool.count);
+            (*pool.job)(begin, end);
+        }
+    }
+
+    static void WorkerMain(WorkerPool* pool)
+    {
+        u64 seenGeneration = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(pool->mutex);
+                pool->wakeCondition.wait(lock, [&] { return pool->quit || pool->generation != seenGeneration; });
+                if (pool->quit)
+                    return;
+                seenGeneration = pool->generation;
+            }
+
+            RunRanges(*pool);
+
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            if (--pool->pendingWorkers == 0)
+                pool->doneCondition.notify_one();
+        }
+    }
+
+    void Init(u32 workerCount)
+    {
+        ASSERT(GlobalWorkerPool == NULL, "The job system is already initialized");
+
+        GlobalWorkerPool = new WorkerPool();
+        GlobalWorkerPool->job = NULL;
+        GlobalWorkerPool->generation = 0;
+        GlobalWorkerPool->quit = false;
+        for (u32 i = 0; i < workerCount; ++i)
+            GlobalWorkerPool->workers.push_back(std::thread(WorkerMain, GlobalWorkerPool));
+    }
+
+    void Shutdown()
+    {
+        if (!GlobalWorkerPool)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(GlobalWorkerPool->mutex);
+            GlobalWorkerPool->quit = true;
+        }
+        GlobalWorkerPool->wakeCondition.notify_all();
+        for (u32 i = 0; i < GlobalWorkerPool->workers.size(); ++i)
+            GlobalWorkerPool->workers[i].join();
+
+        delete GlobalWorkerPool;
+        GlobalWorkerPool = NULL;
+    }
+
+    u32 WorkerCount()
+    {
+        return GlobalWorkerPool ? (u32)GlobalWorkerPool->workers.size() : 0;
+    }
+
+    void ParallelFor(u32 count, u32 minRangeSize, const std::function<void(u32 begin, u32 end)>& job)
+    {
+        if (count == 0)
+            return;
+
+        // a few ranges per thread so a slow range does not leave the others idle
+        u32 threadCount = WorkerCount() + 1;
+        u32 rangeSize = glm::max(glm::max(minRangeSize, 1u), (count + threadCount * 4 - 1) / (threadCount * 4));
+        u32 rangeCount = (count + rangeSize - 1) / rangeSize;
+
+        if (threadCount == 1 || rangeCount == 1)
+        {
+            job(0, count);
+            return;
+        }
+
+        WorkerPool& pool = *GlobalWorkerPool;
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.job = &job;
+            pool.count = count;
+            pool.rangeSize = rangeSize;
+            pool.rangeCount = rangeCount;
+            pool.nextRange = 0;
+            pool.pendingWorkers = (u32)pool.workers.size();
+            ++pool.generation;
+        }
+        pool.wakeCondition.notify_all();
+
+        RunRanges(pool);
+
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.doneCondition.wait(lock, [&] { return pool.pendingWorkers == 0; });
+        pool.job = NULL;
+    }
+}
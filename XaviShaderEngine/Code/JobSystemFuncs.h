@@ -0,0 +1,22 @@
+
+#ifndef JOB_SYSTEM_FUNC
+#define JOB_SYSTEM_FUNC
+
+#include "Globals.h"
+#include <functional>
+
+// Fixed pool of worker threads. The calling thread takes part in every ParallelFor,
+// so with zero workers everything simply runs inline.
+namespace JobSystem
+{
+    void Init(u32 workerCount);
+
+    void Shutdown();
+
+    u32 WorkerCount();
+
+    // Splits [0, count) in ranges of at least minRangeSize and waits for all of them
+    void ParallelFor(u32 count, u32 minRangeSize, const std::function<void(u32 begin, u32 end)>& job);
+}
+
+#endif // !JOB_SYSTEM_FUNC
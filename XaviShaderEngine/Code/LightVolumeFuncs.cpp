@@ -0,0 +1,190 @@
+
+#include "LightVolumeFuncs.h"
+#include "GLStateFuncs.h"
+#include "platform.h"
+#include <map>
+
+// the icosphere facets sit inside the unit sphere, this covers them
+#define LIGHT_VOLUME_SCALE 1.1f
+
+namespace LightVolumes
+{
+    static u32 Midpoint(std::vector<vec3>& vertices, std::map<u64, u32>& midpoints, u32 a, u32 b)
+    {
+        u64 key = a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+        std::map<u64, u32>::iterator it = midpoints.find(key);
+        if (it != midpoints.end())
+            return it->second;
+
+        vertices.push_back(glm::normalize(vertices[a] + vertices[b]));
+        midpoints[key] = vertices.size() - 1;
+        return vertices.size() - 1;
+    }
+
+    static void CreateIcosphere(LightVolumeRenderer& renderer)
+    {
+        const f32 t = (1.0f + sqrtf(5.0f)) * 0.5f;
+        std::vector<vec3> vertices = {
+            vec3(-1, t, 0), vec3(1, t, 0), vec3(-1, -t, 0), vec3(1, -t, 0),
+            vec3(0, -1, t), vec3(0, 1, t), vec3(0, -1, -t), vec3(0, 1, -t),
+            vec3(t, 0, -1), vec3(t, 0, 1), vec3(-t, 0, -1), vec3(-t, 0, 1)
+        };
+        for (u32 i = 0; i < vertices.size(); ++i)
+            vertices[i] = glm::normalize(vertices[i]);
+
+        std::vector<u16> indices = {
+            0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+            1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+            3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+            4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1
+        };
+
+        // one subdivision, 80 triangles
+        std::map<u64, u32> midpoints;
+        std::vector<u16> subdivided;
+        for (u32 i = 0; i < indices.size(); i += 3)
+        {
+            u32 a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            u32 ab = Midpoint(vertices, midpoints, a, b);
+            u32 bc = Midpoint(vertices, midpoints, b, c);
+            u32 ca = Midpoint(vertices, midpoints, c, a);
+            u16 triangles[] = { (u16)a, (u16)ab, (u16)ca, (u16)b, (u16)bc, (u16)ab, (u16)c, (u16)ca, (u16)bc, (u16)ab, (u16)bc, (u16)ca };
+            subdivided.insert(subdivided.end(), triangles, triangles + ARRAY_COUNT(triangles));
+        }
+
+        glGenVertexArrays(1, &renderer.sphereVao);
+        GLState::BindVertexArray(renderer.sphereVao);
+
+        glGenBuffers(1, &renderer.sphereVertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, renderer.sphereVertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glGenBuffers(1, &renderer.sphereIndexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.sphereIndexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, subdivided.size() * sizeof(u16), subdivided.data(), GL_STATIC_DRAW);
+        renderer.sphereIndexCount = subdivided.size();
+
+        GLState::BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void Create(LightVolumeRenderer& renderer)
+    {
+        CreateIcosphere(renderer);
+
+        renderer.accumulationTexture = 0;
+        glGenFramebuffers(1, &renderer.accumulationFrameBuffer);
+    }
+
+    void SetTargets(LightVolumeRenderer& renderer, GLuint accumulationTexture, GLuint depthStencil, GLuint gBufferFrameBuffer, ivec2 size)
+    {
+        renderer.accumulationTexture = accumulationTexture;
+
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, renderer.accumulationFrameBuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, accumulationTexture, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthStencil, 0);
+
+        GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+            ELOG("Light accumulation framebuffer incomplete: 0x%x", framebufferStatus);
+
+        // only the depth, every light clears the stencil
+        GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, gBufferFrameBuffer);
+        GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, renderer.accumulationFrameBuffer);
+        glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    static void SetLightUniforms(GLuint program, const Light& light, u32 lightIndex)
+    {
+        glUniform1ui(glGetUniformLocation(program, "uLightType"), light.type);
+        glUniform3fv(glGetUniformLocation(program, "uLightColor"), 1, glm::value_ptr(light.color));
+        glUniform3fv(glGetUniformLocation(program, "uLightDirection"), 1, glm::value_ptr(light.direction));
+        glUniform4f(glGetUniformLocation(program, "uLightPositionRadius"), light.position.x, light.position.y, light.position.z, light.radius);
+        glUniform1ui(glGetUniformLocation(program, "uLightIndex"), lightIndex);
+    }
+
+    void Accumulate(const LightVolumeRenderer& renderer, GLuint program, const std::vector<Light>& lights, const glm::mat4& viewProjection, GLuint fullscreenVao)
+    {
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, renderer.accumulationFrameBuffer);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        GLState::ClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // the depth is the G-buffer one, it is tested against but never written
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_FUNC_ADD);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        // directional lights cover the whole screen, the first one casts the shadows
+        glDisable(GL_DEPTH_TEST);
+        glUniform1i(glGetUniformLocation(program, "uFullscreen"), 1);
+        GLint castsShadowLocation = glGetUniformLocation(program, "uCastsShadow");
+        bool firstDirectional = true;
+        GLState::BindVertexArray(fullscreenVao);
+        for (u32 i = 0; i < lights.size(); ++i)
+        {
+            if (lights[i].type != LightType_Directional)
+                continue;
+            SetLightUniforms(program, lights[i], i);
+            glUniform1i(castsShadowLocation, firstDirectional);
+            firstDirectional = false;
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+        }
+
+        glUniform1i(glGetUniformLocation(program, "uFullscreen"), 0);
+        glUniform1i(castsShadowLocation, 0);
+        GLint worldViewProjectionLocation = glGetUniformLocation(program, "uWorldViewProjection");
+        glEnable(GL_STENCIL_TEST);
+        GLState::BindVertexArray(renderer.sphereVao);
+        for (u32 i = 0; i < lights.size(); ++i)
+        {
+            const Light& light = lights[i];
+            if (light.type != LightType_Point || light.radius <= 0.0f)
+                continue;
+
+            glm::mat4 worldViewProjection = viewProjection * glm::scale(glm::translate(light.position), vec3(light.radius * LIGHT_VOLUME_SCALE));
+            glUniformMatrix4fv(worldViewProjectionLocation, 1, GL_FALSE, &worldViewProjection[0][0]);
+            SetLightUniforms(program, light, i);
+
+            // stencil pass: non zero where a back face is behind the surface and the front face is not
+            glDrawBuffer(GL_NONE);
+            glEnable(GL_DEPTH_TEST);
+            glDisable(GL_CULL_FACE);
+            glClear(GL_STENCIL_BUFFER_BIT);
+            glStencilFunc(GL_ALWAYS, 0, 0);
+            glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+            glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            glDrawElements(GL_TRIANGLES, renderer.sphereIndexCount, GL_UNSIGNED_SHORT, 0);
+
+            // light pass: back faces only, so it still works with the camera inside the sphere
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+            glDrawElements(GL_TRIANGLES, renderer.sphereIndexCount, GL_UNSIGNED_SHORT, 0);
+            glCullFace(GL_BACK);
+        }
+
+        GLState::BindVertexArray(0);
+        glDisable(GL_STENCIL_TEST);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glDepthMask(GL_TRUE);
+    }
+
+    void Resolve(const LightVolumeRenderer& renderer, ivec2 sourceSize, ivec2 targetSize)
+    {
+        GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, renderer.accumulationFrameBuffer);
+        GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        GLenum filter = sourceSize == targetSize ? GL_NEAREST : GL_LINEAR;
+        glBlitFramebuffer(0, 0, sourceSize.x, sourceSize.y, 0, 0, targetSize.x, targetSize.y, GL_COLOR_BUFFER_BIT, filter);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
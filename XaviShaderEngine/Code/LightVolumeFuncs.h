@@ -0,0 +1,37 @@
+
+#ifndef LIGHT_VOLUME_FUNC
+#define LIGHT_VOLUME_FUNC
+
+#include "Globals.h"
+
+// Deferred lighting without compute: every point light is a sphere, the stencil keeps the pixels inside it
+struct LightVolumeRenderer
+{
+    // unit icosphere, scaled by the light radius
+    GLuint sphereVao;
+    GLuint sphereVertexBuffer;
+    GLuint sphereIndexBuffer;
+    u32 sphereIndexCount;
+
+    // additive light accumulation and a copy of the G-buffer depth for the sphere tests, both frame graph transients.
+    // The shading samples the G-buffer depth, so it is never attached while it is read
+    GLuint accumulationTexture;
+    GLuint accumulationFrameBuffer;
+};
+
+namespace LightVolumes
+{
+    void Create(LightVolumeRenderer& renderer);
+
+    // Attaches the targets of the current size and copies the depth of gBufferFrameBuffer into depthStencil. Both
+    // depths are GL_DEPTH24_STENCIL8 of the size of the GL_RGBA16F accumulation texture
+    void SetTargets(LightVolumeRenderer& renderer, GLuint accumulationTexture, GLuint depthStencil, GLuint gBufferFrameBuffer, ivec2 size);
+
+    // The program is in use and has the G-buffer bound, the result stays in the accumulation target
+    void Accumulate(const LightVolumeRenderer& renderer, GLuint program, const std::vector<Light>& lights, const glm::mat4& viewProjection, GLuint fullscreenVao);
+
+    // Copies the accumulation target to the default framebuffer, scaled while they differ
+    void Resolve(const LightVolumeRenderer& renderer, ivec2 sourceSize, ivec2 targetSize);
+}
+
+#endif // !LIGHT_VOLUME_FUNC
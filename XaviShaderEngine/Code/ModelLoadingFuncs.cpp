@@ -3,6 +3,7 @@
 
 #include <stb_image.h>
 #include <stb_image_write.h>
+#include <float.h>
 
 namespace ModelLoader
 {
@@ -42,7 +43,7 @@ namespace ModelLoader
 
         GLuint texHandle;
         glGenTextures(1, &texHandle);
-        glBindTexture(GL_TEXTURE_2D, texHandle);
+        GLState::BindTexture(GL_TEXTURE_2D, texHandle);
         glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -50,7 +51,7 @@ namespace ModelLoader
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
 
         return texHandle;
     }
@@ -283,6 +284,26 @@ namespace ModelLoader
 
         aiReleaseImport(scene);
 
+        // bounding sphere enclosing the aabb of every submesh
+        vec3 boundsMin = vec3(FLT_MAX);
+        vec3 boundsMax = vec3(-FLT_MAX);
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        {
+            const SubMesh& submesh = mesh.submeshes[i];
+            const u32 floatStride = submesh.vertexBufferLayout.stride / sizeof(float);
+            for (u32 v = 0; v + 2 < submesh.vertices.size(); v += floatStride)
+            {
+                vec3 position = vec3(submesh.vertices[v], submesh.vertices[v + 1], submesh.vertices[v + 2]);
+                boundsMin = glm::min(boundsMin, position);
+                boundsMax = glm::max(boundsMax, position);
+            }
+        }
+        if (boundsMin.x <= boundsMax.x)
+        {
+            model.boundsCenter = (boundsMin + boundsMax) * 0.5f;
+            model.boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+        }
+
         u32 vertexBufferSize = 0;
         u32 indexBufferSize = 0;
 
@@ -0,0 +1,188 @@
+
+#include "OcclusionCullingFuncs.h"
+#include "GLStateFuncs.h"
+
+namespace OcclusionCulling
+{
+    void Resize(GpuCulling& culling, ivec2 size)
+    {
+        if (culling.hiZTexture != 0)
+            glDeleteTextures(1, &culling.hiZTexture);
+
+        culling.hiZSize = size;
+        culling.hiZMipCount = 1;
+        for (i32 maxSize = glm::max(size.x, size.y); maxSize > 1; maxSize >>= 1)
+            ++culling.hiZMipCount;
+
+        glGenTextures(1, &culling.hiZTexture);
+        GLState::BindTexture(GL_TEXTURE_2D, culling.hiZTexture);
+        glTexStorage2D(GL_TEXTURE_2D, culling.hiZMipCount, GL_R32F, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+
+        // the depth it would be built from is not this size yet
+        culling.hasDepthHistory = false;
+    }
+
+    void Create(GpuCulling& culling, ivec2 size)
+    {
+        culling.hiZTexture = 0;
+        Resize(culling, size);
+
+        glGenBuffers(1, &culling.instanceBuffer);
+        glGenBuffers(1, &culling.visibleBuffer);
+        glGenBuffers(1, &culling.commandBuffer);
+
+        culling.prevViewProjection = glm::mat4(1.0f);
+    }
+
+    vec4 WorldBoundingSphere(const glm::mat4& worldMatrix, const Model& model)
+    {
+        vec3 center = vec3(worldMatrix * vec4(model.boundsCenter, 1.0f));
+        float maxScale = glm::max(glm::length(vec3(worldMatrix[0])), glm::max(glm::length(vec3(worldMatrix[1])), glm::length(vec3(worldMatrix[2]))));
+        return vec4(center, model.boundsRadius * maxScale);
+    }
+
+    void ExtractFrustumPlanes(const glm::mat4& viewProjection, vec4 planes[6])
+    {
+        glm::mat4 m = glm::transpose(viewProjection);
+        planes[0] = m[3] + m[0]; // left
+        planes[1] = m[3] - m[0]; // right
+        planes[2] = m[3] + m[1]; // bottom
+        planes[3] = m[3] - m[1]; // top
+        planes[4] = m[3] + m[2]; // near
+        planes[5] = m[3] - m[2]; // far
+        for (u32 i = 0; i < 6; ++i)
+            planes[i] /= glm::length(vec3(planes[i]));
+    }
+
+    void UploadInstances(GpuCulling& culling)
+    {
+        u32 visibleCapacity = 0;
+        for (u32 i = 0; i < culling.batches.size(); ++i)
+            visibleCapacity += culling.batches[i].instanceCapacity;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, culling.instances.size() * sizeof(CullInstance), culling.instances.data(), GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.visibleBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, glm::max(visibleCapacity, 1u) * sizeof(u32), NULL, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, culling.batches.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void UpdateInstances(GpuCulling& culling, const std::vector<u32>& instanceIndices)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.instanceBuffer);
+        for (u32 i = 0; i < instanceIndices.size(); ++i)
+        {
+            u32 index = instanceIndices[i];
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, index * sizeof(CullInstance), sizeof(CullInstance), &culling.instances[index]);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void BuildDepthPyramid(GpuCulling& culling, GLuint buildProgram, GLuint depthTexture)
+    {
+        ReduceDepth(buildProgram, depthTexture, culling.hiZTexture, culling.hiZSize, culling.hiZMipCount, false);
+    }
+
+    void ReduceDepth(GLuint buildProgram, GLuint depthTexture, GLuint pyramidTexture, ivec2 size, u32 mipCount, bool keepNearest)
+    {
+        GLState::UseProgram(buildProgram);
+        glUniform1i(glGetUniformLocation(buildProgram, "uSource"), 0);
+        glUniform1i(glGetUniformLocation(buildProgram, "uKeepNearest"), keepNearest);
+        GLState::ActiveTexture(GL_TEXTURE0);
+
+        ivec2 sourceSize = size;
+        for (u32 level = 0; level < mipCount; ++level)
+        {
+            ivec2 levelSize = glm::max(size >> ivec2(level), ivec2(1));
+
+            // level 0 copies the depth attachment, the rest reduce the previous level
+            GLState::BindTexture(GL_TEXTURE_2D, level == 0 ? depthTexture : pyramidTexture);
+            glUniform1i(glGetUniformLocation(buildProgram, "uSourceLevel"), (GLint)level - 1);
+            glUniform2i(glGetUniformLocation(buildProgram, "uSourceSize"), sourceSize.x, sourceSize.y);
+            glBindImageTexture(0, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+            glDispatchCompute((levelSize.x + 7) / 8, (levelSize.y + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+            sourceSize = levelSize;
+        }
+
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+        GLState::UseProgram(0);
+    }
+
+    void CullInstances(GpuCulling& culling, GLuint cullProgram, const glm::mat4& viewProjection)
+    {
+        if (culling.batches.empty())
+            return;
+
+        // the cull pass re-counts the visible instances of every batch
+        std::vector<DrawElementsIndirectCommand> commands(culling.batches.size());
+        for (u32 i = 0; i < culling.batches.size(); ++i)
+        {
+            const CullBatch& batch = culling.batches[i];
+            commands[i] = { batch.indexCount, 0, batch.firstIndex, 0, batch.firstInstance };
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.commandBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        vec4 frustumPlanes[6];
+        ExtractFrustumPlanes(viewProjection, frustumPlanes);
+
+        GLState::UseProgram(cullProgram);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culling.instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culling.visibleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culling.commandBuffer);
+
+        glUniform1ui(glGetUniformLocation(cullProgram, "uInstanceCount"), (GLuint)culling.instances.size());
+        glUniform4fv(glGetUniformLocation(cullProgram, "uFrustumPlanes"), 6, &frustumPlanes[0].x);
+        glUniformMatrix4fv(glGetUniformLocation(cullProgram, "uPrevViewProjection"), 1, GL_FALSE, &culling.prevViewProjection[0][0]);
+        glUniform1i(glGetUniformLocation(cullProgram, "uUseOcclusion"), culling.hasDepthHistory);
+        glUniform2f(glGetUniformLocation(cullProgram, "uHiZSize"), (float)culling.hiZSize.x, (float)culling.hiZSize.y);
+        glUniform1i(glGetUniformLocation(cullProgram, "uHiZMaxLevel"), (GLint)culling.hiZMipCount - 1);
+
+        GLState::ActiveTexture(GL_TEXTURE0);
+        GLState::BindTexture(GL_TEXTURE_2D, culling.hiZTexture);
+        glUniform1i(glGetUniformLocation(cullProgram, "uHiZ"), 0);
+
+        glDispatchCompute(((GLuint)culling.instances.size() + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+        GLState::UseProgram(0);
+    }
+
+    void DrawBatches(const GpuCulling& culling, GLuint drawProgram)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culling.instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culling.visibleBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culling.commandBuffer);
+
+        GLint firstInstanceLocation = glGetUniformLocation(drawProgram, "uFirstInstance");
+        glUniform1i(glGetUniformLocation(drawProgram, "uTexture"), 0);
+        GLState::ActiveTexture(GL_TEXTURE0);
+
+        for (u32 i = 0; i < culling.batches.size(); ++i)
+        {
+            const CullBatch& batch = culling.batches[i];
+            GLState::BindVertexArray(batch.vao);
+            GLState::BindTexture(GL_TEXTURE_2D, batch.textureHandle);
+            glUniform1ui(firstInstanceLocation, batch.firstInstance);
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(u64)(i * sizeof(DrawElementsIndirectCommand)));
+        }
+
+        GLState::BindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
@@ -0,0 +1,83 @@
+
+#ifndef OCCLUSION_CULLING_FUNC
+#define OCCLUSION_CULLING_FUNC
+
+#include "Globals.h"
+
+// Same layout as the indirect command read by glDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount;
+    u32 firstIndex;
+    u32 baseVertex;
+    u32 baseInstance; // first slot of the batch in the visible instance list
+};
+
+// One indirect draw per submesh, its instances are all the entities using that model
+struct CullBatch
+{
+    GLuint vao;
+    GLuint textureHandle;
+    u32 indexCount;
+    u32 firstIndex;
+    u32 firstInstance;
+    u32 instanceCapacity;
+};
+
+// std430 mirror of InstanceData in HiZCull.glsl and RENDER_TO_FB_INDIRECT.glsl
+struct CullInstance
+{
+    glm::mat4 worldMatrix;
+    vec4 boundingSphere; // xyz world center, w radius
+    u32 firstBatch;
+    u32 batchCount;
+    u32 padding[2];
+};
+
+struct GpuCulling
+{
+    // hierarchical depth, every texel keeps the farthest depth of the texels below it
+    GLuint hiZTexture;
+    ivec2 hiZSize;
+    u32 hiZMipCount;
+
+    GLuint instanceBuffer;
+    GLuint visibleBuffer;
+    GLuint commandBuffer;
+
+    std::vector<CullBatch> batches;
+    std::vector<CullInstance> instances;
+
+    // camera that rendered the depth the pyramid is built from
+    glm::mat4 prevViewProjection;
+    bool hasDepthHistory;
+};
+
+namespace OcclusionCulling
+{
+    void Create(GpuCulling& culling, ivec2 size);
+
+    // New pyramid for a depth of that size, culling waits for a depth of the new size
+    void Resize(GpuCulling& culling, ivec2 size);
+
+    vec4 WorldBoundingSphere(const glm::mat4& worldMatrix, const Model& model);
+
+    void ExtractFrustumPlanes(const glm::mat4& viewProjection, vec4 planes[6]);
+
+    void UploadInstances(GpuCulling& culling);
+
+    // Re-uploads only the listed instances, the buffers keep their size
+    void UpdateInstances(GpuCulling& culling, const std::vector<u32>& instanceIndices);
+
+    void BuildDepthPyramid(GpuCulling& culling, GLuint buildProgram, GLuint depthTexture);
+
+    // Fills every mip of an R32F pyramid from the depth texture, keeping the farthest depth or the nearest one
+    void ReduceDepth(GLuint buildProgram, GLuint depthTexture, GLuint pyramidTexture, ivec2 size, u32 mipCount, bool keepNearest);
+
+    void CullInstances(GpuCulling& culling, GLuint cullProgram, const glm::mat4& viewProjection);
+
+    void DrawBatches(const GpuCulling& culling, GLuint drawProgram);
+}
+
+#endif // !OCCLUSION_CULLING_FUNC
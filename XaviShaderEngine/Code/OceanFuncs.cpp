@@ -0,0 +1,574 @@
+
+#include "OceanFuncs.h"
+#include "GLStateFuncs.h"
+#include "JobSystemFuncs.h"
+#include "platform.h"
+
+#include <random>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OCEAN_SIMD
+#include <immintrin.h>
+#endif
+
+// columns a job transforms together, a cache line of each row
+#define OCEAN_FFT_BLOCK 16
+#define OCEAN_TRANSPOSE_TILE 32
+#define OCEAN_GRAVITY 9.81f
+
+// The butterflies run on OCEAN_LANES adjacent columns at once, every column is an independent transform
+#if defined(OCEAN_SIMD)
+typedef __m128 Lanes;
+#define OCEAN_LANES 4
+static inline Lanes Load(const f32* p) { return _mm_loadu_ps(p); }
+static inline void Store(f32* p, Lanes v) { _mm_storeu_ps(p, v); }
+static inline Lanes Splat(f32 v) { return _mm_set1_ps(v); }
+static inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+#else
+typedef f32 Lanes;
+#define OCEAN_LANES 1
+static inline Lanes Load(const f32* p) { return *p; }
+static inline void Store(f32* p, Lanes v) { *p = v; }
+static inline Lanes Splat(f32 v) { return v; }
+static inline Lanes Add(Lanes a, Lanes b) { return a + b; }
+static inline Lanes Sub(Lanes a, Lanes b) { return a - b; }
+static inline Lanes Mul(Lanes a, Lanes b) { return a * b; }
+#endif
+
+namespace Ocean
+{
+    static void Run(u32 count, u32 minRangeSize, bool parallel, const std::function<void(u32 begin, u32 end)>& job)
+    {
+        if (parallel)
+            JobSystem::ParallelFor(count, minRangeSize, job);
+        else
+            job(0, count);
+    }
+
+    static f32 Phillips(const OceanSimulation& ocean, vec2 k)
+    {
+        f32 kLength = glm::length(k);
+        if (kLength < 1e-6f)
+            return 0.0f;
+
+        // largest wave the wind raises, and a cut of the ones much shorter than it
+        f32 largestWave = ocean.windSpeed * ocean.windSpeed / OCEAN_GRAVITY;
+        f32 smallestWave = largestWave / 1000.0f;
+        f32 kDotWind = glm::dot(k / kLength, ocean.windDirection);
+        f32 k2 = kLength * kLength;
+
+        return ocean.amplitude * expf(-1.0f / (k2 * largestWave * largestWave)) / (k2 * k2) * kDotWind * kDotWind * expf(-k2 * smallestWave * smallestWave);
+    }
+
+    static void InitSpectrum(OceanSimulation& ocean, u32 resolution)
+    {
+        ASSERT(resolution >= OCEAN_MIN_RESOLUTION && resolution <= OCEAN_MAX_RESOLUTION && BufferManager::IsPowerOf2(resolution), "Unsupported ocean resolution");
+
+        const u32 n = resolution;
+        ocean.resolution = n;
+        ocean.log2Resolution = 0;
+        while ((1u << ocean.log2Resolution) < n)
+            ++ocean.log2Resolution;
+
+        ocean.h0.re.resize(n * n);
+        ocean.h0.im.resize(n * n);
+        ocean.h0MinusConj.re.resize(n * n);
+        ocean.h0MinusConj.im.resize(n * n);
+        ocean.omega.resize(n * n);
+        for (u32 f = 0; f < 3; ++f)
+        {
+            ocean.fields[f].re.resize(n * n);
+            ocean.fields[f].im.resize(n * n);
+            ocean.transposed[f].re.resize(n * n);
+            ocean.transposed[f].im.resize(n * n);
+        }
+
+        // fixed seed, the same sea every run
+        std::mt19937 random(1337);
+        std::normal_distribution<f32> gaussian(0.0f, 1.0f);
+
+        // row m, column n hold k = 2 pi (n - N/2, m - N/2) / patchSize
+        for (u32 m = 0; m < n; ++m)
+        {
+            for (u32 x = 0; x < n; ++x)
+            {
+                vec2 k = 2.0f * glm::pi<f32>() * vec2((f32)x - n / 2, (f32)m - n / 2) / ocean.patchSize;
+                f32 amplitude = sqrtf(Phillips(ocean, k) * 0.5f);
+                ocean.h0.re[m * n + x] = gaussian(random) * amplitude;
+                ocean.h0.im[m * n + x] = gaussian(random) * amplitude;
+                ocean.omega[m * n + x] = sqrtf(OCEAN_GRAVITY * glm::length(k));
+            }
+        }
+        for (u32 m = 0; m < n; ++m)
+        {
+            for (u32 x = 0; x < n; ++x)
+            {
+                u32 minus = ((n - m) % n) * n + (n - x) % n;
+                ocean.h0MinusConj.re[m * n + x] = ocean.h0.re[minus];
+                ocean.h0MinusConj.im[m * n + x] = -ocean.h0.im[minus];
+            }
+        }
+
+        ocean.twiddleRe.resize(n / 2);
+        ocean.twiddleIm.resize(n / 2);
+        for (u32 j = 0; j < n / 2; ++j)
+        {
+            f64 angle = 2.0 * 3.14159265358979323846 * j / n;
+            ocean.twiddleRe[j] = (f32)cos(angle);
+            ocean.twiddleIm[j] = (f32)sin(angle);
+        }
+
+        ocean.bitReverse.resize(n);
+        for (u32 i = 0; i < n; ++i)
+        {
+            u32 reversed = 0;
+            for (u32 b = 0; b < ocean.log2Resolution; ++b)
+                reversed |= ((i >> b) & 1) << (ocean.log2Resolution - 1 - b);
+            ocean.bitReverse[i] = reversed;
+        }
+    }
+
+    // h(k, t) and the fields derived from it, packed in pairs of real results per complex transform
+    static void EvaluateSpectrum(OceanSimulation& ocean, f32 time, bool parallel)
+    {
+        const u32 n = ocean.resolution;
+        Run(n, 8, parallel, [&](u32 begin, u32 end)
+        {
+            for (u32 m = begin; m < end; ++m)
+            {
+                f32 kz = 2.0f * glm::pi<f32>() * ((f32)m - n / 2) / ocean.patchSize;
+                for (u32 x = 0; x < n; ++x)
+                {
+                    u32 i = m * n + x;
+                    f32 kx = 2.0f * glm::pi<f32>() * ((f32)x - n / 2) / ocean.patchSize;
+                    f32 kLength = sqrtf(kx * kx + kz * kz);
+                    f32 c = cosf(ocean.omega[i] * time);
+                    f32 s = sinf(ocean.omega[i] * time);
+
+                    f32 hRe = ocean.h0.re[i] * c - ocean.h0.im[i] * s + ocean.h0MinusConj.re[i] * c + ocean.h0MinusConj.im[i] * s;
+                    f32 hIm = ocean.h0.re[i] * s + ocean.h0.im[i] * c + ocean.h0MinusConj.im[i] * c - ocean.h0MinusConj.re[i] * s;
+                    f32 kxNorm = kLength > 1e-6f ? kx / kLength : 0.0f;
+                    f32 kzNorm = kLength > 1e-6f ? kz / kLength : 0.0f;
+
+                    // h + i Dx with Dx = -i kx / k h
+                    ocean.fields[0].re[i] = hRe * (1.0f + kxNorm);
+                    ocean.fields[0].im[i] = hIm * (1.0f + kxNorm);
+                    // Dz + i dh/dx with dh/dx = i kx h
+                    ocean.fields[1].re[i] = -kx * hRe + kzNorm * hIm;
+                    ocean.fields[1].im[i] = -kx * hIm - kzNorm * hRe;
+                    // dh/dz
+                    ocean.fields[2].re[i] = -kz * hIm;
+                    ocean.fields[2].im[i] = kz * hRe;
+                }
+            }
+        });
+    }
+
+    static inline void ComplexMul(Lanes aRe, Lanes aIm, Lanes wRe, Lanes wIm, Lanes& outRe, Lanes& outIm)
+    {
+        outRe = Sub(Mul(aRe, wRe), Mul(aIm, wIm));
+        outIm = Add(Mul(aRe, wIm), Mul(aIm, wRe));
+    }
+
+    static void Radix2Stage(const OceanSimulation& ocean, f32* re, f32* im, u32 half, u32 c0, u32 c1)
+    {
+        const u32 n = ocean.resolution;
+        const u32 twiddleStep = n / (2 * half);
+        for (u32 base = 0; base < n; base += 2 * half)
+        {
+            for (u32 j = 0; j < half; ++j)
+            {
+                Lanes wRe = Splat(ocean.twiddleRe[j * twiddleStep]);
+                Lanes wIm = Splat(ocean.twiddleIm[j * twiddleStep]);
+                u32 a = (base + j) * n;
+                u32 b = a + half * n;
+                for (u32 c = c0; c < c1; c += OCEAN_LANES)
+                {
+                    Lanes tRe, tIm;
+                    ComplexMul(Load(re + b + c), Load(im + b + c), wRe, wIm, tRe, tIm);
+                    Lanes xRe = Load(re + a + c);
+                    Lanes xIm = Load(im + a + c);
+                    Store(re + a + c, Add(xRe, tRe));
+                    Store(im + a + c, Add(xIm, tIm));
+                    Store(re + b + c, Sub(xRe, tRe));
+                    Store(im + b + c, Sub(xIm, tIm));
+                }
+            }
+        }
+    }
+
+    // Two radix-2 stages in one pass over the rows, half is the one of the first. The twiddle of the odd outputs of
+    // the second stage is the even one times i
+    static void Radix4Stage(const OceanSimulation& ocean, f32* re, f32* im, u32 half, u32 c0, u32 c1)
+    {
+        const u32 n = ocean.resolution;
+        const u32 step1 = n / (2 * half);
+        const u32 step2 = n / (4 * half);
+        for (u32 base = 0; base < n; base += 4 * half)
+        {
+            for (u32 j = 0; j < half; ++j)
+            {
+                Lanes w1Re = Splat(ocean.twiddleRe[j * step1]);
+                Lanes w1Im = Splat(ocean.twiddleIm[j * step1]);
+                Lanes w2Re = Splat(ocean.twiddleRe[j * step2]);
+                Lanes w2Im = Splat(ocean.twiddleIm[j * step2]);
+                u32 r0 = (base + j) * n;
+                u32 r1 = r0 + half * n;
+                u32 r2 = r1 + half * n;
+                u32 r3 = r2 + half * n;
+                for (u32 c = c0; c < c1; c += OCEAN_LANES)
+                {
+                    Lanes x0Re = Load(re + r0 + c), x0Im = Load(im + r0 + c);
+                    Lanes x2Re = Load(re + r2 + c), x2Im = Load(im + r2 + c);
+                    Lanes u1Re, u1Im, u3Re, u3Im;
+                    ComplexMul(Load(re + r1 + c), Load(im + r1 + c), w1Re, w1Im, u1Re, u1Im);
+                    ComplexMul(Load(re + r3 + c), Load(im + r3 + c), w1Re, w1Im, u3Re, u3Im);
+
+                    Lanes t0Re = Add(x0Re, u1Re), t0Im = Add(x0Im, u1Im);
+                    Lanes t1Re = Sub(x0Re, u1Re), t1Im = Sub(x0Im, u1Im);
+                    Lanes t2Re = Add(x2Re, u3Re), t2Im = Add(x2Im, u3Im);
+                    Lanes t3Re = Sub(x2Re, u3Re), t3Im = Sub(x2Im, u3Im);
+
+                    Lanes v2Re, v2Im, v3Re, v3Im;
+                    ComplexMul(t2Re, t2Im, w2Re, w2Im, v2Re, v2Im);
+                    ComplexMul(t3Re, t3Im, w2Re, w2Im, v3Re, v3Im);
+
+                    // i * v3 = -v3Im + i v3Re
+                    Store(re + r0 + c, Add(t0Re, v2Re));
+                    Store(im + r0 + c, Add(t0Im, v2Im));
+                    Store(re + r2 + c, Sub(t0Re, v2Re));
+                    Store(im + r2 + c, Sub(t0Im, v2Im));
+                    Store(re + r1 + c, Sub(t1Re, v3Im));
+                    Store(im + r1 + c, Add(t1Im, v3Re));
+                    Store(re + r3 + c, Add(t1Re, v3Im));
+                    Store(im + r3 + c, Sub(t1Im, v3Re));
+                }
+            }
+        }
+    }
+
+    // Inverse DFT down the columns c0 to c1, in place and without the 1/N
+    static void TransformColumns(const OceanSimulation& ocean, OceanField& field, u32 c0, u32 c1)
+    {
+        const u32 n = ocean.resolution;
+        f32* re = field.re.data();
+        f32* im = field.im.data();
+
+        for (u32 r = 0; r < n; ++r)
+        {
+            u32 reversed = ocean.bitReverse[r];
+            if (reversed <= r)
+                continue;
+            for (u32 c = c0; c < c1; ++c)
+            {
+                std::swap(re[r * n + c], re[reversed * n + c]);
+                std::swap(im[r * n + c], im[reversed * n + c]);
+            }
+        }
+
+        u32 half = 1;
+        if (ocean.log2Resolution & 1)
+        {
+            Radix2Stage(ocean, re, im, half, c0, c1);
+            half = 2;
+        }
+        for (; half < n; half *= 4)
+            Radix4Stage(ocean, re, im, half, c0, c1);
+    }
+
+    static void TransformFields(OceanSimulation& ocean, OceanField* fields, bool parallel)
+    {
+        Run(ocean.resolution / OCEAN_FFT_BLOCK, 1, parallel, [&](u32 begin, u32 end)
+        {
+            for (u32 f = 0; f < 3; ++f)
+                TransformColumns(ocean, fields[f], begin * OCEAN_FFT_BLOCK, end * OCEAN_FFT_BLOCK);
+        });
+    }
+
+    // Column transforms, a transpose and column transforms again, so both passes walk whole rows.
+    // The result ends up transposed, transposed[f][x * N + z]
+    static void InverseTransform(OceanSimulation& ocean, bool parallel)
+    {
+        const u32 n = ocean.resolution;
+        TransformFields(ocean, ocean.fields, parallel);
+
+        Run(n / OCEAN_TRANSPOSE_TILE, 1, parallel, [&](u32 begin, u32 end)
+        {
+            for (u32 f = 0; f < 3; ++f)
+            {
+                const OceanField& source = ocean.fields[f];
+                OceanField& destination = ocean.transposed[f];
+                for (u32 tileRow = begin * OCEAN_TRANSPOSE_TILE; tileRow < end * OCEAN_TRANSPOSE_TILE; tileRow += OCEAN_TRANSPOSE_TILE)
+                    for (u32 tileColumn = 0; tileColumn < n; tileColumn += OCEAN_TRANSPOSE_TILE)
+                        for (u32 r = tileRow; r < tileRow + OCEAN_TRANSPOSE_TILE; ++r)
+                            for (u32 c = tileColumn; c < tileColumn + OCEAN_TRANSPOSE_TILE; ++c)
+                            {
+                                destination.re[c * n + r] = source.re[r * n + c];
+                                destination.im[c * n + r] = source.im[r * n + c];
+                            }
+            }
+        });
+
+        TransformFields(ocean, ocean.transposed, parallel);
+    }
+
+    void Create(OceanSimulation& ocean, u32 resolution)
+    {
+        InitSpectrum(ocean, resolution);
+        const u32 n = ocean.resolution;
+
+        u32 mipCount = ocean.log2Resolution + 1;
+        glGenTextures(1, &ocean.displacementTexture);
+        GLState::BindTexture(GL_TEXTURE_2D, ocean.displacementTexture);
+        glTexStorage2D(GL_TEXTURE_2D, mipCount, GL_RGBA32F, n, n);
+        glGenTextures(1, &ocean.slopeTexture);
+        GLState::BindTexture(GL_TEXTURE_2D, ocean.slopeTexture);
+        glTexStorage2D(GL_TEXTURE_2D, mipCount, GL_RG32F, n, n);
+
+        GLuint textures[] = { ocean.displacementTexture, ocean.slopeTexture };
+        for (u32 t = 0; t < ARRAY_COUNT(textures); ++t)
+        {
+            GLState::BindTexture(GL_TEXTURE_2D, textures[t]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        }
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+
+        // both textures of a frame, plus the alignment of the second
+        u32 regionSize = n * n * (4 + 2) * sizeof(f32) + 256;
+        ocean.uploadBuffer = BufferManager::CreateRingBuffer(regionSize, OCEAN_UPLOAD_FRAMES, GL_PIXEL_UNPACK_BUFFER);
+
+        ocean.solveMs = 0.0;
+        ocean.uploadMs = 0.0;
+    }
+
+    void Destroy(OceanSimulation& ocean)
+    {
+        glDeleteTextures(1, &ocean.displacementTexture);
+        glDeleteTextures(1, &ocean.slopeTexture);
+
+        RingBuffer& ring = ocean.uploadBuffer;
+        for (u32 r = 0; r < ring.regionCount; ++r)
+        {
+            if (ring.fences[r])
+                glDeleteSync(ring.fences[r]);
+        }
+        glDeleteBuffers(1, &ring.buffer.handle);
+        ring = {};
+
+        GLState::Invalidate();
+    }
+
+    void Update(OceanSimulation& ocean, f32 time)
+    {
+        const u32 n = ocean.resolution;
+
+        f64 start = glfwGetTime();
+        EvaluateSpectrum(ocean, time, true);
+        InverseTransform(ocean, true);
+        f64 solved = glfwGetTime();
+
+        RingBuffer& ring = ocean.uploadBuffer;
+        BufferManager::BeginRingRegion(ring);
+        BufferManager::MapRing(ring);
+        RingAllocation displacement = BufferManager::AllocateRing(ring, n * n * 4 * sizeof(f32), 256);
+        RingAllocation slopes = BufferManager::AllocateRing(ring, n * n * 2 * sizeof(f32), 256);
+        if (!displacement.data || !slopes.data)
+        {
+            BufferManager::UnmapRing(ring);
+            BufferManager::EndRingRegion(ring);
+            return;
+        }
+
+        // back from the transposed layout, with the (-1)^(x + z) of the centered spectrum. The choppy displacement
+        // pulls the points towards the crests
+        Run(n, 8, true, [&](u32 begin, u32 end)
+        {
+            for (u32 z = begin; z < end; ++z)
+            {
+                f32* displacementRow = (f32*)displacement.data + z * n * 4;
+                f32* slopeRow = (f32*)slopes.data + z * n * 2;
+                for (u32 x = 0; x < n; ++x)
+                {
+                    u32 i = x * n + z;
+                    f32 sign = ((x + z) & 1) ? -1.0f : 1.0f;
+                    displacementRow[x * 4 + 0] = -ocean.choppiness * sign * ocean.transposed[0].im[i];
+                    displacementRow[x * 4 + 1] = sign * ocean.transposed[0].re[i];
+                    displacementRow[x * 4 + 2] = -ocean.choppiness * sign * ocean.transposed[1].re[i];
+                    displacementRow[x * 4 + 3] = 0.0f;
+                    slopeRow[x * 2 + 0] = sign * ocean.transposed[1].im[i];
+                    slopeRow[x * 2 + 1] = sign * ocean.transposed[2].re[i];
+                }
+            }
+        });
+        BufferManager::UnmapRing(ring);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.buffer.handle);
+        GLState::BindTexture(GL_TEXTURE_2D, ocean.displacementTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, n, GL_RGBA, GL_FLOAT, (void*)(u64)displacement.offset);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GLState::BindTexture(GL_TEXTURE_2D, ocean.slopeTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, n, GL_RG, GL_FLOAT, (void*)(u64)slopes.offset);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        BufferManager::EndRingRegion(ring);
+
+        ocean.solveMs = (solved - start) * 1000.0;
+        ocean.uploadMs = (glfwGetTime() - solved) * 1000.0;
+    }
+
+    struct GridVertex
+    {
+        vec3 position;
+        vec3 normal;
+        vec3 grid; // xz to the neighbours a seam vertex averages, y the spacing its level samples at
+    };
+
+    void CreateGrid(OceanGrid& grid, f32 baseSpacing)
+    {
+        const u32 quads = OCEAN_LOD_QUADS;
+        const u32 side = quads + 1;
+        grid.baseSpacing = baseSpacing;
+
+        std::vector<GridVertex> vertices;
+        std::vector<u32> indices;
+        vertices.reserve(OCEAN_LOD_LEVELS * side * side);
+
+        for (u32 level = 0; level < OCEAN_LOD_LEVELS; ++level)
+        {
+            f32 spacing = baseSpacing * (f32)(1 << level);
+            bool hasOuterRing = level + 1 < OCEAN_LOD_LEVELS;
+            u32 first = (u32)vertices.size();
+
+            for (u32 j = 0; j < side; ++j)
+            {
+                for (u32 i = 0; i < side; ++i)
+                {
+                    GridVertex vertex;
+                    vertex.position = vec3(((f32)i - quads / 2) * spacing, 0.0f, ((f32)j - quads / 2) * spacing);
+                    vertex.normal = vec3(0.0f, 1.0f, 0.0f);
+                    vertex.grid = vec3(0.0f, spacing, 0.0f);
+
+                    // odd vertices of the outer edge have no match in the next ring, they follow its edge
+                    if (hasOuterRing)
+                    {
+                        bool onColumnEdge = i == 0 || i == quads;
+                        bool onRowEdge = j == 0 || j == quads;
+                        if (onColumnEdge && (j & 1))
+                            vertex.grid = vec3(0.0f, 2.0f * spacing, spacing);
+                        else if (onRowEdge && (i & 1))
+                            vertex.grid = vec3(spacing, 2.0f * spacing, 0.0f);
+                    }
+                    vertices.push_back(vertex);
+                }
+            }
+
+            for (u32 j = 0; j < quads; ++j)
+            {
+                for (u32 i = 0; i < quads; ++i)
+                {
+                    // the inner half is the finer ring
+                    bool inner = i >= quads / 4 && i < 3 * quads / 4 && j >= quads / 4 && j < 3 * quads / 4;
+                    if (level > 0 && inner)
+                        continue;
+
+                    u32 v00 = first + j * side + i;
+                    u32 v10 = v00 + 1;
+                    u32 v01 = v00 + side;
+                    u32 v11 = v01 + 1;
+                    u32 quad[] = { v00, v01, v11, v00, v11, v10 };
+                    indices.insert(indices.end(), quad, quad + 6);
+                }
+            }
+        }
+        grid.indexCount = (u32)indices.size();
+
+        glGenVertexArrays(1, &grid.vao);
+        GLState::BindVertexArray(grid.vao);
+
+        glGenBuffers(1, &grid.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, grid.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GridVertex), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GridVertex), (void*)offsetof(GridVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GridVertex), (void*)offsetof(GridVertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GridVertex), (void*)offsetof(GridVertex, grid));
+        glEnableVertexAttribArray(2);
+
+        glGenBuffers(1, &grid.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, grid.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u32), indices.data(), GL_STATIC_DRAW);
+
+        GLState::BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void DestroyGrid(OceanGrid& grid)
+    {
+        glDeleteVertexArrays(1, &grid.vao);
+        glDeleteBuffers(1, &grid.vertexBuffer);
+        glDeleteBuffers(1, &grid.indexBuffer);
+        grid = {};
+
+        GLState::Invalidate();
+    }
+
+    glm::mat4 GridMatrix(const OceanGrid& grid, const vec3& cameraPosition, f32 waterHeight)
+    {
+        f32 snap = grid.baseSpacing * (f32)(1 << (OCEAN_LOD_LEVELS - 1));
+        vec3 center = vec3(floorf(cameraPosition.x / snap) * snap, waterHeight, floorf(cameraPosition.z / snap) * snap);
+        return glm::translate(center);
+    }
+
+    f32 GridExtent(const OceanGrid& grid)
+    {
+        return grid.baseSpacing * (f32)(1 << (OCEAN_LOD_LEVELS - 1)) * (OCEAN_LOD_QUADS / 2);
+    }
+
+    std::string RunBenchmark()
+    {
+        const u32 resolutions[] = { 128, 256, 512 };
+        const u32 repetitions = 5;
+
+        std::string report;
+        char line[256];
+        sprintf(line, "%u workers, %s butterflies\n", JobSystem::WorkerCount(), OCEAN_LANES > 1 ? "SSE" : "scalar");
+        report += line;
+
+        for (u32 r = 0; r < ARRAY_COUNT(resolutions); ++r)
+        {
+            OceanSimulation ocean = {};
+            InitSpectrum(ocean, resolutions[r]);
+
+            // best of a few runs, spectrum and FFTs on one thread, then on the workers
+            f64 bestTimes[4] = { 1e30, 1e30, 1e30, 1e30 };
+            for (u32 i = 0; i < repetitions; ++i)
+            {
+                for (u32 variant = 0; variant < 2; ++variant)
+                {
+                    bool parallel = variant == 1;
+                    f64 start = glfwGetTime();
+                    EvaluateSpectrum(ocean, 1.0f + i, parallel);
+                    f64 evaluated = glfwGetTime();
+                    InverseTransform(ocean, parallel);
+                    f64 transformed = glfwGetTime();
+
+                    bestTimes[variant * 2 + 0] = glm::min(bestTimes[variant * 2 + 0], (evaluated - start) * 1000.0);
+                    bestTimes[variant * 2 + 1] = glm::min(bestTimes[variant * 2 + 1], (transformed - evaluated) * 1000.0);
+                }
+            }
+
+            sprintf(line, "%ux%u: spectrum %.2f ms, FFT %.2f ms on one thread, %.2f / %.2f ms on the workers\n",
+                resolutions[r], resolutions[r], bestTimes[0], bestTimes[1], bestTimes[2], bestTimes[3]);
+            report += line;
+        }
+
+        return report;
+    }
+}
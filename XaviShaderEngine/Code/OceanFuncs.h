@@ -0,0 +1,93 @@
+
+#ifndef OCEAN_FUNC
+#define OCEAN_FUNC
+
+#include "Globals.h"
+#include "BufferSupFuncs.h"
+
+// Power of two sides of the height field, the solver handles anything in between
+#define OCEAN_MIN_RESOLUTION 128
+#define OCEAN_MAX_RESOLUTION 512
+
+// Regions of the upload ring, one per frame in flight
+#define OCEAN_UPLOAD_FRAMES 3
+
+// Rings of the camera centered grid, each twice the spacing of the one inside it
+#define OCEAN_LOD_LEVELS 5
+#define OCEAN_LOD_QUADS 64
+
+// Complex field split in real and imaginary planes, row major, resolution * resolution
+struct OceanField
+{
+    std::vector<f32> re;
+    std::vector<f32> im;
+};
+
+// Tessendorf ocean: a Phillips spectrum animated on the CPU and brought back to a height field by inverse FFTs.
+// Heights and choppy displacements tile every patchSize meters
+struct OceanSimulation
+{
+    u32 resolution;
+    u32 log2Resolution;
+    f32 patchSize = 32.0f;
+    vec2 windDirection = vec2(1.0f, 0.0f);
+    f32 windSpeed = 6.0f;
+    f32 amplitude = 1e-5f; // Phillips constant, a tenth of a meter rms with the wind above
+    f32 choppiness = 1.0f;
+
+    // by wave vector, h0MinusConj is conj(h0(-k)) so the animated spectrum stays Hermitian
+    OceanField h0;
+    OceanField h0MinusConj;
+    std::vector<f32> omega;
+
+    // e^(2 pi i j / resolution) for j below resolution / 2, and the bit reversal of every index
+    std::vector<f32> twiddleRe;
+    std::vector<f32> twiddleIm;
+    std::vector<u32> bitReverse;
+
+    // h + i Dx, Dz + i dh/dx and dh/dz, two real fields per transform where possible
+    OceanField fields[3];
+    OceanField transposed[3];
+
+    // RGBA32F dx, h, dz and RG32F slopes, mipmapped for the far rings of the grid
+    GLuint displacementTexture;
+    GLuint slopeTexture;
+    RingBuffer uploadBuffer;
+
+    f64 solveMs;
+    f64 uploadMs;
+};
+
+struct OceanGrid
+{
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    u32 indexCount;
+    f32 baseSpacing; // of the innermost ring
+};
+
+namespace Ocean
+{
+    void Create(OceanSimulation& ocean, u32 resolution);
+
+    void Destroy(OceanSimulation& ocean);
+
+    // Evaluates the spectrum at time and uploads the fields to the textures through the ring
+    void Update(OceanSimulation& ocean, f32 time);
+
+    void CreateGrid(OceanGrid& grid, f32 baseSpacing);
+
+    void DestroyGrid(OceanGrid& grid);
+
+    // Follows the camera in steps of the coarsest spacing so the vertices do not swim over the waves
+    glm::mat4 GridMatrix(const OceanGrid& grid, const vec3& cameraPosition, f32 waterHeight);
+
+    // Half the side of the whole grid
+    f32 GridExtent(const OceanGrid& grid);
+
+    // Times the spectrum and the inverse FFTs at 128, 256 and 512, on the calling thread and on the workers
+    std::string RunBenchmark();
+}
+
+#endif // !OCEAN_FUNC
@@ -0,0 +1,336 @@
+
+#include "PointShadowFuncs.h"
+#include "OcclusionCullingFuncs.h"
+#include "GLStateFuncs.h"
+#include "platform.h"
+
+#include <algorithm>
+
+// a light keeps its band until its importance is this far past the band limits
+#define POINT_SHADOW_HYSTERESIS 1.25f
+
+namespace PointShadows
+{
+    // tile size and atlas rows of each band, they add up to the atlas size
+    static const u32 bandTileSizes[POINT_SHADOW_TILE_CLASSES] = { 512, 256, 128, 64 };
+    static const u32 bandHeights[POINT_SHADOW_TILE_CLASSES] = { 1536, 1024, 1024, 512 };
+    // lowest importance of each band, the radius over the distance to the camera
+    static const f32 bandImportance[POINT_SHADOW_TILE_CLASSES] = { 0.5f, 0.25f, 0.1f, 0.0f };
+
+    // same faces in PointShadowFactor of the lighting shaders
+    static const vec3 faceForward[6] = { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+    static const vec3 faceUp[6] = { vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0) };
+
+    static void ResetSlots(PointShadowAtlas& atlas)
+    {
+        for (u32 b = 0; b < POINT_SHADOW_TILE_CLASSES; ++b)
+        {
+            PointShadowBand& band = atlas.bands[b];
+            band.freeSlots.clear();
+            for (u32 s = band.slotCount; s > 0; --s)
+                band.freeSlots.push_back(s - 1);
+        }
+    }
+
+    void Create(PointShadowAtlas& atlas)
+    {
+        glGenTextures(1, &atlas.depthTexture);
+        GLState::BindTexture(GL_TEXTURE_2D, atlas.depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &atlas.frameBuffer);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, atlas.frameBuffer);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, atlas.depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+            ELOG("Point shadow atlas framebuffer incomplete (0x%x)", framebufferStatus);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        u32 top = 0;
+        for (u32 b = 0; b < POINT_SHADOW_TILE_CLASSES; ++b)
+        {
+            PointShadowBand& band = atlas.bands[b];
+            band.tileSize = bandTileSizes[b];
+            band.top = top;
+            band.tilesPerRow = POINT_SHADOW_ATLAS_SIZE / band.tileSize;
+            band.slotCount = band.tilesPerRow * (bandHeights[b] / band.tileSize) / 6;
+            top += bandHeights[b];
+        }
+        ResetSlots(atlas);
+
+        // one entry so the binding is valid before the first Update
+        glGenBuffers(1, &atlas.shadowBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, atlas.shadowBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GpuPointShadow), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        atlas.shadowCapacity = 1;
+
+        atlas.updateBudget = 4;
+    }
+
+    static bool SphereInLight(const PointShadowLight& light, const vec4& sphere)
+    {
+        return light.rendered && glm::length(vec3(sphere) - light.renderedPosition) < sphere.w + light.renderedRadius;
+    }
+
+    void MarkChanged(PointShadowAtlas& atlas, const vec4& boundingSphere)
+    {
+        for (u32 i = 0; i < atlas.lights.size(); ++i)
+            if (!atlas.lights[i].dirty && SphereInLight(atlas.lights[i], boundingSphere))
+                atlas.lights[i].dirty = true;
+    }
+
+    void Invalidate(PointShadowAtlas& atlas)
+    {
+        for (u32 i = 0; i < atlas.lights.size(); ++i)
+            atlas.lights[i].dirty = true;
+    }
+
+    static u8 WantedBand(const PointShadowLight& light)
+    {
+        u8 band = 0;
+        while (band + 1 < POINT_SHADOW_TILE_CLASSES && light.importance < bandImportance[band])
+            ++band;
+        return band;
+    }
+
+    static bool KeepsBand(const PointShadowLight& light)
+    {
+        u8 b = light.tileClass;
+        bool aboveFloor = light.importance >= bandImportance[b] / POINT_SHADOW_HYSTERESIS;
+        bool belowCeiling = b == 0 || light.importance < bandImportance[b - 1] * POINT_SHADOW_HYSTERESIS;
+        return aboveFloor && belowCeiling;
+    }
+
+    static void ReleaseTiles(PointShadowAtlas& atlas, PointShadowLight& light)
+    {
+        atlas.bands[light.tileClass].freeSlots.push_back(light.slot);
+        light.tileClass = POINT_SHADOW_NO_TILES;
+        light.rendered = false;
+    }
+
+    static ivec2 TileCorner(const PointShadowBand& band, u32 slot, u32 face)
+    {
+        u32 tile = slot * 6 + face;
+        return ivec2((tile % band.tilesPerRow) * band.tileSize, band.top + (tile / band.tilesPerRow) * band.tileSize);
+    }
+
+    static void AssignTiles(PointShadowAtlas& atlas, const std::vector<u32>& order)
+    {
+        // lights that left the view or need another band give their tiles back first
+        for (u32 i = 0; i < atlas.lights.size(); ++i)
+        {
+            PointShadowLight& light = atlas.lights[i];
+            if (light.tileClass == POINT_SHADOW_NO_TILES)
+                continue;
+            if (light.importance <= 0.0f)
+                ReleaseTiles(atlas, light);
+            else if (!KeepsBand(light))
+            {
+                // a light already squeezed into a smaller band waits there until the one it wants has room
+                u8 wanted = WantedBand(light);
+                if (wanted > light.tileClass || !atlas.bands[wanted].freeSlots.empty())
+                    ReleaseTiles(atlas, light);
+            }
+        }
+
+        // then the most important ones pick first, falling back to smaller tiles when the band is full
+        for (u32 k = 0; k < order.size(); ++k)
+        {
+            PointShadowLight& light = atlas.lights[order[k]];
+            if (light.tileClass != POINT_SHADOW_NO_TILES || light.importance <= 0.0f)
+                continue;
+
+            for (u8 b = WantedBand(light); b < POINT_SHADOW_TILE_CLASSES; ++b)
+            {
+                if (atlas.bands[b].freeSlots.empty())
+                    continue;
+                light.tileClass = b;
+                light.slot = atlas.bands[b].freeSlots.back();
+                atlas.bands[b].freeSlots.pop_back();
+                light.rendered = false;
+                break;
+            }
+        }
+    }
+
+    static void RenderLight(PointShadowAtlas& atlas, const Light& light, const PointShadowLight& state, const DrawList& list, u32 packetCount, const DrawView& view, const std::vector<vec4>& rowBoundingSpheres)
+    {
+        // only the packets inside the light sphere, every face replays them
+        DrawList& lightList = atlas.lightList;
+        lightList.program = list.program;
+        lightList.textureLocation = list.textureLocation;
+        lightList.viewMatrixLocation = list.viewMatrixLocation;
+        lightList.packets.clear();
+        for (u32 i = 0; i < packetCount; ++i)
+        {
+            const vec4& sphere = rowBoundingSpheres[list.packets[i].row];
+            if (glm::length(vec3(sphere) - light.position) < sphere.w + light.radius)
+                lightList.packets.push_back(list.packets[i]);
+        }
+        lightList.mainViewCount = lightList.packets.size();
+        lightList.waterViewBegin = lightList.packets.size();
+
+        const PointShadowBand& band = atlas.bands[state.tileClass];
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, light.radius);
+        GLint lightViewProjectionLocation = glGetUniformLocation(list.program, "uLightViewProjection");
+        for (u32 face = 0; face < 6; ++face)
+        {
+            ivec2 corner = TileCorner(band, state.slot, face);
+            GLState::Viewport(corner.x, corner.y, band.tileSize, band.tileSize);
+            glScissor(corner.x, corner.y, band.tileSize, band.tileSize);
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            glm::mat4 viewProjection = projection * glm::lookAt(light.position, light.position + faceForward[face], faceUp[face]);
+            glUniformMatrix4fv(lightViewProjectionLocation, 1, GL_FALSE, &viewProjection[0][0]);
+            DrawCommands::Replay(lightList, lightList.packets.size(), view);
+        }
+    }
+
+    static void UploadShadows(PointShadowAtlas& atlas, const std::vector<Light>& lights)
+    {
+        atlas.gpuShadows.resize(lights.size());
+        for (u32 i = 0; i < lights.size(); ++i)
+        {
+            const PointShadowLight& state = atlas.lights[i];
+            GpuPointShadow& shadow = atlas.gpuShadows[i];
+            if (state.tileClass == POINT_SHADOW_NO_TILES || !state.rendered)
+            {
+                shadow.params = vec4(0.0f);
+                continue;
+            }
+
+            const PointShadowBand& band = atlas.bands[state.tileClass];
+            f32 size = (f32)band.tileSize / POINT_SHADOW_ATLAS_SIZE;
+            for (u32 face = 0; face < 6; ++face)
+                shadow.faceRects[face] = vec4(vec2(TileCorner(band, state.slot, face)) / (f32)POINT_SHADOW_ATLAS_SIZE, size, size);
+            shadow.params = vec4(POINT_SHADOW_NEAR, state.renderedRadius, 1.0f, 0.0f);
+        }
+
+        u32 count = glm::max((u32)atlas.gpuShadows.size(), 1u);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, atlas.shadowBuffer);
+        if (count > atlas.shadowCapacity)
+        {
+            atlas.shadowCapacity = glm::max(count, atlas.shadowCapacity * 2);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, atlas.shadowCapacity * sizeof(GpuPointShadow), NULL, GL_DYNAMIC_DRAW);
+        }
+        if (!atlas.gpuShadows.empty())
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, atlas.gpuShadows.size() * sizeof(GpuPointShadow), atlas.gpuShadows.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void Update(PointShadowAtlas& atlas, const std::vector<Light>& lights, const glm::mat4& cameraViewProjection, const vec3& cameraPosition,
+        const DrawList& list, u32 packetCount, const DrawView& view, const std::vector<vec4>& rowBoundingSpheres)
+    {
+        atlas.frame++;
+        atlas.updatedCount = 0;
+
+        // the states follow the light indices, a new light list starts over
+        if (atlas.lights.size() != lights.size())
+        {
+            ResetSlots(atlas);
+            atlas.lights.assign(lights.size(), PointShadowLight());
+            for (u32 i = 0; i < atlas.lights.size(); ++i)
+                atlas.lights[i].tileClass = POINT_SHADOW_NO_TILES;
+        }
+
+        vec4 frustumPlanes[6];
+        OcclusionCulling::ExtractFrustumPlanes(cameraViewProjection, frustumPlanes);
+
+        std::vector<u32> order;
+        for (u32 i = 0; i < lights.size(); ++i)
+        {
+            const Light& light = lights[i];
+            PointShadowLight& state = atlas.lights[i];
+            state.importance = 0.0f;
+            if (light.type != LightType_Point || light.radius <= 0.0f)
+                continue;
+
+            // a light whose sphere is out of the view lights nothing on screen
+            bool inView = true;
+            for (u32 p = 0; p < 6 && inView; ++p)
+                inView = glm::dot(vec3(frustumPlanes[p]), light.position) + frustumPlanes[p].w > -light.radius;
+            if (!inView)
+                continue;
+
+            state.importance = light.radius / glm::max(glm::length(light.position - cameraPosition), light.radius);
+            if (state.rendered && (state.renderedPosition != light.position || state.renderedRadius != light.radius))
+                state.dirty = true;
+            order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return atlas.lights[a].importance > atlas.lights[b].importance; });
+
+        AssignTiles(atlas, order);
+
+        // new tiles and changed lights, the important ones first but a long wait counts too
+        std::vector<u32> pending;
+        atlas.shadowedCount = 0;
+        for (u32 k = 0; k < order.size(); ++k)
+        {
+            const PointShadowLight& state = atlas.lights[order[k]];
+            if (state.tileClass == POINT_SHADOW_NO_TILES)
+                continue;
+            atlas.shadowedCount++;
+            if (!state.rendered || state.dirty)
+                pending.push_back(order[k]);
+        }
+        std::stable_sort(pending.begin(), pending.end(), [&](u32 a, u32 b)
+        {
+            const PointShadowLight& lightA = atlas.lights[a];
+            const PointShadowLight& lightB = atlas.lights[b];
+            if (lightA.rendered != lightB.rendered)
+                return !lightA.rendered;
+            return lightA.importance * (1 + atlas.frame - lightA.lastUpdateFrame) > lightB.importance * (1 + atlas.frame - lightB.lastUpdateFrame);
+        });
+
+        if (!pending.empty())
+        {
+            GLState::UseProgram(list.program);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, atlas.frameBuffer);
+            glEnable(GL_SCISSOR_TEST);
+            glEnable(GL_POLYGON_OFFSET_FILL);
+            glPolygonOffset(2.0f, 4.0f);
+
+            u32 budget = glm::max(atlas.updateBudget, 1u);
+            for (u32 k = 0; k < pending.size() && k < budget; ++k)
+            {
+                u32 i = pending[k];
+                PointShadowLight& state = atlas.lights[i];
+                RenderLight(atlas, lights[i], state, list, packetCount, view, rowBoundingSpheres);
+                state.renderedPosition = lights[i].position;
+                state.renderedRadius = lights[i].radius;
+                state.rendered = true;
+                state.dirty = false;
+                state.lastUpdateFrame = atlas.frame;
+                atlas.updatedCount++;
+            }
+
+            glDisable(GL_POLYGON_OFFSET_FILL);
+            glDisable(GL_SCISSOR_TEST);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+            GLState::UseProgram(0);
+        }
+
+        UploadShadows(atlas, lights);
+    }
+
+    void BindForShading(const PointShadowAtlas& atlas, GLuint program, u32 textureUnit, bool enabled)
+    {
+        GLState::ActiveTexture(GL_TEXTURE0 + textureUnit);
+        GLState::BindTexture(GL_TEXTURE_2D, atlas.depthTexture);
+        glUniform1i(glGetUniformLocation(program, "uPointShadowAtlas"), textureUnit);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, atlas.shadowBuffer);
+        glUniform1i(glGetUniformLocation(program, "uPointShadowsEnabled"), enabled && !atlas.gpuShadows.empty());
+    }
+}
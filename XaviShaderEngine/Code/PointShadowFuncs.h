@@ -0,0 +1,81 @@
+
+#ifndef POINT_SHADOW_FUNC
+#define POINT_SHADOW_FUNC
+
+#include "Globals.h"
+#include "DrawListFuncs.h"
+
+// One depth atlas for every point light, split in bands of square tiles. A light takes six tiles of one band,
+// the bigger the closer it is, so the memory stays the same whatever the light count
+#define POINT_SHADOW_ATLAS_SIZE 4096
+#define POINT_SHADOW_TILE_CLASSES 4
+#define POINT_SHADOW_NEAR 0.05f
+#define POINT_SHADOW_NO_TILES 0xFF
+
+// std430 mirror of PointShadow in FB_TO_BB.glsl, FB_TO_BB_SSAO.glsl and LIGHT_VOLUME.glsl, by index in app->lights
+struct GpuPointShadow
+{
+    vec4 faceRects[6]; // atlas uv offset and size of each cube face
+    vec4 params; // near, far, 1 when the tiles hold a shadow
+};
+
+struct PointShadowBand
+{
+    u32 tileSize;
+    u32 top; // first atlas row of the band
+    u32 tilesPerRow;
+    u32 slotCount; // six tiles each
+    std::vector<u32> freeSlots;
+};
+
+struct PointShadowLight
+{
+    u8 tileClass; // band of its slot, POINT_SHADOW_NO_TILES without one
+    u32 slot;
+    f32 importance; // screen size of its sphere, 0 out of view
+
+    // what the tiles were last rendered with, the lighting samples them until the next render
+    vec3 renderedPosition;
+    f32 renderedRadius;
+    bool rendered;
+    bool dirty; // something moved inside the sphere
+    u32 lastUpdateFrame;
+};
+
+struct PointShadowAtlas
+{
+    GLuint depthTexture;
+    GLuint frameBuffer;
+    PointShadowBand bands[POINT_SHADOW_TILE_CLASSES];
+
+    std::vector<PointShadowLight> lights; // by index in app->lights, reset when the count changes
+    std::vector<GpuPointShadow> gpuShadows;
+    GLuint shadowBuffer;
+    u32 shadowCapacity;
+
+    u32 updateBudget; // lights rendered per frame
+    u32 frame;
+    u32 updatedCount; // lights rendered in the last Update
+    u32 shadowedCount; // lights holding tiles
+    DrawList lightList; // the packets of the light being rendered
+};
+
+namespace PointShadows
+{
+    void Create(PointShadowAtlas& atlas);
+
+    // Cached lights whose sphere has the bounding sphere are rendered again
+    void MarkChanged(PointShadowAtlas& atlas, const vec4& boundingSphere);
+
+    void Invalidate(PointShadowAtlas& atlas);
+
+    // Gives tiles to the point lights in view by importance and renders the most important ones that need it
+    // within the budget. Same list requirements as ShadowCascades::Update
+    void Update(PointShadowAtlas& atlas, const std::vector<Light>& lights, const glm::mat4& cameraViewProjection, const vec3& cameraPosition,
+        const DrawList& list, u32 packetCount, const DrawView& view, const std::vector<vec4>& rowBoundingSpheres);
+
+    // Atlas on the given unit plus the tile buffer, with the program in use
+    void BindForShading(const PointShadowAtlas& atlas, GLuint program, u32 textureUnit, bool enabled);
+}
+
+#endif // !POINT_SHADOW_FUNC
@@ -0,0 +1,152 @@
+
+#include "RenderTargetFuncs.h"
+#include "GLStateFuncs.h"
+#include "platform.h"
+
+namespace RenderTargets
+{
+    void Create(RenderTargetPool& pool, u32 maxUnusedFrames)
+    {
+        pool.targets.clear();
+        pool.frame = 0;
+        pool.maxUnusedFrames = maxUnusedFrames;
+        pool.bytesHeld = 0;
+        pool.bytesInUse = 0;
+        pool.createdCount = 0;
+        pool.freedCount = 0;
+    }
+
+    u32 FormatBytes(GLenum format)
+    {
+        switch (format)
+        {
+        case GL_R8: return 1;
+        case GL_R16F: case GL_RG8: return 2;
+        case GL_RGBA8: case GL_RG16: case GL_RG16F: case GL_R32F: case GL_R11F_G11F_B10F:
+        case GL_DEPTH24_STENCIL8: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: return 4;
+        case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+        case GL_RGBA32F: return 16;
+        default: return 4;
+        }
+    }
+
+    u64 Bytes(const RenderTargetDesc& desc)
+    {
+        return (u64)FormatBytes(desc.format) * desc.size.x * desc.size.y * glm::max(desc.samples, 1u) * glm::max(desc.layers, 1u);
+    }
+
+    static bool SameDesc(const RenderTargetDesc& a, const RenderTargetDesc& b)
+    {
+        return a.size == b.size && a.format == b.format && a.samples == b.samples && a.layers == b.layers;
+    }
+
+    static GLuint CreateTexture(const RenderTargetDesc& desc)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+
+        if (desc.samples > 1)
+        {
+            // no sampler state, only texelFetch and resolves read them
+            GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+            glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.format, desc.size.x, desc.size.y, GL_TRUE);
+            GLState::BindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+            return texture;
+        }
+
+        GLenum target = desc.layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+        GLState::BindTexture(target, texture);
+        // immutable storage, texture views need it
+        if (desc.layers > 1)
+            glTexStorage3D(target, 1, desc.format, desc.size.x, desc.size.y, desc.layers);
+        else
+            glTexStorage2D(target, 1, desc.format, desc.size.x, desc.size.y);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        GLState::BindTexture(target, 0);
+
+        return texture;
+    }
+
+    GLuint Acquire(RenderTargetPool& pool, const RenderTargetDesc& desc)
+    {
+        for (u32 i = 0; i < pool.targets.size(); ++i)
+        {
+            RenderTarget& target = pool.targets[i];
+            if (!target.inUse && SameDesc(target.desc, desc))
+            {
+                target.inUse = true;
+                target.lastUsedFrame = pool.frame;
+                pool.bytesInUse += target.bytes;
+                return target.texture;
+            }
+        }
+
+        RenderTarget target = {};
+        target.desc = desc;
+        target.desc.samples = glm::max(desc.samples, 1u);
+        target.desc.layers = glm::max(desc.layers, 1u);
+        target.texture = CreateTexture(target.desc);
+        target.bytes = Bytes(target.desc);
+        target.lastUsedFrame = pool.frame;
+        target.inUse = true;
+        pool.targets.push_back(target);
+
+        pool.bytesHeld += target.bytes;
+        pool.bytesInUse += target.bytes;
+        ++pool.createdCount;
+        return target.texture;
+    }
+
+    GLuint Acquire(RenderTargetPool& pool, ivec2 size, GLenum format)
+    {
+        RenderTargetDesc desc = { size, format, 1, 1 };
+        return Acquire(pool, desc);
+    }
+
+    void Release(RenderTargetPool& pool, GLuint texture)
+    {
+        for (u32 i = 0; i < pool.targets.size(); ++i)
+        {
+            RenderTarget& target = pool.targets[i];
+            if (target.texture == texture && target.inUse)
+            {
+                target.inUse = false;
+                target.lastUsedFrame = pool.frame;
+                pool.bytesInUse -= target.bytes;
+                return;
+            }
+        }
+        ELOG("Render target %u is not from the pool or was already released", texture);
+    }
+
+    void EndFrame(RenderTargetPool& pool)
+    {
+        u32 freedCount = pool.freedCount;
+        for (u32 i = 0; i < pool.targets.size();)
+        {
+            RenderTarget& target = pool.targets[i];
+            if (!target.inUse && pool.frame - target.lastUsedFrame >= pool.maxUnusedFrames)
+            {
+                glDeleteTextures(1, &target.texture);
+                pool.bytesHeld -= target.bytes;
+                ++pool.freedCount;
+
+                // order does not matter, Acquire looks at all of them
+                pool.targets[i] = pool.targets.back();
+                pool.targets.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        // a deleted name can come back from glGenTextures while the shadow state still has it bound
+        if (pool.freedCount != freedCount)
+            GLState::Invalidate();
+        ++pool.frame;
+    }
+}
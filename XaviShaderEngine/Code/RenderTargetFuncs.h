@@ -0,0 +1,60 @@
+
+#ifndef RENDER_TARGET_FUNC
+#define RENDER_TARGET_FUNC
+
+#include "Globals.h"
+
+// Frames a released target is kept for a pass that asks for the same one again
+#define RENDER_TARGET_MAX_UNUSED_FRAMES 120
+
+// What a pass asks for, a target is only handed out again for the same one
+struct RenderTargetDesc
+{
+    ivec2 size;
+    GLenum format;
+    u32 samples; // GL_TEXTURE_2D_MULTISAMPLE above 1
+    u32 layers; // GL_TEXTURE_2D_ARRAY above 1
+};
+
+struct RenderTarget
+{
+    GLuint texture;
+    RenderTargetDesc desc;
+    u64 bytes;
+    u32 lastUsedFrame;
+    bool inUse;
+};
+
+struct RenderTargetPool
+{
+    std::vector<RenderTarget> targets;
+    u32 frame;
+    u32 maxUnusedFrames;
+
+    u64 bytesHeld; // every texture of the pool, in use or waiting
+    u64 bytesInUse;
+    u32 createdCount;
+    u32 freedCount;
+};
+
+namespace RenderTargets
+{
+    void Create(RenderTargetPool& pool, u32 maxUnusedFrames = RENDER_TARGET_MAX_UNUSED_FRAMES);
+
+    // A free target of that description, or a new one. Immutable storage, nearest filtering and clamped
+    GLuint Acquire(RenderTargetPool& pool, const RenderTargetDesc& desc);
+
+    GLuint Acquire(RenderTargetPool& pool, ivec2 size, GLenum format);
+
+    // The texture stays alive for the next Acquire with the same description
+    void Release(RenderTargetPool& pool, GLuint texture);
+
+    // Deletes the targets nobody asked for in maxUnusedFrames frames
+    void EndFrame(RenderTargetPool& pool);
+
+    u32 FormatBytes(GLenum format);
+
+    u64 Bytes(const RenderTargetDesc& desc);
+}
+
+#endif // !RENDER_TARGET_FUNC
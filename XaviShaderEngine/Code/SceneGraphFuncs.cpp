@@ -0,0 +1,93 @@
+
+#include "SceneGraphFuncs.h"
+
+namespace SceneGraph
+{
+    u32 AddNode(TransformHierarchy& hierarchy, u32 parent, const vec3& position, const glm::quat& rotation, const vec3& scale)
+    {
+        ASSERT(parent == SCENE_NO_PARENT || parent < hierarchy.parent.size(), "Parent node does not exist");
+
+        hierarchy.localPosition.push_back(position);
+        hierarchy.localRotation.push_back(rotation);
+        hierarchy.localScale.push_back(scale);
+        hierarchy.parent.push_back(parent);
+        hierarchy.dirty.push_back(1);
+        hierarchy.worldMatrix.push_back(glm::mat4(1.0f));
+
+        return hierarchy.parent.size() - 1;
+    }
+
+    u32 AppendNodes(TransformHierarchy& hierarchy, u32 count, const vec3* positions, const glm::quat* rotations, const vec3* scales, const u32* parents)
+    {
+        u32 firstNode = hierarchy.parent.size();
+
+        hierarchy.localPosition.insert(hierarchy.localPosition.end(), positions, positions + count);
+        hierarchy.localRotation.insert(hierarchy.localRotation.end(), rotations, rotations + count);
+        hierarchy.localScale.insert(hierarchy.localScale.end(), scales, scales + count);
+        hierarchy.parent.insert(hierarchy.parent.end(), parents, parents + count);
+        hierarchy.dirty.resize(firstNode + count, 1);
+        hierarchy.worldMatrix.resize(firstNode + count, glm::mat4(1.0f));
+
+        for (u32 node = firstNode; node < firstNode + count; ++node)
+        {
+            u32& parent = hierarchy.parent[node];
+            if (parent == SCENE_NO_PARENT)
+                continue;
+
+            ASSERT(parent < node - firstNode, "Parents have to come before their children");
+            parent += firstNode;
+        }
+
+        return firstNode;
+    }
+
+    void SetLocalPosition(TransformHierarchy& hierarchy, u32 node, const vec3& position)
+    {
+        hierarchy.localPosition[node] = position;
+        hierarchy.dirty[node] = 1;
+    }
+
+    void SetLocalRotation(TransformHierarchy& hierarchy, u32 node, const glm::quat& rotation)
+    {
+        hierarchy.localRotation[node] = rotation;
+        hierarchy.dirty[node] = 1;
+    }
+
+    void SetLocalScale(TransformHierarchy& hierarchy, u32 node, const vec3& scale)
+    {
+        hierarchy.localScale[node] = scale;
+        hierarchy.dirty[node] = 1;
+    }
+
+    glm::mat4 LocalMatrix(const TransformHierarchy& hierarchy, u32 node)
+    {
+        glm::mat4 local = glm::translate(hierarchy.localPosition[node]) * glm::mat4_cast(hierarchy.localRotation[node]);
+        return glm::scale(local, hierarchy.localScale[node]);
+    }
+
+    u32 UpdateWorldMatrices(TransformHierarchy& hierarchy)
+    {
+        hierarchy.changedNodes.clear();
+
+        for (u32 node = 0; node < hierarchy.parent.size(); ++node)
+        {
+            u32 parent = hierarchy.parent[node];
+
+            // the parent was already visited, so its flag says if its world matrix moved
+            if (parent != SCENE_NO_PARENT)
+                hierarchy.dirty[node] |= hierarchy.dirty[parent];
+
+            if (!hierarchy.dirty[node])
+                continue;
+
+            glm::mat4 local = LocalMatrix(hierarchy, node);
+            hierarchy.worldMatrix[node] = parent != SCENE_NO_PARENT ? hierarchy.worldMatrix[parent] * local : local;
+            hierarchy.changedNodes.push_back(node);
+        }
+
+        for (u32 i = 0; i < hierarchy.changedNodes.size(); ++i)
+            hierarchy.dirty[hierarchy.changedNodes[i]] = 0;
+
+        return hierarchy.changedNodes.size();
+    }
+}
@@ -0,0 +1,45 @@
+
+#ifndef SCENE_GRAPH_FUNC
+#define SCENE_GRAPH_FUNC
+
+#include "Globals.h"
+#include <glm/gtc/quaternion.hpp>
+
+#define SCENE_NO_PARENT 0xFFFFFFFF
+
+// Transform component of every entity, stored in topological order: a parent is always
+// before its children, so a single forward sweep sees every parent updated first.
+struct TransformHierarchy
+{
+    std::vector<vec3> localPosition;
+    std::vector<glm::quat> localRotation;
+    std::vector<vec3> localScale;
+    std::vector<u32> parent;
+    std::vector<u8> dirty;
+
+    std::vector<glm::mat4> worldMatrix;
+    std::vector<u32> changedNodes; // world matrices rewritten by the last UpdateWorldMatrices
+};
+
+namespace SceneGraph
+{
+    // The parent has to exist already, that keeps the arrays topologically ordered
+    u32 AddNode(TransformHierarchy& hierarchy, u32 parent, const vec3& position, const glm::quat& rotation, const vec3& scale);
+
+    // Bulk version of AddNode, parents are relative to the first new node (or SCENE_NO_PARENT)
+    // and must point backwards. Returns the first node.
+    u32 AppendNodes(TransformHierarchy& hierarchy, u32 count, const vec3* positions, const glm::quat* rotations, const vec3* scales, const u32* parents);
+
+    void SetLocalPosition(TransformHierarchy& hierarchy, u32 node, const vec3& position);
+
+    void SetLocalRotation(TransformHierarchy& hierarchy, u32 node, const glm::quat& rotation);
+
+    void SetLocalScale(TransformHierarchy& hierarchy, u32 node, const vec3& scale);
+
+    glm::mat4 LocalMatrix(const TransformHierarchy& hierarchy, u32 node);
+
+    // Recomputes the dirty nodes and everything below them, returns how many changed
+    u32 UpdateWorldMatrices(TransformHierarchy& hierarchy);
+}
+
+#endif // !SCENE_GRAPH_FUNC
@@ -0,0 +1,330 @@
+
+#include "engine.h"
+#include "SceneLoadingFuncs.h"
+
+namespace SceneLoader
+{
+    static_assert(sizeof(glm::quat) == 4 * sizeof(f32), "Rotations are copied as x y z w");
+    static_assert(sizeof(Light) == sizeof(u32) + 10 * sizeof(f32), "Lights are copied as they are");
+
+    struct TextScene
+    {
+        std::vector<std::string> modelNames;
+        std::vector<std::string> modelPaths;
+
+        std::vector<u32> entityModels;
+        std::vector<u32> entityParents;
+        std::vector<vec3> entityPositions;
+        std::vector<glm::quat> entityRotations;
+        std::vector<vec3> entityScales;
+
+        std::vector<Light> lights;
+        std::vector<SceneWaterRecord> waters;
+    };
+
+    static i32 FindModel(const TextScene& scene, const char* name)
+    {
+        for (u32 i = 0; i < scene.modelNames.size(); ++i)
+            if (scene.modelNames[i] == name)
+                return i;
+        return -1;
+    }
+
+    static bool ParseLine(TextScene& scene, const char* line, u32 lineNumber, const char* textPath)
+    {
+        char keyword[64];
+        char name[256];
+        char path[256];
+        i32 consumed = 0;
+
+        if (sscanf(line, "%63s", keyword) != 1)
+            return true; // empty line
+
+        if (strcmp(keyword, "model") == 0)
+        {
+            if (sscanf(line, "%*s %255s %255s", name, path) != 2)
+            {
+                ELOG("%s(%u): expected 'model <name> <path>'", textPath, lineNumber);
+                return false;
+            }
+            scene.modelNames.push_back(name);
+            scene.modelPaths.push_back(path);
+        }
+        else if (strcmp(keyword, "entity") == 0)
+        {
+            vec3 position, scale;
+            if (sscanf(line, "%*s %255s %f %f %f %f %f %f%n", name, &position.x, &position.y, &position.z, &scale.x, &scale.y, &scale.z, &consumed) != 7)
+            {
+                ELOG("%s(%u): expected 'entity <model> <position> <scale> [rot <degrees>] [parent <entity>]'", textPath, lineNumber);
+                return false;
+            }
+
+            i32 model = FindModel(scene, name);
+            if (model < 0)
+            {
+                ELOG("%s(%u): unknown model '%s'", textPath, lineNumber, name);
+                return false;
+            }
+
+            vec3 eulerDegrees = vec3(0.0f);
+            u32 parent = SCENE_NO_PARENT;
+            for (const char* options = line + consumed; sscanf(options, "%63s%n", keyword, &consumed) == 1; options += consumed)
+            {
+                i32 optionConsumed = 0;
+                if (strcmp(keyword, "rot") == 0 && sscanf(options + consumed, "%f %f %f%n", &eulerDegrees.x, &eulerDegrees.y, &eulerDegrees.z, &optionConsumed) == 3)
+                    consumed += optionConsumed;
+                else if (strcmp(keyword, "parent") == 0 && sscanf(options + consumed, "%u%n", &parent, &optionConsumed) == 1)
+                    consumed += optionConsumed;
+                else
+                {
+                    ELOG("%s(%u): unknown entity option '%s'", textPath, lineNumber, keyword);
+                    return false;
+                }
+            }
+
+            if (parent != SCENE_NO_PARENT && parent >= scene.entityModels.size())
+            {
+                ELOG("%s(%u): parent %u has to be an earlier entity", textPath, lineNumber, parent);
+                return false;
+            }
+
+            scene.entityModels.push_back(model);
+            scene.entityParents.push_back(parent);
+            scene.entityPositions.push_back(position);
+            scene.entityRotations.push_back(glm::quat(glm::radians(eulerDegrees)));
+            scene.entityScales.push_back(scale);
+        }
+        else if (strcmp(keyword, "light") == 0)
+        {
+            Light light = {};
+            i32 fieldCount = sscanf(line, "%*s %255s %f %f %f %f %f %f %f %f %f %f", name,
+                &light.color.x, &light.color.y, &light.color.z,
+                &light.direction.x, &light.direction.y, &light.direction.z,
+                &light.position.x, &light.position.y, &light.position.z, &light.radius);
+            if (fieldCount != 10 && fieldCount != 11)
+            {
+                ELOG("%s(%u): expected 'light <directional|point> <color> <direction> <position> [radius]'", textPath, lineNumber);
+                return false;
+            }
+            if (fieldCount == 10)
+                light.radius = ClusteredLighting::LightRadius(light.color);
+
+            if (strcmp(name, "directional") == 0)
+                light.type = LightType_Directional;
+            else if (strcmp(name, "point") == 0)
+                light.type = LightType_Point;
+            else
+            {
+                ELOG("%s(%u): unknown light type '%s'", textPath, lineNumber, name);
+                return false;
+            }
+            scene.lights.push_back(light);
+        }
+        else if (strcmp(keyword, "water") == 0)
+        {
+            SceneWaterRecord water = {};
+            if (sscanf(line, "%*s %255s %f %f %f %f %f %f", name, &water.position.x, &water.position.y, &water.position.z, &water.scale.x, &water.scale.y, &water.scale.z) != 7)
+            {
+                ELOG("%s(%u): expected 'water <model> <position> <scale>'", textPath, lineNumber);
+                return false;
+            }
+
+            i32 model = FindModel(scene, name);
+            if (model < 0)
+            {
+                ELOG("%s(%u): unknown model '%s'", textPath, lineNumber, name);
+                return false;
+            }
+            water.model = model;
+            scene.waters.push_back(water);
+        }
+        else
+        {
+            ELOG("%s(%u): unknown keyword '%s'", textPath, lineNumber, keyword);
+            return false;
+        }
+
+        return true;
+    }
+
+    static u32 AppendTable(std::vector<u8>& blob, const void* data, u32 size)
+    {
+        u32 offset = BufferManager::Align(blob.size(), sizeof(vec4));
+        blob.resize(offset + size);
+        if (size > 0)
+            memcpy(blob.data() + offset, data, size);
+        return offset;
+    }
+
+    bool CompileTextScene(const char* textPath, const char* binaryPath)
+    {
+        String text = ReadTextFile(textPath);
+        if (!text.str)
+            return false;
+
+        TextScene scene;
+        char line[1024];
+        u32 lineNumber = 0;
+        for (const char* cursor = text.str; *cursor; )
+        {
+            const char* lineEnd = strchr(cursor, '\n');
+            if (!lineEnd)
+                lineEnd = cursor + strlen(cursor);
+
+            u32 length = glm::min((u32)(lineEnd - cursor), (u32)sizeof(line) - 1);
+            memcpy(line, cursor, length);
+            line[length] = '\0';
+            ++lineNumber;
+
+            // everything after a # is a comment
+            char* comment = strchr(line, '#');
+            if (comment)
+                *comment = '\0';
+
+            if (!ParseLine(scene, line, lineNumber, textPath))
+                return false;
+
+            cursor = *lineEnd ? lineEnd + 1 : lineEnd;
+        }
+
+        std::vector<u8> blob(sizeof(SceneFileHeader));
+        SceneFileHeader header = {};
+        header.magic = SCENE_FILE_MAGIC;
+        header.version = SCENE_FILE_VERSION;
+        header.modelCount = scene.modelPaths.size();
+        header.entityCount = scene.entityModels.size();
+        header.lightCount = scene.lights.size();
+        header.waterCount = scene.waters.size();
+
+        std::vector<u32> modelPathOffsets;
+        std::string strings;
+        for (u32 i = 0; i < scene.modelPaths.size(); ++i)
+        {
+            modelPathOffsets.push_back(strings.size());
+            strings += scene.modelPaths[i];
+            strings += '\0';
+        }
+
+        header.modelPathOffsets = AppendTable(blob, modelPathOffsets.data(), modelPathOffsets.size() * sizeof(u32));
+        header.stringTable = AppendTable(blob, strings.data(), strings.size());
+        header.stringTableSize = strings.size();
+        header.entityModels = AppendTable(blob, scene.entityModels.data(), header.entityCount * sizeof(u32));
+        header.entityParents = AppendTable(blob, scene.entityParents.data(), header.entityCount * sizeof(u32));
+        header.entityPositions = AppendTable(blob, scene.entityPositions.data(), header.entityCount * sizeof(vec3));
+        header.entityRotations = AppendTable(blob, scene.entityRotations.data(), header.entityCount * sizeof(glm::quat));
+        header.entityScales = AppendTable(blob, scene.entityScales.data(), header.entityCount * sizeof(vec3));
+        header.lights = AppendTable(blob, scene.lights.data(), header.lightCount * sizeof(Light));
+        header.waters = AppendTable(blob, scene.waters.data(), header.waterCount * sizeof(SceneWaterRecord));
+        memcpy(blob.data(), &header, sizeof(header));
+
+        if (!WriteBinaryFile(binaryPath, blob.data(), blob.size()))
+            return false;
+
+        ILOG("Compiled scene %s into %s (%u entities, %u bytes)", textPath, binaryPath, header.entityCount, (u32)blob.size());
+        return true;
+    }
+
+    static bool TableFits(const MappedFile& file, u32 offset, u64 size)
+    {
+        return (u64)offset + size <= file.size;
+    }
+
+    // The tables fit, now what they hold: every index read from the file has to land inside the table it indexes
+    static bool IndicesValid(const MappedFile& file, const SceneFileHeader& header)
+    {
+        const u32* modelPathOffsets = (const u32*)(file.data + header.modelPathOffsets);
+        const char* strings = (const char*)(file.data + header.stringTable);
+        for (u32 i = 0; i < header.modelCount; ++i)
+        {
+            u32 offset = modelPathOffsets[i];
+            if (offset >= header.stringTableSize || !memchr(strings + offset, '\0', header.stringTableSize - offset))
+                return false;
+        }
+
+        const u32* entityModels = (const u32*)(file.data + header.entityModels);
+        const u32* entityParents = (const u32*)(file.data + header.entityParents);
+        for (u32 i = 0; i < header.entityCount; ++i)
+        {
+            if (entityModels[i] >= header.modelCount)
+                return false;
+            if (entityParents[i] != SCENE_NO_PARENT && entityParents[i] >= i)
+                return false;
+        }
+
+        const SceneWaterRecord* waters = (const SceneWaterRecord*)(file.data + header.waters);
+        for (u32 i = 0; i < header.waterCount; ++i)
+            if (waters[i].model >= header.modelCount)
+                return false;
+        return true;
+    }
+
+    bool LoadScene(App* app, const char* binaryPath)
+    {
+        f64 start = glfwGetTime();
+
+        MappedFile file = MapFile(binaryPath);
+        if (!file.data)
+            return false;
+
+        const SceneFileHeader& header = *(const SceneFileHeader*)file.data;
+        bool valid = file.size >= sizeof(SceneFileHeader) && header.magic == SCENE_FILE_MAGIC && header.version == SCENE_FILE_VERSION;
+        valid = valid && TableFits(file, header.modelPathOffsets, (u64)header.modelCount * sizeof(u32))
+            && TableFits(file, header.stringTable, header.stringTableSize)
+            && TableFits(file, header.entityModels, (u64)header.entityCount * sizeof(u32))
+            && TableFits(file, header.entityParents, (u64)header.entityCount * sizeof(u32))
+            && TableFits(file, header.entityPositions, (u64)header.entityCount * sizeof(vec3))
+            && TableFits(file, header.entityRotations, (u64)header.entityCount * sizeof(glm::quat))
+            && TableFits(file, header.entityScales, (u64)header.entityCount * sizeof(vec3))
+            && TableFits(file, header.lights, (u64)header.lightCount * sizeof(Light))
+            && TableFits(file, header.waters, (u64)header.waterCount * sizeof(SceneWaterRecord));
+        // a corrupt file is rejected before anything is created from it, the caller compiles the text scene again
+        valid = valid && header.waterCount > 0 && IndicesValid(file, header);
+        if (!valid)
+        {
+            ELOG("%s is not a valid scene file (version %u expected, with a water plane and every index inside its table)", binaryPath, SCENE_FILE_VERSION);
+            UnmapFile(file);
+            return false;
+        }
+
+        // every model once, the tables refer to them by index
+        const u32* modelPathOffsets = (const u32*)(file.data + header.modelPathOffsets);
+        const char* strings = (const char*)(file.data + header.stringTable);
+        std::vector<u32> models(header.modelCount);
+        for (u32 i = 0; i < header.modelCount; ++i)
+            models[i] = ModelLoader::LoadModel(app, strings + modelPathOffsets[i]);
+
+        f64 modelsLoaded = glfwGetTime();
+
+        // the columns go in with one copy each, only the model indices need remapping
+        u32 firstNode = SceneGraph::AppendNodes(app->transforms, header.entityCount,
+            (const vec3*)(file.data + header.entityPositions),
+            (const glm::quat*)(file.data + header.entityRotations),
+            (const vec3*)(file.data + header.entityScales),
+            (const u32*)(file.data + header.entityParents));
+
+        const u32* entityModels = (const u32*)(file.data + header.entityModels);
+        std::vector<u32> engineModels(header.entityCount);
+        for (u32 i = 0; i < header.entityCount; ++i)
+            engineModels[i] = models[entityModels[i]];
+        app->CreateEntities(header.entityCount, engineModels.data(), firstNode, RenderPass_All);
+
+        const Light* lights = (const Light*)(file.data + header.lights);
+        app->lights.insert(app->lights.end(), lights, lights + header.lightCount);
+
+        // the water is in no pass, it is drawn over the lit frame. Only the first plane places it
+        const SceneWaterRecord* waters = (const SceneWaterRecord*)(file.data + header.waters);
+        for (u32 i = 0; i < header.waterCount; ++i)
+        {
+            EntityId water = app->CreateEntity(models[waters[i].model], waters[i].position, waters[i].scale, 0);
+            if (i == 0)
+                app->waterEntity = water;
+        }
+
+        UnmapFile(file);
+
+        f64 end = glfwGetTime();
+        ILOG("Loaded scene %s: %u entities, %u lights in %.3f ms (models %.3f ms, tables %.3f ms)", binaryPath,
+            header.entityCount, header.lightCount, (end - start) * 1000.0, (modelsLoaded - start) * 1000.0, (end - modelsLoaded) * 1000.0);
+        return true;
+    }
+}
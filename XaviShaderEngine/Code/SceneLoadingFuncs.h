@@ -0,0 +1,54 @@
+
+#ifndef SCENE_LOADING_FUNC
+#define SCENE_LOADING_FUNC
+
+#include "Globals.h"
+
+struct App;
+
+#define SCENE_FILE_MAGIC 0x4E435358 // "XSCN"
+#define SCENE_FILE_VERSION 2
+
+// Binary scene: this header and then flat tables, every offset is from the start of the file.
+// The entity tables are columns so they copy straight into TransformHierarchy and EntityStore.
+struct SceneFileHeader
+{
+    u32 magic;
+    u32 version;
+
+    u32 modelCount;
+    u32 entityCount;
+    u32 lightCount;
+    u32 waterCount;
+
+    u32 modelPathOffsets; // u32[modelCount], into the string table
+    u32 stringTable;
+    u32 stringTableSize;
+
+    u32 entityModels; // u32[entityCount], index in the model table
+    u32 entityParents; // u32[entityCount], earlier entity or SCENE_NO_PARENT
+    u32 entityPositions; // vec3[entityCount]
+    u32 entityRotations; // glm::quat[entityCount], x y z w
+    u32 entityScales; // vec3[entityCount]
+
+    u32 lights; // Light[lightCount]
+    u32 waters; // SceneWaterRecord[waterCount]
+};
+
+struct SceneWaterRecord
+{
+    u32 model;
+    vec3 position;
+    vec3 scale;
+};
+
+namespace SceneLoader
+{
+    // Parses the authoring format (see WorkingDir/Assets/Default.scene) and writes the binary one
+    bool CompileTextScene(const char* textPath, const char* binaryPath);
+
+    // Maps the binary scene and appends its models, entities, lights and water planes to the app
+    bool LoadScene(App* app, const char* binaryPath);
+}
+
+#endif // !SCENE_LOADING_FUNC
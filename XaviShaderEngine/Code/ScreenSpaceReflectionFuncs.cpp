@@ -0,0 +1,55 @@
+
+#include "ScreenSpaceReflectionFuncs.h"
+#include "OcclusionCullingFuncs.h"
+#include "GLStateFuncs.h"
+
+namespace ScreenSpaceReflections
+{
+    void Resize(ReflectionDepth& depth, ivec2 size)
+    {
+        if (depth.depthPyramid != 0)
+        {
+            glDeleteTextures(1, &depth.depthPyramid);
+            GLState::Invalidate();
+        }
+
+        depth.size = size;
+        depth.mipCount = 1;
+        for (i32 maxSize = glm::max(size.x, size.y); maxSize > 1; maxSize >>= 1)
+            ++depth.mipCount;
+
+        glGenTextures(1, &depth.depthPyramid);
+        GLState::BindTexture(GL_TEXTURE_2D, depth.depthPyramid);
+        glTexStorage2D(GL_TEXTURE_2D, depth.mipCount, GL_R32F, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        GLState::BindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void Create(ReflectionDepth& depth, ivec2 size)
+    {
+        depth.depthPyramid = 0;
+        Resize(depth, size);
+    }
+
+    void BuildDepthPyramid(ReflectionDepth& depth, GLuint buildProgram, GLuint depthTexture)
+    {
+        OcclusionCulling::ReduceDepth(buildProgram, depthTexture, depth.depthPyramid, depth.size, depth.mipCount, true);
+    }
+
+    void BindForWater(const ReflectionDepth& depth, GLuint program, u32 firstUnit, const glm::mat4& viewProjection, f32 zNear, f32 zFar, bool enabled)
+    {
+        glUniform1i(glGetUniformLocation(program, "uScreenSpaceReflection"), enabled);
+        if (!enabled)
+            return;
+
+        GLState::ActiveTexture(GL_TEXTURE0 + firstUnit);
+        GLState::BindTexture(GL_TEXTURE_2D, depth.depthPyramid);
+        glUniform1i(glGetUniformLocation(program, "ssrDepthPyramid"), firstUnit);
+
+        glUniformMatrix4fv(glGetUniformLocation(program, "ssrViewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+        glUniform2f(glGetUniformLocation(program, "ssrNearFar"), zNear, zFar);
+    }
+}
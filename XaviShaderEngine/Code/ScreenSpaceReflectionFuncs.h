@@ -0,0 +1,31 @@
+
+#ifndef SCREEN_SPACE_REFLECTION_FUNC
+#define SCREEN_SPACE_REFLECTION_FUNC
+
+#include "Globals.h"
+
+// What the water traces its reflections against: the depth the main pass left this frame. Hits are read from the
+// scene color the water refracts
+struct ReflectionDepth
+{
+    // every texel keeps the nearest depth of the texels below it, mip 0 is the depth itself
+    GLuint depthPyramid;
+    ivec2 size;
+    u32 mipCount;
+};
+
+namespace ScreenSpaceReflections
+{
+    void Create(ReflectionDepth& depth, ivec2 size);
+
+    // New pyramid of that size
+    void Resize(ReflectionDepth& depth, ivec2 size);
+
+    // Reduces the depth attachment of the main pass, before the water is drawn
+    void BuildDepthPyramid(ReflectionDepth& depth, GLuint buildProgram, GLuint depthTexture);
+
+    // The pyramid and the camera of the main pass for WaterEffect.glsl, on firstUnit
+    void BindForWater(const ReflectionDepth& depth, GLuint program, u32 firstUnit, const glm::mat4& viewProjection, f32 zNear, f32 zFar, bool enabled);
+}
+
+#endif // !SCREEN_SPACE_REFLECTION_FUNC
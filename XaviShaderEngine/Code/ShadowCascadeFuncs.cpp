@@ -0,0 +1,224 @@
+
+#include "ShadowCascadeFuncs.h"
+#include "GLStateFuncs.h"
+#include "platform.h"
+
+#include <algorithm>
+
+// cached cascades are fit with this much room, the camera can move inside it without a render
+#define SHADOW_CACHE_MARGIN 0.25f
+// casters between the light and the cascade sphere, along the light direction
+#define SHADOW_CASTER_EXTENT 100.0f
+
+namespace ShadowCascades
+{
+    void Create(CascadedShadowMap& shadowMap)
+    {
+        glGenTextures(1, &shadowMap.depthArray);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.depthArray);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADE_COUNT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(SHADOW_CASCADE_COUNT, shadowMap.frameBuffers);
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+        {
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, shadowMap.frameBuffers[c]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap.depthArray, 0, c);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+
+            GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+                ELOG("Shadow cascade %u framebuffer incomplete (0x%x)", c, framebufferStatus);
+        }
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        shadowMap.shadowDistance = 150.0f;
+        shadowMap.splitLambda = 0.75f;
+        shadowMap.updateBudget = 2;
+        shadowMap.alwaysUpdated = 1;
+        shadowMap.maxAge = 30;
+        Invalidate(shadowMap);
+    }
+
+    static bool SphereInCascade(const ShadowCascade& cascade, const vec4& sphere)
+    {
+        vec3 center = vec3(cascade.lightView * vec4(vec3(sphere), 1.0f));
+        return glm::all(glm::greaterThanEqual(center + sphere.w, cascade.boundsMin)) && glm::all(glm::lessThanEqual(center - sphere.w, cascade.boundsMax));
+    }
+
+    void MarkChanged(CascadedShadowMap& shadowMap, const vec4& boundingSphere)
+    {
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+            if (!shadowMap.cascades[c].dirty && SphereInCascade(shadowMap.cascades[c], boundingSphere))
+                shadowMap.cascades[c].dirty = true;
+    }
+
+    void Invalidate(CascadedShadowMap& shadowMap)
+    {
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+            shadowMap.cascades[c].dirty = true;
+    }
+
+    static void RenderCascade(CascadedShadowMap& shadowMap, u32 c, const DrawList& list, u32 packetCount, const DrawView& view, const std::vector<vec4>& rowBoundingSpheres)
+    {
+        const ShadowCascade& cascade = shadowMap.cascades[c];
+
+        // only the packets inside the box of this cascade
+        DrawList& cascadeList = shadowMap.cascadeList;
+        cascadeList.program = list.program;
+        cascadeList.textureLocation = list.textureLocation;
+        cascadeList.viewMatrixLocation = list.viewMatrixLocation;
+        cascadeList.packets.clear();
+        for (u32 i = 0; i < packetCount; ++i)
+            if (SphereInCascade(cascade, rowBoundingSpheres[list.packets[i].row]))
+                cascadeList.packets.push_back(list.packets[i]);
+        cascadeList.mainViewCount = cascadeList.packets.size();
+        cascadeList.waterViewBegin = cascadeList.packets.size();
+
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, shadowMap.frameBuffers[c]);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glUniformMatrix4fv(glGetUniformLocation(list.program, "uLightViewProjection"), 1, GL_FALSE, &cascade.viewProjection[0][0]);
+        DrawCommands::Replay(cascadeList, cascadeList.packets.size(), view);
+    }
+
+    void Update(CascadedShadowMap& shadowMap, const glm::mat4& cameraView, f32 fovY, f32 aspectRatio, f32 zNear, const vec3& lightDirection,
+        const DrawList& list, u32 packetCount, const DrawView& view, const std::vector<vec4>& rowBoundingSpheres)
+    {
+        shadowMap.frame++;
+        shadowMap.updatedMask = 0;
+
+        vec3 direction = glm::normalize(lightDirection);
+        if (glm::dot(direction, shadowMap.lightDirection) < 0.9999f)
+        {
+            Invalidate(shadowMap);
+            shadowMap.lightDirection = direction;
+        }
+
+        // one light rotation for every cascade, the texel snapping happens in it
+        vec3 up = fabsf(direction.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(vec3(0.0f), -direction, up);
+        glm::mat4 inverseCameraView = glm::inverse(cameraView);
+        f32 tanY = tanf(fovY * 0.5f);
+        f32 tanX = tanY * aspectRatio;
+
+        vec3 sliceCenters[SHADOW_CASCADE_COUNT];
+        f32 sliceRadii[SHADOW_CASCADE_COUNT];
+        bool needed[SHADOW_CASCADE_COUNT];
+
+        f32 splitNear = zNear;
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+        {
+            ShadowCascade& cascade = shadowMap.cascades[c];
+
+            f32 fraction = (f32)(c + 1) / SHADOW_CASCADE_COUNT;
+            f32 uniformSplit = zNear + (shadowMap.shadowDistance - zNear) * fraction;
+            f32 logSplit = zNear * powf(shadowMap.shadowDistance / zNear, fraction);
+            f32 splitFar = glm::mix(uniformSplit, logSplit, shadowMap.splitLambda);
+            cascade.splitFar = splitFar;
+
+            // sphere around the slice corners, its radius stays the same when the camera turns
+            vec3 corners[8];
+            vec3 center = vec3(0.0f);
+            for (u32 k = 0; k < 8; ++k)
+            {
+                f32 depth = (k & 4) ? splitFar : splitNear;
+                vec4 viewCorner = vec4((k & 1 ? 1.0f : -1.0f) * tanX * depth, (k & 2 ? 1.0f : -1.0f) * tanY * depth, -depth, 1.0f);
+                corners[k] = vec3(inverseCameraView * viewCorner);
+                center += corners[k] / 8.0f;
+            }
+            f32 radius = 0.0f;
+            for (u32 k = 0; k < 8; ++k)
+                radius = glm::max(radius, glm::length(corners[k] - center));
+            sliceCenters[c] = center;
+            sliceRadii[c] = ceilf(radius * 16.0f) / 16.0f;
+
+            bool covered = glm::length(center - cascade.center) + sliceRadii[c] <= cascade.radius;
+            needed[c] = c < shadowMap.alwaysUpdated || cascade.dirty || !covered;
+
+            splitNear = splitFar;
+        }
+
+        // the ones that must follow first, then the ones that waited the longest
+        u32 order[SHADOW_CASCADE_COUNT];
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+            order[c] = c;
+        std::sort(order, order + SHADOW_CASCADE_COUNT, [&](u32 a, u32 b)
+        {
+            bool alwaysA = a < shadowMap.alwaysUpdated, alwaysB = b < shadowMap.alwaysUpdated;
+            if (alwaysA != alwaysB)
+                return alwaysA;
+            if (needed[a] != needed[b])
+                return needed[a];
+            return shadowMap.cascades[a].lastUpdateFrame < shadowMap.cascades[b].lastUpdateFrame;
+        });
+
+        GLState::UseProgram(list.program);
+        GLState::Viewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        u32 budget = glm::max(shadowMap.updateBudget, 1u);
+        for (u32 i = 0; i < SHADOW_CASCADE_COUNT && i < budget; ++i)
+        {
+            u32 c = order[i];
+            ShadowCascade& cascade = shadowMap.cascades[c];
+            if (!needed[c] && shadowMap.frame - cascade.lastUpdateFrame < shadowMap.maxAge)
+                break;
+
+            f32 radius = sliceRadii[c];
+            if (c >= shadowMap.alwaysUpdated)
+                radius *= 1.0f + SHADOW_CACHE_MARGIN;
+
+            // whole texel steps, so the cascade does not shimmer while the camera moves
+            vec3 lightCenter = vec3(lightRotation * vec4(sliceCenters[c], 1.0f));
+            f32 texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+            lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+            lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+
+            // the light looks down -z, the casters towards it have a greater z
+            cascade.lightView = lightRotation;
+            cascade.boundsMin = lightCenter - vec3(radius);
+            cascade.boundsMax = lightCenter + vec3(radius, radius, radius + SHADOW_CASTER_EXTENT);
+            glm::mat4 projection = glm::ortho(cascade.boundsMin.x, cascade.boundsMax.x, cascade.boundsMin.y, cascade.boundsMax.y, -cascade.boundsMax.z, -cascade.boundsMin.z);
+            cascade.viewProjection = projection * lightRotation;
+            cascade.center = sliceCenters[c];
+            cascade.radius = radius;
+            cascade.dirty = false;
+            cascade.lastUpdateFrame = shadowMap.frame;
+
+            RenderCascade(shadowMap, c, list, packetCount, view, rowBoundingSpheres);
+            shadowMap.updatedMask |= 1 << c;
+        }
+
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::UseProgram(0);
+    }
+
+    void BindForShading(const CascadedShadowMap& shadowMap, GLuint program, u32 textureUnit, bool enabled)
+    {
+        GLState::ActiveTexture(GL_TEXTURE0 + textureUnit);
+        GLState::BindTexture(GL_TEXTURE_2D_ARRAY, shadowMap.depthArray);
+        glUniform1i(glGetUniformLocation(program, "uShadowMap"), textureUnit);
+
+        glm::mat4 matrices[SHADOW_CASCADE_COUNT];
+        vec4 splits;
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+        {
+            // a cascade that was never rendered maps everything out of its box, so it is skipped
+            matrices[c] = shadowMap.cascades[c].lastUpdateFrame > 0 ? shadowMap.cascades[c].viewProjection : glm::translate(vec3(10.0f));
+            splits[c] = shadowMap.cascades[c].splitFar;
+        }
+        glUniformMatrix4fv(glGetUniformLocation(program, "uShadowMatrices"), SHADOW_CASCADE_COUNT, GL_FALSE, &matrices[0][0][0]);
+        glUniform4fv(glGetUniformLocation(program, "uCascadeSplits"), 1, glm::value_ptr(splits));
+
+        glUniform1i(glGetUniformLocation(program, "uShadowsEnabled"), enabled);
+    }
+}
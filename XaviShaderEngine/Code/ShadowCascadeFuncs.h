@@ -0,0 +1,63 @@
+
+#ifndef SHADOW_CASCADE_FUNC
+#define SHADOW_CASCADE_FUNC
+
+#include "Globals.h"
+#include "DrawListFuncs.h"
+
+// Same count in FB_TO_BB.glsl, FB_TO_BB_SSAO.glsl and LIGHT_VOLUME.glsl
+#define SHADOW_CASCADE_COUNT 4
+#define SHADOW_MAP_SIZE 2048
+
+struct ShadowCascade
+{
+    // what the cascade was last rendered with, the lighting samples with it until the next render
+    glm::mat4 lightView;
+    glm::mat4 viewProjection;
+    vec3 boundsMin; // light view space box of the last render
+    vec3 boundsMax;
+    vec3 center; // world space sphere the box was fit to
+    f32 radius;
+
+    f32 splitFar; // view depth where the next cascade starts
+    bool dirty; // something moved inside the box
+    u32 lastUpdateFrame;
+};
+
+struct CascadedShadowMap
+{
+    GLuint depthArray;
+    GLuint frameBuffers[SHADOW_CASCADE_COUNT];
+    ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+    vec3 lightDirection; // of the cached cascades, they are all redone when it changes
+
+    f32 shadowDistance;
+    f32 splitLambda; // 0 uniform splits, 1 logarithmic
+    u32 updateBudget; // cascades rendered per frame
+    u32 alwaysUpdated; // nearest cascades rendered every frame, they count against the budget
+    u32 maxAge; // frames a cached cascade can go without a render
+
+    u32 frame;
+    u32 updatedMask; // cascades rendered in the last Update
+    DrawList cascadeList; // the packets of the cascade being rendered
+};
+
+namespace ShadowCascades
+{
+    void Create(CascadedShadowMap& shadowMap);
+
+    // Cached cascades whose box has the sphere are rendered again
+    void MarkChanged(CascadedShadowMap& shadowMap, const vec4& boundingSphere);
+
+    void Invalidate(CascadedShadowMap& shadowMap);
+
+    // Fits the cascades to the camera and renders the ones that need it within the budget. The list program has
+    // to take the local params of the view, packets are culled per cascade with the bounding sphere of their row
+    void Update(CascadedShadowMap& shadowMap, const glm::mat4& cameraView, f32 fovY, f32 aspectRatio, f32 zNear, const vec3& lightDirection,
+        const DrawList& list, u32 packetCount, const DrawView& view, const std::vector<vec4>& rowBoundingSpheres);
+
+    // Shadow map on the given unit plus the cascade matrices and splits, with the program in use
+    void BindForShading(const CascadedShadowMap& shadowMap, GLuint program, u32 textureUnit, bool enabled);
+}
+
+#endif // !SHADOW_CASCADE_FUNC
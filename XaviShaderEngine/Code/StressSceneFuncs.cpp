@@ -0,0 +1,319 @@
+
+#include "engine.h"
+#include "StressSceneFuncs.h"
+#include <random>
+
+#define STRESS_SPACING 4.0f
+#define STRESS_HEIGHT 2.0f
+#define STRESS_LIGHT_HEIGHT 3.0f
+#define STRESS_LIGHT_RADIUS 8.0f
+
+namespace StressTest
+{
+    static const char* modelPaths[] = { "Patrick/Sphere.obj", "Patrick/Cone.obj", "Assets/Bookshelf.obj", "Assets/House.obj" };
+    static const f32 modelScales[] = { 0.5f, 0.5f, 1.0f, 0.2f };
+
+    // Bytes of a ring region every pass keeps for the globals, the rest holds the entity blocks
+    static u32 ReservedRegionBytes(const App* app)
+    {
+        const u32 alignment = app->uniformBlockAlignment;
+        const u32 globalsSize = BufferManager::Align(2 * sizeof(vec4) + MAX_SHADER_LIGHTS * 4 * sizeof(vec4), alignment);
+        return UNIFORM_PASSES_PER_FRAME * (globalsSize + alignment);
+    }
+
+    // What the uniform ring still fits next to the scene entities, the current stress ones left out
+    static u32 InstanceLimit(const App* app, const StressScene& stress)
+    {
+        u32 sceneEntities = Entities::Count(app->entityStore) - stress.entities.size();
+        u32 capacity = EntityCapacity(app);
+        return capacity > sceneEntities ? capacity - sceneEntities : 0;
+    }
+
+    // Recreates the uniform ring with regions big enough for the scene and instanceCount stress entities, it is
+    // never shrunk. Only called between frames, DestroyRingBuffer waits for the GPU to release the old one
+    static void ReserveInstances(App* app, const StressScene& stress, u32 instanceCount)
+    {
+        if (instanceCount <= InstanceLimit(app, stress))
+            return;
+
+        const u32 entityStride = BufferManager::Align(2 * sizeof(glm::mat4), app->uniformBlockAlignment);
+        u32 entityCount = Entities::Count(app->entityStore) - stress.entities.size() + instanceCount;
+        u32 regionSize = ReservedRegionBytes(app) + UNIFORM_PASSES_PER_FRAME * entityCount * entityStride;
+        regionSize = BufferManager::Align(regionSize, app->uniformBlockAlignment);
+
+        BufferManager::DestroyRingBuffer(app->localUniformBuffer);
+        app->localUniformBuffer = BufferManager::CreateRingBuffer(regionSize, UNIFORM_RING_FRAMES, GL_UNIFORM_BUFFER);
+        ILOG("Uniform ring grown to %u entities, %u KB per region", EntityCapacity(app), regionSize / 1024);
+    }
+
+    void Generate(App* app, StressScene& stress, const StressSceneParams& params)
+    {
+        f64 start = glfwGetTime();
+
+        Clear(app, stress);
+        stress.params = params;
+        stress.time = 0.0f;
+
+        if (!stress.modelsLoaded)
+        {
+            for (u32 i = 0; i < ARRAY_COUNT(modelPaths); ++i)
+                stress.models[i] = ModelLoader::LoadModel(app, modelPaths[i]);
+            stress.modelsLoaded = true;
+        }
+
+        std::vector<u32> usableModels;
+        for (u32 i = 0; i < ARRAY_COUNT(modelPaths); ++i)
+            if (stress.models[i] != UINT32_MAX)
+                usableModels.push_back(i);
+
+        std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
+        std::default_random_engine generator(params.seed);
+
+        u32 count = usableModels.empty() ? 0 : glm::min(params.instanceCount, (u32)STRESS_MAX_INSTANCES);
+        ReserveInstances(app, stress, count);
+        u32 instanceLimit = InstanceLimit(app, stress);
+        if (count > instanceLimit)
+        {
+            ELOG("Stress scene: %u instances do not fit in the uniform ring, %u generated", count, instanceLimit);
+            count = instanceLimit;
+        }
+        const u32 side = (u32)ceilf(sqrtf((f32)glm::max(count, params.pointLightCount)));
+        const f32 extent = side * STRESS_SPACING;
+
+        if (count > 0)
+        {
+            std::vector<vec3> positions(count);
+            std::vector<glm::quat> rotations(count, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+            std::vector<vec3> scales(count);
+            std::vector<u32> parents(count, SCENE_NO_PARENT);
+            std::vector<u32> models(count);
+
+            for (u32 i = 0; i < count; ++i)
+            {
+                if (params.randomLayout)
+                    positions[i] = vec3((randomFloats(generator) - 0.5f) * extent, STRESS_HEIGHT + randomFloats(generator) * STRESS_SPACING, (randomFloats(generator) - 0.5f) * extent);
+                else
+                    positions[i] = vec3((i % side) * STRESS_SPACING - extent * 0.5f, STRESS_HEIGHT, (i / side) * STRESS_SPACING - extent * 0.5f);
+
+                u32 model = usableModels[i % usableModels.size()];
+                models[i] = stress.models[model];
+                scales[i] = vec3(modelScales[model]);
+            }
+
+            if (count <= stress.nodeCapacity)
+            {
+                for (u32 i = 0; i < count; ++i)
+                {
+                    SceneGraph::SetLocalPosition(app->transforms, stress.firstNode + i, positions[i]);
+                    SceneGraph::SetLocalScale(app->transforms, stress.firstNode + i, scales[i]);
+                }
+            }
+            else
+            {
+                stress.firstNode = SceneGraph::AppendNodes(app->transforms, count, positions.data(), rotations.data(), scales.data(), parents.data());
+                stress.nodeCapacity = count;
+            }
+
+            EntityId firstEntity = app->CreateEntities(count, models.data(), stress.firstNode, RenderPass_All);
+            stress.entities.resize(count);
+            for (u32 i = 0; i < count; ++i)
+                stress.entities[i] = firstEntity + i;
+            stress.basePositions = positions;
+        }
+
+        stress.firstLight = app->lights.size();
+        for (u32 i = 0; i < params.pointLightCount; ++i)
+        {
+            vec3 position = vec3((randomFloats(generator) - 0.5f) * extent, STRESS_LIGHT_HEIGHT, (randomFloats(generator) - 0.5f) * extent);
+            vec3 color = vec3(randomFloats(generator), randomFloats(generator), randomFloats(generator));
+            app->lights.push_back({ LightType_Point, color, vec3(1.0f), position, STRESS_LIGHT_RADIUS });
+            stress.lightBasePositions.push_back(position);
+        }
+
+        if (app->mode == Mode_Forward && app->lights.size() > MAX_SHADER_LIGHTS)
+            ILOG("Stress scene: %u lights, forward shading only uses the first %u", (u32)app->lights.size(), MAX_SHADER_LIGHTS);
+        ILOG("Stress scene: %u instances and %u point lights generated in %.2f ms", count, params.pointLightCount, (glfwGetTime() - start) * 1000.0);
+    }
+
+    void Clear(App* app, StressScene& stress)
+    {
+        // from the last row, so no other entity has to move into the holes
+        for (u32 i = stress.entities.size(); i-- > 0;)
+            if (Entities::IsAlive(app->entityStore, stress.entities[i]))
+                app->DestroyEntity(stress.entities[i]);
+        stress.entities.clear();
+        stress.basePositions.clear();
+
+        if (!stress.lightBasePositions.empty())
+            app->lights.erase(app->lights.begin() + stress.firstLight, app->lights.begin() + stress.firstLight + stress.lightBasePositions.size());
+        stress.lightBasePositions.clear();
+    }
+
+    void Animate(App* app, StressScene& stress, f32 deltaTime)
+    {
+        if (!stress.params.animate)
+            return;
+
+        stress.time += deltaTime;
+
+        for (u32 i = 0; i < stress.entities.size(); ++i)
+        {
+            vec3 offset = vec3(0.0f, sinf(stress.time * 2.0f + i * 0.37f) * 0.5f, 0.0f);
+            SceneGraph::SetLocalPosition(app->transforms, stress.firstNode + i, stress.basePositions[i] + offset);
+        }
+
+        for (u32 i = 0; i < stress.lightBasePositions.size(); ++i)
+        {
+            f32 angle = stress.time + i * 0.61f;
+            app->lights[stress.firstLight + i].position = stress.lightBasePositions[i] + vec3(cosf(angle), 0.0f, sinf(angle)) * STRESS_SPACING;
+        }
+    }
+
+    u32 EntityCapacity(const App* app)
+    {
+        const u32 entityStride = BufferManager::Align(2 * sizeof(glm::mat4), app->uniformBlockAlignment);
+
+        // every pass pushes the globals and all the entity blocks
+        const u32 reserved = ReservedRegionBytes(app);
+        if (app->localUniformBuffer.regionSize <= reserved)
+            return 0;
+
+        return (app->localUniformBuffer.regionSize - reserved) / (UNIFORM_PASSES_PER_FRAME * entityStride);
+    }
+
+    void BeginSweep(StressSweep& sweep, const char* csvPath)
+    {
+        const u32 instanceCounts[] = { 0, 64, 256, 1024, 4096, 16384, 65536 };
+        const u32 lightCounts[] = { 0, 4, 16, 64 };
+
+        sweep.instanceCounts.assign(instanceCounts, instanceCounts + ARRAY_COUNT(instanceCounts));
+        sweep.lightCounts.assign(lightCounts, lightCounts + ARRAY_COUNT(lightCounts));
+        sweep.warmupFrames = 30;
+        sweep.measuredFrames = 120;
+
+        sweep.running = true;
+        sweep.combination = 0;
+        sweep.frame = 0;
+        sweep.csvPath = csvPath;
+        sweep.csv = "instances,point_lights,shaded_lights,entities,ring_capacity,cpu_ms,gpu_ms,frame_ms,status\n";
+    }
+
+    static void NextCombination(App* app, StressSweep& sweep)
+    {
+        sweep.combination++;
+        sweep.frame = 0;
+        if (sweep.combination < sweep.instanceCounts.size() * sweep.lightCounts.size())
+            return;
+
+        sweep.running = false;
+        Clear(app, app->stressScene);
+
+        if (WriteBinaryFile(sweep.csvPath.c_str(), sweep.csv.data(), sweep.csv.size()))
+        {
+            ILOG("Stress sweep written to %s", sweep.csvPath.c_str());
+        }
+        else
+        {
+            ELOG("Could not write the stress sweep to %s", sweep.csvPath.c_str());
+        }
+
+        if (sweep.quitWhenDone)
+            app->isRunning = false;
+    }
+
+    void StepSweep(App* app, StressSweep& sweep)
+    {
+        if (!sweep.running)
+            return;
+
+        const u32 instanceCount = sweep.instanceCounts[sweep.combination / sweep.lightCounts.size()];
+        const u32 lightCount = sweep.lightCounts[sweep.combination % sweep.lightCounts.size()];
+        char line[256];
+
+        if (sweep.frame == 0)
+        {
+            if (instanceCount > STRESS_MAX_INSTANCES)
+            {
+                sprintf(line, "%u,%u,,,,,,,over the %u stress instances limit\n", instanceCount, lightCount, STRESS_MAX_INSTANCES);
+                sweep.csv += line;
+                NextCombination(app, sweep);
+                return;
+            }
+
+            // layout and animation stay as set in the gui or the command line
+            StressSceneParams params = app->stressParams;
+            params.instanceCount = instanceCount;
+            params.pointLightCount = lightCount;
+            Generate(app, app->stressScene, params);
+
+            sweep.cpuTotal = 0.0;
+            sweep.gpuTotal = 0.0;
+            sweep.frameTotal = 0.0;
+        }
+        else if (sweep.frame > sweep.warmupFrames)
+        {
+            // the previous frame, the warmup covers the frames the GPU times lag behind
+            sweep.cpuTotal += app->cpuFrameMs;
+            sweep.gpuTotal += GpuProfiler::Milliseconds(app->gpuTimers, "Frame");
+            sweep.frameTotal += app->deltaTime * 1000.0;
+        }
+
+        if (++sweep.frame <= sweep.warmupFrames + sweep.measuredFrames)
+            return;
+
+        // the clustered deferred lighting has no light limit, forward shading still does
+        u32 lightTotal = app->lights.size();
+        bool lightsClamped = app->mode == Mode_Forward && lightTotal > MAX_SHADER_LIGHTS;
+        sprintf(line, "%u,%u,%u,%u,%u,%.3f,%.3f,%.3f,%s\n", instanceCount, lightCount, lightsClamped ? (u32)MAX_SHADER_LIGHTS : lightTotal, Entities::Count(app->entityStore), EntityCapacity(app),
+            sweep.cpuTotal / sweep.measuredFrames, sweep.gpuTotal / sweep.measuredFrames, sweep.frameTotal / sweep.measuredFrames,
+            lightsClamped ? "lights over the forward shading limit" : "ok");
+        sweep.csv += line;
+        NextCombination(app, sweep);
+    }
+
+    void ParseCommandLine(App* app, int argc, char** argv)
+    {
+        bool generate = false;
+        const char* sweepPath = NULL;
+
+        for (int i = 1; i < argc; ++i)
+        {
+            bool hasValue = i + 1 < argc;
+            if (strcmp(argv[i], "--stress-instances") == 0 && hasValue)
+            {
+                app->stressParams.instanceCount = atoi(argv[++i]);
+                generate = true;
+            }
+            else if (strcmp(argv[i], "--stress-lights") == 0 && hasValue)
+            {
+                app->stressParams.pointLightCount = atoi(argv[++i]);
+                generate = true;
+            }
+            else if (strcmp(argv[i], "--stress-seed") == 0 && hasValue)
+                app->stressParams.seed = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--stress-random") == 0)
+                app->stressParams.randomLayout = true;
+            else if (strcmp(argv[i], "--stress-animate") == 0)
+                app->stressParams.animate = true;
+            else if (strcmp(argv[i], "--stress-sweep") == 0 && hasValue)
+                sweepPath = argv[++i];
+            else
+                ELOG("Unknown command line option %s", argv[i]);
+        }
+
+        if (sweepPath)
+        {
+            BeginSweep(app->stressSweep, sweepPath);
+            app->stressSweep.quitWhenDone = true;
+        }
+        else if (generate)
+        {
+            if (app->stressParams.instanceCount > STRESS_MAX_INSTANCES)
+            {
+                ELOG("--stress-instances %u is over the limit, %u are used", app->stressParams.instanceCount, STRESS_MAX_INSTANCES);
+                app->stressParams.instanceCount = STRESS_MAX_INSTANCES;
+            }
+            Generate(app, app->stressScene, app->stressParams);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+
+#ifndef STRESS_SCENE_FUNC
+#define STRESS_SCENE_FUNC
+
+#include "Globals.h"
+#include "EntityStoreFuncs.h"
+
+// Largest N of the sweep, the uniform ring grows up to it
+#define STRESS_MAX_INSTANCES 65536
+
+struct App;
+
+struct StressSceneParams
+{
+    u32 instanceCount;
+    u32 pointLightCount;
+    bool randomLayout; // grid otherwise
+    bool animate;
+    u32 seed;
+};
+
+// Generated entities and lights on top of the loaded scene, replaced on every Generate
+struct StressScene
+{
+    StressSceneParams params;
+
+    u32 models[4]; // UINT32_MAX until the first Generate loads them
+    bool modelsLoaded;
+
+    std::vector<EntityId> entities;
+    std::vector<vec3> basePositions;
+
+    // transform nodes are reused, the hierarchy never drops them
+    u32 firstNode;
+    u32 nodeCapacity;
+
+    u32 firstLight; // generated point lights are app->lights[firstLight, firstLight + lightBasePositions.size())
+    std::vector<vec3> lightBasePositions;
+    f32 time;
+};
+
+// Every N/M combination is generated, warmed up and measured for a fixed number of frames
+struct StressSweep
+{
+    std::vector<u32> instanceCounts;
+    std::vector<u32> lightCounts;
+    u32 warmupFrames;
+    u32 measuredFrames;
+
+    bool running;
+    bool quitWhenDone;
+    u32 combination;
+    u32 frame;
+    f64 cpuTotal;
+    f64 gpuTotal;
+    f64 frameTotal;
+
+    std::string csvPath;
+    std::string csv;
+};
+
+namespace StressTest
+{
+    void Generate(App* app, StressScene& stress, const StressSceneParams& params);
+
+    void Clear(App* app, StressScene& stress);
+
+    void Animate(App* app, StressScene& stress, f32 deltaTime);
+
+    // Entities the uniform ring can upload in one pass, the scene included. Generate grows the ring past it
+    u32 EntityCapacity(const App* app);
+
+    // Default N/M steps, written to csvPath when the last one is measured
+    void BeginSweep(StressSweep& sweep, const char* csvPath);
+
+    // Call once per frame, after the previous frame was rendered
+    void StepSweep(App* app, StressSweep& sweep);
+
+    // --stress-instances N --stress-lights M --stress-random --stress-animate --stress-seed S --stress-sweep file.csv
+    void ParseCommandLine(App* app, int argc, char** argv);
+}
+
+#endif // !STRESS_SCENE_FUNC
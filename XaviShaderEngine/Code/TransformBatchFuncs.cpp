@@ -0,0 +1,235 @@
+
+#include "TransformBatchFuncs.h"
+#include "BufferSupFuncs.h"
+#include "JobSystemFuncs.h"
+#include "platform.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_BATCH_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX_FMA
+#else
+#define TARGET_AVX_FMA __attribute__((target("avx,fma")))
+#endif
+#endif
+
+// below this many entities the job system costs more than it saves
+#define TRANSFORM_BATCH_PARALLEL_THRESHOLD 4096
+#define TRANSFORM_BATCH_MIN_JOB_BLOCKS 64
+
+namespace TransformBatch
+{
+    void Resize(TransformSoA& soa, u32 count)
+    {
+        u32 paddedCount = (count + TRANSFORM_BATCH_WIDTH - 1) / TRANSFORM_BATCH_WIDTH * TRANSFORM_BATCH_WIDTH;
+        for (u32 e = 0; e < 16; ++e)
+            soa.elements[e].resize(paddedCount, (e % 5 == 0) ? 1.0f : 0.0f);
+        soa.count = count;
+    }
+
+    void SetMatrix(TransformSoA& soa, u32 index, const glm::mat4& matrix)
+    {
+        const f32* values = glm::value_ptr(matrix);
+        for (u32 e = 0; e < 16; ++e)
+            soa.elements[e][index] = values[e];
+    }
+
+    glm::mat4 GetMatrix(const TransformSoA& soa, u32 index)
+    {
+        glm::mat4 matrix;
+        f32* values = glm::value_ptr(matrix);
+        for (u32 e = 0; e < 16; ++e)
+            values[e] = soa.elements[e][index];
+        return matrix;
+    }
+
+    bool HasSimdKernel()
+    {
+#if defined(TRANSFORM_BATCH_SIMD)
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        // the OS has to save the ymm registers too
+        return osxsave && avx && fma && (_xgetbv(0) & 0x6) == 0x6;
+#else
+        return __builtin_cpu_supports("avx") && __builtin_cpu_supports("fma");
+#endif
+#else
+        return false;
+#endif
+    }
+
+    static void WriteRangeScalar(const TransformSoA& soa, const glm::mat4& viewProjection, u8* destination, u32 destinationStride, u32 begin, u32 end)
+    {
+        for (u32 i = begin; i < end; ++i)
+        {
+            glm::mat4 block[2];
+            block[0] = GetMatrix(soa, i);
+            block[1] = viewProjection * block[0];
+            memcpy(destination + (u64)i * destinationStride, block, sizeof(block));
+        }
+    }
+
+#if defined(TRANSFORM_BATCH_SIMD)
+    // begin must be a multiple of TRANSFORM_BATCH_WIDTH
+    TARGET_AVX_FMA static void WriteRangeAvx(const TransformSoA& soa, const glm::mat4& viewProjection, u8* destination, u32 destinationStride, u32 begin, u32 end)
+    {
+        __m256 viewProjectionElements[16];
+        for (u32 k = 0; k < 4; ++k)
+            for (u32 r = 0; r < 4; ++r)
+                viewProjectionElements[k * 4 + r] = _mm256_set1_ps(viewProjection[k][r]);
+
+        for (u32 i = begin; i < end; i += TRANSFORM_BATCH_WIDTH)
+        {
+            alignas(32) f32 world[16][TRANSFORM_BATCH_WIDTH];
+            alignas(32) f32 worldViewProjection[16][TRANSFORM_BATCH_WIDTH];
+
+            __m256 worldElements[16];
+            for (u32 e = 0; e < 16; ++e)
+            {
+                worldElements[e] = _mm256_loadu_ps(&soa.elements[e][i]);
+                _mm256_store_ps(world[e], worldElements[e]);
+            }
+
+            // (VP * W)[c][r] = sum_k VP[k][r] * W[c][k], eight entities per lane
+            for (u32 c = 0; c < 4; ++c)
+            {
+                for (u32 r = 0; r < 4; ++r)
+                {
+                    __m256 sum = _mm256_mul_ps(viewProjectionElements[0 * 4 + r], worldElements[c * 4 + 0]);
+                    sum = _mm256_fmadd_ps(viewProjectionElements[1 * 4 + r], worldElements[c * 4 + 1], sum);
+                    sum = _mm256_fmadd_ps(viewProjectionElements[2 * 4 + r], worldElements[c * 4 + 2], sum);
+                    sum = _mm256_fmadd_ps(viewProjectionElements[3 * 4 + r], worldElements[c * 4 + 3], sum);
+                    _mm256_store_ps(worldViewProjection[c * 4 + r], sum);
+                }
+            }
+
+            // back to one contiguous block per entity, mapped memory is write combined
+            u32 laneCount = glm::min((u32)TRANSFORM_BATCH_WIDTH, end - i);
+            for (u32 lane = 0; lane < laneCount; ++lane)
+            {
+                f32 block[32];
+                for (u32 e = 0; e < 16; ++e)
+                {
+                    block[e] = world[e][lane];
+                    block[16 + e] = worldViewProjection[e][lane];
+                }
+                memcpy(destination + (u64)(i + lane) * destinationStride, block, sizeof(block));
+            }
+        }
+    }
+#endif
+
+    enum Kernel
+    {
+        Kernel_Scalar,
+        Kernel_Simd,
+        Kernel_SimdParallel
+    };
+
+    static void RunKernel(Kernel kernel, const TransformSoA& soa, u32 count, const glm::mat4& viewProjection, u8* destination, u32 destinationStride)
+    {
+        ASSERT(count <= soa.count, "Not enough matrices in the batch");
+
+#if defined(TRANSFORM_BATCH_SIMD)
+        if (kernel == Kernel_Simd)
+        {
+            WriteRangeAvx(soa, viewProjection, destination, destinationStride, 0, count);
+            return;
+        }
+        if (kernel == Kernel_SimdParallel)
+        {
+            u32 blockCount = (count + TRANSFORM_BATCH_WIDTH - 1) / TRANSFORM_BATCH_WIDTH;
+            JobSystem::ParallelFor(blockCount, TRANSFORM_BATCH_MIN_JOB_BLOCKS, [&](u32 beginBlock, u32 endBlock)
+            {
+                WriteRangeAvx(soa, viewProjection, destination, destinationStride, beginBlock * TRANSFORM_BATCH_WIDTH, glm::min(endBlock * TRANSFORM_BATCH_WIDTH, count));
+            });
+            return;
+        }
+#endif
+        WriteRangeScalar(soa, viewProjection, destination, destinationStride, 0, count);
+    }
+
+    void WriteWorldViewProjection(const TransformSoA& soa, u32 count, const glm::mat4& viewProjection, u8* destination, u32 destinationStride)
+    {
+        static const bool hasSimdKernel = HasSimdKernel();
+
+        Kernel kernel = Kernel_Scalar;
+        if (hasSimdKernel)
+            kernel = count >= TRANSFORM_BATCH_PARALLEL_THRESHOLD ? Kernel_SimdParallel : Kernel_Simd;
+
+        RunKernel(kernel, soa, count, viewProjection, destination, destinationStride);
+    }
+
+    std::string RunBenchmark(u32 uniformBlockAlignment)
+    {
+        const u32 entityCounts[] = { 10000, 100000, 1000000 };
+        const u32 repetitions = 5;
+        const u32 stride = BufferManager::Align(2 * sizeof(glm::mat4), uniformBlockAlignment);
+
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+        glm::mat4 view = glm::lookAt(vec3(9.0f, 2.0f, 15.0f), vec3(0.0f), vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 viewProjection = projection * view;
+
+        std::string report;
+        char line[256];
+        sprintf(line, "stride %u bytes, %u workers, %s\n", stride, JobSystem::WorkerCount(), HasSimdKernel() ? "AVX/FMA" : "no AVX/FMA, SIMD rows use the scalar kernel");
+        report += line;
+
+        for (u32 c = 0; c < ARRAY_COUNT(entityCounts); ++c)
+        {
+            const u32 count = entityCounts[c];
+
+            TransformSoA soa = {};
+            Resize(soa, count);
+            for (u32 i = 0; i < count; ++i)
+            {
+                vec3 position = vec3((f32)(i % 100), (f32)((i / 100) % 100), (f32)(i / 10000)) * 2.0f;
+                SetMatrix(soa, i, glm::scale(glm::translate(position), vec3(0.5f + (i % 3) * 0.25f)));
+            }
+
+            u8* destination = (u8*)malloc((u64)count * stride);
+
+            // best of a few runs of each variant
+            f64 bestTimes[4] = { 1e30, 1e30, 1e30, 1e30 };
+            for (u32 r = 0; r < repetitions; ++r)
+            {
+                // what UpdateEntityBuffer did: two matrix products and two pushes per entity
+                f64 start = glfwGetTime();
+                Buffer buffer = {};
+                buffer.data = destination;
+                for (u32 i = 0; i < count; ++i)
+                {
+                    glm::mat4 world = GetMatrix(soa, i);
+                    glm::mat4 WVP = projection * view * world;
+                    BufferManager::AlignHead(buffer, uniformBlockAlignment);
+                    PushMat4(buffer, world);
+                    PushMat4(buffer, WVP);
+                }
+                bestTimes[0] = glm::min(bestTimes[0], glfwGetTime() - start);
+
+                Kernel kernels[3] = { Kernel_Scalar, Kernel_Simd, Kernel_SimdParallel };
+                for (u32 k = 0; k < 3; ++k)
+                {
+                    start = glfwGetTime();
+                    RunKernel(HasSimdKernel() ? kernels[k] : Kernel_Scalar, soa, count, viewProjection, destination, stride);
+                    bestTimes[k + 1] = glm::min(bestTimes[k + 1], glfwGetTime() - start);
+                }
+            }
+
+            free(destination);
+
+            sprintf(line, "%7u entities: loop %.3f ms | hoisted %.3f ms | simd %.3f ms | simd+jobs %.3f ms\n",
+                count, bestTimes[0] * 1000.0, bestTimes[1] * 1000.0, bestTimes[2] * 1000.0, bestTimes[3] * 1000.0);
+            report += line;
+        }
+
+        ILOG("Transform batch benchmark\n%s", report.c_str());
+        return report;
+    }
+}
@@ -0,0 +1,35 @@
+
+#ifndef TRANSFORM_BATCH_FUNC
+#define TRANSFORM_BATCH_FUNC
+
+#include "Globals.h"
+
+#define TRANSFORM_BATCH_WIDTH 8
+
+// World matrices split per element, elements[c * 4 + r][i] is world[c][r] of entity i.
+// The arrays are padded to TRANSFORM_BATCH_WIDTH so the kernel never reads past the end.
+struct TransformSoA
+{
+    std::vector<f32> elements[16];
+    u32 count;
+};
+
+namespace TransformBatch
+{
+    void Resize(TransformSoA& soa, u32 count);
+
+    void SetMatrix(TransformSoA& soa, u32 index, const glm::mat4& matrix);
+
+    glm::mat4 GetMatrix(const TransformSoA& soa, u32 index);
+
+    bool HasSimdKernel();
+
+    // Writes { world, viewProjection * world } of the first count matrices, one block every
+    // destinationStride bytes, so the stride must already respect the uniform block alignment
+    void WriteWorldViewProjection(const TransformSoA& soa, u32 count, const glm::mat4& viewProjection, u8* destination, u32 destinationStride);
+
+    // Times the old per-entity loop against the batched kernels for 10k, 100k and 1M entities
+    std::string RunBenchmark(u32 uniformBlockAlignment);
+}
+
+#endif // !TRANSFORM_BATCH_FUNC
@@ -0,0 +1,199 @@
+
+#include "WaterMaskFuncs.h"
+#include "GLStateFuncs.h"
+#include "platform.h"
+
+#include <algorithm>
+
+namespace WaterMask
+{
+    static f32 Cross(const vec2& o, const vec2& a, const vec2& b)
+    {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    }
+
+    // Monotone chain, counterclockwise without collinear points
+    static u32 ConvexHull(vec2* points, u32 count, vec2* hull)
+    {
+        std::sort(points, points + count, [](const vec2& a, const vec2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+        vec2 chain[2 * WATER_MASK_MAX_CORNERS];
+        u32 size = 0;
+        for (u32 i = 0; i < count; ++i)
+        {
+            while (size >= 2 && Cross(chain[size - 2], chain[size - 1], points[i]) <= 1e-7f)
+                --size;
+            chain[size++] = points[i];
+        }
+        for (i32 i = (i32)count - 2, lower = size + 1; i >= 0; --i)
+        {
+            while ((i32)size >= lower && Cross(chain[size - 2], chain[size - 1], points[i]) <= 1e-7f)
+                --size;
+            chain[size++] = points[i];
+        }
+
+        // the last point closes the chain on the first
+        u32 hullCount = size > 1 ? size - 1 : size;
+        ASSERT(hullCount <= WATER_MASK_MAX_CORNERS, "The hull of a box has at most 8 corners");
+        memcpy(hull, chain, hullCount * sizeof(vec2));
+        return hullCount;
+    }
+
+    // Every edge moved out by margin, the corners where the moved edges meet
+    static void GrowOutline(vec2* outline, u32 count, f32 margin)
+    {
+        vec2 normals[WATER_MASK_MAX_CORNERS];
+        f32 offsets[WATER_MASK_MAX_CORNERS];
+        for (u32 i = 0; i < count; ++i)
+        {
+            vec2 edge = outline[(i + 1) % count] - outline[i];
+            normals[i] = glm::normalize(vec2(edge.y, -edge.x));
+            offsets[i] = glm::dot(normals[i], outline[i]) + margin;
+        }
+
+        for (u32 i = 0; i < count; ++i)
+        {
+            u32 previous = (i + count - 1) % count;
+            const vec2& a = normals[previous];
+            const vec2& b = normals[i];
+            f32 determinant = a.x * b.y - a.y * b.x;
+            outline[i] = vec2(offsets[previous] * b.y - offsets[i] * a.y, a.x * offsets[i] - b.x * offsets[previous]) / determinant;
+        }
+    }
+
+    WaterScreenArea Project(const glm::mat4& worldToClip, const vec3& boxMin, const vec3& boxMax, f32 margin)
+    {
+        WaterScreenArea area = {};
+
+        vec4 corners[8];
+        for (u32 i = 0; i < 8; ++i)
+        {
+            vec3 corner((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+            corners[i] = worldToClip * vec4(corner, 1.0f);
+        }
+
+        // off screen when every corner is out past the same plane of the frustum
+        for (u32 axis = 0; axis < 3; ++axis)
+        {
+            for (f32 side = -1.0f; side <= 1.0f; side += 2.0f)
+            {
+                u32 outside = 0;
+                for (u32 i = 0; i < 8; ++i)
+                    if (corners[i][axis] * side > corners[i].w)
+                        ++outside;
+                if (outside == 8)
+                    return area;
+            }
+        }
+
+        // the corners in front of the camera and where the edges cross to behind it
+        const f32 minW = 1e-4f;
+        vec2 points[8 + 12];
+        u32 pointCount = 0;
+        u32 behind = 0;
+        for (u32 i = 0; i < 8; ++i)
+        {
+            if (corners[i].w > minW)
+                points[pointCount++] = vec2(corners[i]) / corners[i].w * 0.5f + 0.5f;
+            else
+                ++behind;
+
+            for (u32 bit = 1; bit < 8; bit <<= 1)
+            {
+                u32 j = i | bit;
+                if (j == i || (corners[i].w > minW) == (corners[j].w > minW))
+                    continue;
+                vec4 crossing = glm::mix(corners[i], corners[j], (minW - corners[i].w) / (corners[j].w - corners[i].w));
+                points[pointCount++] = vec2(crossing) / minW * 0.5f + 0.5f;
+            }
+        }
+        if (pointCount == 0)
+            return area;
+
+        if (behind == 0)
+        {
+            area.outlineCount = ConvexHull(points, pointCount, area.outline);
+            if (area.outlineCount >= 3)
+                GrowOutline(area.outline, area.outlineCount, margin);
+            else
+                area.outlineCount = 0;
+        }
+
+        vec2 boundsMin = points[0];
+        vec2 boundsMax = points[0];
+        for (u32 i = 1; i < pointCount; ++i)
+        {
+            boundsMin = glm::min(boundsMin, points[i]);
+            boundsMax = glm::max(boundsMax, points[i]);
+        }
+        for (u32 i = 0; i < area.outlineCount; ++i)
+        {
+            boundsMin = glm::min(boundsMin, area.outline[i]);
+            boundsMax = glm::max(boundsMax, area.outline[i]);
+        }
+
+        area.uvMin = glm::clamp(boundsMin - margin, vec2(0.0f), vec2(1.0f));
+        area.uvMax = glm::clamp(boundsMax + margin, vec2(0.0f), vec2(1.0f));
+        area.visible = area.uvMin.x < area.uvMax.x && area.uvMin.y < area.uvMax.y;
+        return area;
+    }
+
+    f32 Coverage(const WaterScreenArea& area)
+    {
+        return area.visible ? (area.uvMax.x - area.uvMin.x) * (area.uvMax.y - area.uvMin.y) : 0.0f;
+    }
+
+    void BeginScissor(const WaterScreenArea& area, ivec2 targetSize)
+    {
+        ivec2 pixelMin = ivec2(glm::floor(area.uvMin * vec2(targetSize)));
+        ivec2 pixelMax = ivec2(glm::ceil(area.uvMax * vec2(targetSize)));
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(pixelMin.x, pixelMin.y, pixelMax.x - pixelMin.x, pixelMax.y - pixelMin.y);
+    }
+
+    void EndScissor()
+    {
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    bool WriteStencil(const WaterScreenArea& area, GLuint maskProgram, GLuint vao)
+    {
+        if (area.outlineCount == 0)
+            return false;
+
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+
+        // a fan of the outline corners from gl_VertexID, the bound vao only satisfies the core profile
+        GLState::UseProgram(maskProgram);
+        glUniform2fv(glGetUniformLocation(maskProgram, "uCorners"), area.outlineCount, &area.outline[0].x);
+        GLState::BindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, area.outlineCount);
+        GLState::BindVertexArray(0);
+
+        glDisable(GL_STENCIL_TEST);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        return true;
+    }
+
+    void BeginStencilTest()
+    {
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_EQUAL, 1, 0xFF);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    }
+
+    void EndStencilTest()
+    {
+        glDisable(GL_STENCIL_TEST);
+    }
+}
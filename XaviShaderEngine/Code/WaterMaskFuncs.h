@@ -0,0 +1,44 @@
+
+#ifndef WATER_MASK_FUNC
+#define WATER_MASK_FUNC
+
+#include "Globals.h"
+
+// Corners of a box, the most its convex outline on screen can have
+#define WATER_MASK_MAX_CORNERS 8
+
+// Texture coordinates the water reaches in one view, grown by the distortion of its lookups
+struct WaterScreenArea
+{
+    bool visible;
+    vec2 uvMin;
+    vec2 uvMax;
+
+    // counterclockwise outline, only while the whole box is in front of the camera. Empty otherwise and the
+    // rectangle alone bounds the water
+    vec2 outline[WATER_MASK_MAX_CORNERS];
+    u32 outlineCount;
+};
+
+namespace WaterMask
+{
+    // Bounds of the world box through worldToClip, margin in texture coordinates
+    WaterScreenArea Project(const glm::mat4& worldToClip, const vec3& boxMin, const vec3& boxMax, f32 margin);
+
+    // Share of the target inside the rectangle
+    f32 Coverage(const WaterScreenArea& area);
+
+    // Scissor to the rectangle in pixels of a target of that size, until EndScissor
+    void BeginScissor(const WaterScreenArea& area, ivec2 targetSize);
+    void EndScissor();
+
+    // Sets the stencil of the bound target to 1 inside the outline and 0 around it, the color and depth are kept.
+    // False when there is no outline, the target then stays unmasked
+    bool WriteStencil(const WaterScreenArea& area, GLuint maskProgram, GLuint vao);
+
+    // Draws only where WriteStencil marked, until EndStencilTest
+    void BeginStencilTest();
+    void EndStencilTest();
+}
+
+#endif // !WATER_MASK_FUNC
@@ -12,7 +12,7 @@
 #include "Globals.h"
 #include <glm/glm.hpp>
 
-#include <random>
+#include <thread>
 
 GLuint CreateProgramFromSource(String programSource, const char* shaderName)
 {
@@ -26,28 +26,34 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     sprintf(shaderNameDefine, "#define %s\n", shaderName);
     char vertexShaderDefine[] = "#define VERTEX\n";
     char fragmentShaderDefine[] = "#define FRAGMENT\n";
+    // the G-buffer layout is chosen at build time, the shaders that write or read it branch on this
+    const char* layoutDefine = COMPACT_GBUFFER ? "#define COMPACT_GBUFFER\n" : "";
 
     const GLchar* vertexShaderSource[] = {
 	    versionString,
 	    shaderNameDefine,
+	    layoutDefine,
 	    vertexShaderDefine,
 	    programSource.str
     };
     const GLint vertexShaderLengths[] = {
 	    (GLint)strlen(versionString),
 	    (GLint)strlen(shaderNameDefine),
+	    (GLint)strlen(layoutDefine),
 	    (GLint)strlen(vertexShaderDefine),
 	    (GLint)programSource.len
     };
     const GLchar* fragmentShaderSource[] = {
 	    versionString,
 	    shaderNameDefine,
+	    layoutDefine,
 	    fragmentShaderDefine,
 	    programSource.str
     };
     const GLint fragmentShaderLengths[] = {
 	    (GLint)strlen(versionString),
 	    (GLint)strlen(shaderNameDefine),
+	    (GLint)strlen(layoutDefine),
 	    (GLint)strlen(fragmentShaderDefine),
 	    (GLint)programSource.len
     };
@@ -83,7 +89,7 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
         ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
     }
 
-    glUseProgram(0);
+    GLState::UseProgram(0);
 
     glDetachShader(programHandle, vshader);
     glDetachShader(programHandle, fshader);
@@ -119,8 +125,12 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
             &type,
             name);
 
-        u8 location = glGetAttribLocation(program.handle, name);
-        program.shaderLayout.attributes.push_back(VertexShaderAttribute{ location, (u8)size });
+        // built-in inputs such as gl_InstanceID are listed too, but have no location
+        GLint location = glGetAttribLocation(program.handle, name);
+        if (location < 0)
+            continue;
+
+        program.shaderLayout.attributes.push_back(VertexShaderAttribute{ (u8)location, (u8)size });
     }
 
     app->programs.push_back(program);
@@ -128,6 +138,72 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
     return app->programs.size() - 1;
 }
 
+GLuint CreateComputeProgramFromSource(String programSource, const char* shaderName)
+{
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    char versionString[] = "#version 430\n";
+    char shaderNameDefine[128];
+    sprintf(shaderNameDefine, "#define %s\n", shaderName);
+    char computeShaderDefine[] = "#define COMPUTE\n";
+
+    const GLchar* computeShaderSource[] = {
+        versionString,
+        shaderNameDefine,
+        computeShaderDefine,
+        programSource.str
+    };
+    const GLint computeShaderLengths[] = {
+        (GLint)strlen(versionString),
+        (GLint)strlen(shaderNameDefine),
+        (GLint)strlen(computeShaderDefine),
+        (GLint)programSource.len
+    };
+
+    GLuint cshader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(cshader, ARRAY_COUNT(computeShaderSource), computeShaderSource, computeShaderLengths);
+    glCompileShader(cshader);
+    glGetShaderiv(cshader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(cshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with compute shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    GLuint programHandle = glCreateProgram();
+    glAttachShader(programHandle, cshader);
+    glLinkProgram(programHandle);
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    glDetachShader(programHandle, cshader);
+    glDeleteShader(cshader);
+
+    return programHandle;
+}
+
+u32 LoadComputeProgram(App* app, const char* filepath, const char* programName)
+{
+    String programSource = ReadTextFile(filepath);
+
+    Program program = {};
+    program.handle = CreateComputeProgramFromSource(programSource, programName);
+    program.filepath = filepath;
+    program.programName = programName;
+    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+
+    app->programs.push_back(program);
+
+    return app->programs.size() - 1;
+}
+
 GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
 {
     GLuint ReturnValue = 0;
@@ -145,7 +221,7 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
     if (ReturnValue == 0)
     {
         glGenVertexArrays(1, &ReturnValue);
-        glBindVertexArray(ReturnValue);
+        GLState::BindVertexArray(ReturnValue);
 
         glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
@@ -173,7 +249,7 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
             }
             assert(attributeWasLinked);
         }
-        glBindVertexArray(0);
+        GLState::BindVertexArray(0);
 
         VAO vao = { ReturnValue, program.handle };
         Submesh.vaos.push_back(vao);
@@ -193,6 +269,45 @@ glm::mat4 TransformPositionScale(const vec3& pos, const vec3& scaleFactors)
     returnVal = glm::scale(returnVal, scaleFactors);
     return returnVal;
 }
+
+glm::mat4 CameraView(const App::Camera& camera)
+{
+    vec3 xCam = glm::cross(camera.front, vec3(0, 1, 0));
+    vec3 yCam = glm::cross(xCam, camera.front);
+    return glm::lookAt(camera.position, camera.target, yCam);
+}
+
+// With a clip plane the near plane is moved onto it (Lengyel's oblique frustum), everything on its back side is
+// clipped for free and the far plane tilts to keep the depth range
+glm::mat4 CameraProjection(const App::Camera& camera)
+{
+    glm::mat4 projection = glm::perspective(camera.fovYRad, camera.aspRatio, camera.zNear, camera.zFar);
+    if (camera.clipPlane == vec4(0.0f))
+        return projection;
+
+    vec4 plane = glm::transpose(glm::inverse(CameraView(camera))) * camera.clipPlane;
+    // a camera on the kept side would look at the back of its own near plane
+    if (plane.w >= 0.0f)
+        return projection;
+
+    vec4 corner;
+    corner.x = (glm::sign(plane.x) + projection[2][0]) / projection[0][0];
+    corner.y = (glm::sign(plane.y) + projection[2][1]) / projection[1][1];
+    corner.z = -1.0f;
+    corner.w = (1.0f + projection[2][2]) / projection[3][2];
+
+    vec4 nearRow = plane * (2.0f / glm::dot(plane, corner));
+    projection[0][2] = nearRow.x;
+    projection[1][2] = nearRow.y;
+    projection[2][2] = nearRow.z + 1.0f;
+    projection[3][2] = nearRow.w;
+    return projection;
+}
+
+glm::mat4 CameraViewProjection(const App::Camera& camera)
+{
+    return CameraProjection(camera) * CameraView(camera);
+}
 void Init(App* app)
 {
     // TODO: Initialize your resources here!
@@ -202,6 +317,9 @@ void Init(App* app)
     // - programs (and retrieve uniform indices)
     // - textures
 
+    // the main thread takes part in every job too
+    JobSystem::Init(glm::max(std::thread::hardware_concurrency(), 2u) - 1);
+
     //Get OPENGL info.
     app->openglDebugInfo += "OpeGL version:\n" + std::string(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
 
@@ -220,7 +338,7 @@ void Init(App* app)
     //VAO
 
     glGenVertexArrays(1, &app->vao);
-    glBindVertexArray(app->vao);
+    GLState::BindVertexArray(app->vao);
     glBindBuffer(GL_ARRAY_BUFFER, app->embeddedVertices);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)0);
     glEnableVertexAttribArray(0);
@@ -228,25 +346,29 @@ void Init(App* app)
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(VertexV3V2), (void*)sizeof(glm::vec3));
     glEnableVertexAttribArray(1);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    // Water Textures
-    app->ConfigureSingleFrameBuffer(app->waterReflectionDefferedFrameBuffer);
-    app->ConfigureSingleFrameBuffer(app->waterRefractionDefferedFrameBuffer);
-    app->ConfigureSingleFrameBuffer(app->waterFrameBuffer);
-
     //app->waterNormalMap = ModelLoader::LoadTexture2D(app, "normalmap.png");
     app->waterDudvMap = ModelLoader::LoadTexture2D(app, "dudvmap.png");
 
     app->renderToBackBuffer = LoadProgram(app, "RENDER_TO_BB.glsl", "RENDER_TO_BB");
     app->renderToFrameBuffer = LoadProgram(app, "RENDER_TO_FB.glsl", "RENDER_TO_FB");
     app->frameBufferToQuadShader = LoadProgram(app, "FB_TO_BB.glsl", "FB_TO_BB");
+    app->ssaoDownsampleShader = LoadProgram(app, "SSAODownsample.glsl", "SSAODownsample");
     app->ssaoShader = LoadProgram(app, "SSAO.glsl", "SSAO");
     app->ssaoBlurShader = LoadProgram(app, "Blur.glsl", "Blur");
+    app->ssaoUpsampleShader = LoadProgram(app, "SSAOUpsample.glsl", "SSAOUpsample");
     app->frameBufferToQuadShaderSSAO = LoadProgram(app, "FB_TO_BB_SSAO.glsl", "FB_TO_BB_SSAO");
     app->waterShader = LoadProgram(app, "WaterEffect.glsl", "WaterEffect");
+    app->renderToFrameBufferIndirect = LoadProgram(app, "RENDER_TO_FB_INDIRECT.glsl", "RENDER_TO_FB_INDIRECT");
+    app->hiZBuildShader = LoadComputeProgram(app, "HiZBuild.glsl", "HIZ_BUILD");
+    app->hiZCullShader = LoadComputeProgram(app, "HiZCull.glsl", "HIZ_CULL");
+    app->lightClusterShader = LoadComputeProgram(app, "LightClusters.glsl", "LIGHT_CLUSTERS");
+    app->lightVolumeShader = LoadProgram(app, "LIGHT_VOLUME.glsl", "LIGHT_VOLUME");
+    app->shadowDepthShader = LoadProgram(app, "SHADOW_DEPTH.glsl", "SHADOW_DEPTH");
+    app->waterMaskShader = LoadProgram(app, "WaterMask.glsl", "WATER_MASK");
 
     const Program& texturedMeshProgram = app->programs[app->renderToBackBuffer];
     app->texturedMeshProgram_uTexture = glGetUniformLocation(texturedMeshProgram.handle, "uTexture");
@@ -255,20 +377,14 @@ void Init(App* app)
     //u32 GroundModelindex = ModelLoader::LoadModel(app, "Patrick/ground.obj");
     //u32 HouseModelindex = ModelLoader::LoadModel(app, "Assets/hut.obj");
     //u32 BookShelfindex = ModelLoader::LoadModel(app, "Assets/light_oak_bookshelf.obj");
-    u32 houseShelfindex = ModelLoader::LoadModel(app, "Assets/world.obj");
-    u32 lakeindex = ModelLoader::LoadModel(app, "Assets/Lake.obj");
-    u32 waterindex = ModelLoader::LoadModel(app, "Assets/WaterPlane.obj");
-
-    u32 SphereModelindex = ModelLoader::LoadModel(app, "Patrick/Sphere.obj");
-    u32 ConeModelindex = ModelLoader::LoadModel(app, "Patrick/Cone.obj");
-
     glEnable(GL_DEPTH_TEST);////////////////////////////////////////////////////////////////// PARA PROFUNDIIDAD
     glEnable(GL_CULL_FACE); // para que no pinte normales si no se ven
 
     glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAlignment);
 
-    app->localUniformBuffer = CreateConstantBuffer(app->maxUniformBufferSize); // crea un uniform buffer
+    // every frame gets its own region, each pass of the frame allocates from it
+    app->localUniformBuffer = BufferManager::CreateRingBuffer(UNIFORM_PASSES_PER_FRAME * app->maxUniformBufferSize, UNIFORM_RING_FRAMES, GL_UNIFORM_BUFFER);
 
     //app->entities.push_back({ TransformPositionScale(vec3(5.0,0.0,-3.0),vec3(1.0,1.0,1.0)), PatrickModelindex,0,0 });
     //app->entities.push_back({ TransformPositionScale(vec3(-5.0,0.0,-3.0),vec3(1.0,1.0,1.0)), PatrickModelindex,0,0 });
@@ -279,30 +395,32 @@ void Init(App* app)
     //app->entities.push_back({ TransformPositionScale(vec3(0.0, -5.0, 0.0), vec3(1.0, 1.0, 1.0)), GroundModelindex,0,0 });
     //app->entities.push_back({ TransformPositionScale(vec3(0.0, 0.0, 0.0), vec3(1.0, 1.0, 1.0)), HouseModelindex,0,0 });
     //app->entities.push_back({ TransformPositionScale(vec3(0.0, 0.0, 0.0), vec3(1.0, 1.0, 1.0)), BookShelfindex,0,0 });
-    app->entities.push_back({ TransformPositionScale(vec3(0.0, 2.0, 0.0), vec3(1.0, 1.0, 1.0)), houseShelfindex,0,0 });
-    app->entities.push_back({ TransformPositionScale(vec3(-45.0, 0.0, 65.0), vec3(1.0, 1.0, 1.0)), lakeindex,0,0 });
-
-    app->lights.push_back({ LightType::LightType_Directional,vec3(1.0,1.0,1.0),vec3(1.0,1.0,1.0),vec3(0.0,5.0,0.0) });
-    app->lights.push_back({ LightType::LightType_Point,vec3(0.0,0.0,3.0),vec3(1.0,1.0,1.0),vec3(10.0,2.0,1.0) });
-    app->lights.push_back({ LightType::LightType_Point,vec3(3.0,0.0,0.0),vec3(1.0,1.0,1.0),vec3(-10.0,2.0,1.0) });
-
-    for (int i = 0; i < app->lights.size(); i++)
-    {
-        if (app->lights[i].type == LightType::LightType_Point)
-            app->entities.push_back({ TransformPositionScale((app->lights[i].position), vec3(0.5, 0.5, 0.5)), SphereModelindex,0,0 });
-        else
-            app->entities.push_back({ TransformPositionScale((app->lights[i].position), (-app->lights[i].direction)), ConeModelindex,0,0 });
-    }
-
-    app->water = { TransformPositionScale(vec3(-45.0, 0.0, 65.0), vec3(1.0, 1.0, 1.0)), waterindex,0,0 };
-    app->entitiesWithWater = app->entities;
-    app->entitiesWithWater.push_back(app->water);
-
-    app->ConfigureFrameBuffer(app->defferedFrameBuffer);
-    app->ConfigureFrameBuffer(app->waterRefractionFrameBuffer);
-    app->ConfigureFrameBuffer(app->waterReflectionFrameBuffer);
-    app->ConfigureSingleFrameBuffer(app->ssaoFrameBuffer);
-    app->ConfigureSingleFrameBuffer(app->ssaoBlurFrameBuffer);
+    // the binary scene is rebuilt whenever the text one is newer or it does not load (older version)
+    bool sceneLoaded = GetFileLastWriteTimestamp(SCENE_TEXT_FILE) <= GetFileLastWriteTimestamp(SCENE_BINARY_FILE) && SceneLoader::LoadScene(app, SCENE_BINARY_FILE);
+    if (!sceneLoaded && SceneLoader::CompileTextScene(SCENE_TEXT_FILE, SCENE_BINARY_FILE))
+        sceneLoaded = SceneLoader::LoadScene(app, SCENE_BINARY_FILE);
+    if (!sceneLoaded)
+        ELOG("Could not load the scene %s", SCENE_BINARY_FILE);
+
+    // every node is dirty yet, this fills all the world matrices
+    app->ApplyTransformChanges();
+
+    RenderTargets::Create(app->renderTargets);
+    app->renderSize = app->displaySize;
+    app->pendingRenderSize = app->displaySize;
+    LightVolumes::Create(app->lightVolumes);
+    app->CreateRenderTargets();
+    // the main G-buffer plus the reflection view
+    app->gBufferReport = GBuffer::BandwidthReport(app->renderSize, 2, COMPACT_GBUFFER);
+
+    OcclusionCulling::Create(app->gpuCulling, app->renderSize);
+    ScreenSpaceReflections::Create(app->reflectionDepth, app->renderSize);
+    ClusteredLighting::Create(app->lightClusters);
+    ShadowCascades::Create(app->shadowMap);
+    PointShadows::Create(app->pointShadows);
+    Ssao::Create(app->ambientOcclusion);
+    Ocean::Create(app->ocean, 256);
+    Ocean::CreateGrid(app->oceanGrid, 0.125f);
 
     app->cam.position = vec3(9.0f, 2.0f, 15.0f);
     app->cam.target = vec3(0.0f, 0.0f, -1.0f);
@@ -315,8 +433,11 @@ void Init(App* app)
     app->firstClick = true;
 
     app->mode = Mode_Deferred;
+}
 
-    app->KernelRotationVectors();
+void Shutdown(App* app)
+{
+    JobSystem::Shutdown();
 }
 
 void Gui(App* app)
@@ -324,6 +445,108 @@ void Gui(App* app)
     ImGui::Begin("Info");
     ImGui::Text("FPS: %f", 1.0f / app->deltaTime);
     ImGui::Text("%s", app->openglDebugInfo.c_str());
+    ImGui::Text("Uniform ring: %s, %u GPU waits", app->localUniformBuffer.persistent ? "persistent" : "unsynchronized maps", app->localUniformBuffer.waitCount);
+    const char* waterViewScales[] = { "Full", "Half", "Quarter" };
+    int waterViewScale = app->waterViewDivisor == 4 ? 2 : app->waterViewDivisor == 2 ? 1 : 0;
+    if (ImGui::Combo("Water view resolution", &waterViewScale, waterViewScales, ARRAY_COUNT(waterViewScales)))
+        app->waterViewDivisor = 1 << waterViewScale;
+    const char* waterReflectionModes[] = { "Screen space", "Planar (high quality)" };
+    ImGui::Combo("Water reflections", (int*)&app->waterReflectionMode, waterReflectionModes, WaterReflection_Count);
+    ImGui::Checkbox("Amortize water views", &app->amortizeWaterViews);
+    ImGui::Checkbox("Restrict water to its screen area", &app->restrictWaterToScreenArea);
+    if (app->restrictWaterToScreenArea)
+        ImGui::Checkbox("Water stencil mask", &app->useWaterStencil);
+    if (!app->waterVisible)
+        ImGui::Text("Water off screen, its views are skipped");
+    else if (app->waterReflectionMode == WaterReflection_Planar)
+        ImGui::Text("Water covers %.0f%%, views every %u frames%s", app->waterCoverage * 100.0f, app->waterViewInterval, app->updateWaterViews ? "" : ", reprojected");
+    ImGui::Checkbox("FFT ocean", &app->useOcean);
+    if (app->useOcean)
+    {
+        const char* oceanResolutions[] = { "128", "256", "512" };
+        int oceanResolution = app->ocean.resolution == 512 ? 2 : app->ocean.resolution == 256 ? 1 : 0;
+        if (ImGui::Combo("Ocean resolution", &oceanResolution, oceanResolutions, ARRAY_COUNT(oceanResolutions)))
+        {
+            Ocean::Destroy(app->ocean);
+            Ocean::Create(app->ocean, OCEAN_MIN_RESOLUTION << oceanResolution);
+        }
+        ImGui::Text("Ocean: solve %.2f ms, upload %.2f ms", app->ocean.solveMs, app->ocean.uploadMs);
+    }
+    if (ImGui::Button("Run ocean benchmark"))
+        app->oceanBenchmarkReport = Ocean::RunBenchmark();
+    if (!app->oceanBenchmarkReport.empty())
+        ImGui::TextUnformatted(app->oceanBenchmarkReport.c_str());
+
+    const GLStateCounters& stateCounters = GLState::LastFrameCounters();
+    if (ImGui::TreeNode("GL state calls (issued / filtered)"))
+    {
+        for (u32 i = 0; i < GLStateCall_Count; ++i)
+            ImGui::Text("%s: %u / %u", GLState::CallName((GLStateCall)i), stateCounters.issued[i], stateCounters.filtered[i]);
+        ImGui::TreePop();
+    }
+    if (ImGui::Button("Run transform benchmark"))
+        app->transformBenchmarkReport = TransformBatch::RunBenchmark(app->uniformBlockAlignment);
+    if (!app->transformBenchmarkReport.empty())
+        ImGui::TextUnformatted(app->transformBenchmarkReport.c_str());
+    if (ImGui::TreeNode("G-buffer bandwidth"))
+    {
+        ImGui::TextUnformatted(app->gBufferReport.c_str());
+        ImGui::TextUnformatted(Ssao::Report(app->ambientOcclusion, app->renderSize, COMPACT_GBUFFER).c_str());
+        ImGui::TreePop();
+    }
+    if (ImGui::TreeNode("Render targets"))
+    {
+        const RenderTargetPool& pool = app->renderTargets;
+        ImGui::Text("Size: %dx%d (window %dx%d)", app->renderSize.x, app->renderSize.y, app->displaySize.x, app->displaySize.y);
+        ImGui::Text("Held: %.1f MB in %u textures, in use: %.1f MB", pool.bytesHeld / (1024.0 * 1024.0), (u32)pool.targets.size(), pool.bytesInUse / (1024.0 * 1024.0));
+        ImGui::Text("Created: %u, freed: %u", pool.createdCount, pool.freedCount);
+        ImGui::TreePop();
+    }
+    if (app->mode == Mode_Deferred && ImGui::TreeNode("Frame graph"))
+    {
+        const RenderGraph& graph = app->frameGraph;
+        ImGui::Text("Passes: %u run, %u culled", (u32)graph.passes.size() - graph.culledCount, graph.culledCount);
+        ImGui::Text("Transient textures: %u, %u aliased, %.1f MB instead of %.1f MB", graph.transientCount, graph.aliasedCount,
+            graph.transientBytes / (1024.0 * 1024.0), graph.unaliasedBytes / (1024.0 * 1024.0));
+        for (u32 i = 0; i < graph.passes.size(); ++i)
+            ImGui::Text("%s%s", graph.passes[i].name, graph.passes[i].culled ? " (culled)" : "");
+        ImGui::TreePop();
+    }
+    if (ImGui::Button("Run entity store benchmark"))
+        app->entityBenchmarkReport = Entities::RunBenchmark();
+    if (!app->entityBenchmarkReport.empty())
+        ImGui::TextUnformatted(app->entityBenchmarkReport.c_str());
+
+    if (ImGui::TreeNode("GPU timings"))
+    {
+        for (u32 i = 0; i < app->gpuTimers.scopes.size(); ++i)
+            ImGui::Text("%*s%s: %.3f ms", app->gpuTimers.scopes[i].depth * 2, "", app->gpuTimers.scopes[i].name, app->gpuTimers.scopes[i].milliseconds);
+        ImGui::Text("CPU frame: %.3f ms", app->cpuFrameMs);
+        ImGui::Text("Water with screen space reflections: %.3f ms, planar: %.3f ms", app->waterReflectionMs[WaterReflection_ScreenSpace], app->waterReflectionMs[WaterReflection_Planar]);
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("Stress scene"))
+    {
+        ImGui::InputScalar("Instances", ImGuiDataType_U32, &app->stressParams.instanceCount);
+        ImGui::InputScalar("Point lights", ImGuiDataType_U32, &app->stressParams.pointLightCount);
+        ImGui::InputScalar("Seed", ImGuiDataType_U32, &app->stressParams.seed);
+        ImGui::Checkbox("Random layout", &app->stressParams.randomLayout);
+        ImGui::Checkbox("Animate", &app->stressParams.animate);
+        ImGui::Text("Uniform ring fits %u entities (grows up to %u instances), forward shading %u lights", StressTest::EntityCapacity(app), STRESS_MAX_INSTANCES, MAX_SHADER_LIGHTS);
+        ImGui::Text("Clustered lights: %u directional, %u binned", app->lightClusters.directionalCount, app->lightClusters.lightCount - app->lightClusters.directionalCount);
+        if (ImGui::Button("Generate"))
+            StressTest::Generate(app, app->stressScene, app->stressParams);
+        ImGui::SameLine();
+        if (ImGui::Button("Clear"))
+            StressTest::Clear(app, app->stressScene);
+
+        if (app->stressSweep.running)
+            ImGui::Text("Sweeping %u / %u", app->stressSweep.combination + 1, (u32)(app->stressSweep.instanceCounts.size() * app->stressSweep.lightCounts.size()));
+        else if (ImGui::Button("Run sweep to stress_sweep.csv"))
+            StressTest::BeginSweep(app->stressSweep, "stress_sweep.csv");
+        ImGui::TreePop();
+    }
 
     const char* renderModes[] = { "FORWARD","DEFERRED" };
     if (ImGui::BeginCombo("Render Mode", renderModes[app->mode]))
@@ -341,7 +564,7 @@ void Gui(App* app)
     }
     if (app->mode == Mode::Mode_Deferred)
     {
-        const char* renderBuffers[] = { "MAIN","REFRACTION","REFLECTION"};
+        const char* renderBuffers[] = { "MAIN","REFLECTION"};
         if (ImGui::BeginCombo("Render Buffer", renderBuffers[app->renderBuffers]))
         {
             for (size_t i = 0; i < ARRAY_COUNT(renderBuffers); ++i)
@@ -358,31 +581,59 @@ void Gui(App* app)
         if (app->renderBuffers == 0)
         {
             ImGui::Checkbox("Use SSAO", &app->displaySSAO);
-            ImGui::SliderFloat("Sample Radius", &app->sampleRadius, 0.0f, 100.0f);
-            ImGui::SliderFloat("SSAO Bias", &app->ssaoBias, 0.0f, 100.0f);
+            ImGui::Checkbox("GPU Occlusion Culling", &app->useGpuCulling);
+            ImGui::Checkbox("Stencil light volumes", &app->useLightVolumes);
+            ImGui::Checkbox("Shadows", &app->useShadows);
+            if (app->useShadows)
+            {
+                int budget = app->shadowMap.updateBudget;
+                if (ImGui::SliderInt("Cascade updates per frame", &budget, 1, SHADOW_CASCADE_COUNT))
+                    app->shadowMap.updateBudget = budget;
+                ImGui::SliderFloat("Shadow distance", &app->shadowMap.shadowDistance, 20.0f, 500.0f);
+                ImGui::Text("Cascades rendered last frame: %c%c%c%c",
+                    app->shadowMap.updatedMask & 1 ? '0' : '-', app->shadowMap.updatedMask & 2 ? '1' : '-', app->shadowMap.updatedMask & 4 ? '2' : '-', app->shadowMap.updatedMask & 8 ? '3' : '-');
+                ImGui::Checkbox("Point light shadows", &app->usePointShadows);
+                if (app->usePointShadows)
+                {
+                    int lightBudget = app->pointShadows.updateBudget;
+                    if (ImGui::SliderInt("Point lights rendered per frame", &lightBudget, 1, 32))
+                        app->pointShadows.updateBudget = lightBudget;
+                    ImGui::Text("Point lights with tiles: %u, rendered last frame: %u", app->pointShadows.shadowedCount, app->pointShadows.updatedCount);
+                }
+            }
+            if (app->displaySSAO)
+            {
+                AmbientOcclusion& ao = app->ambientOcclusion;
+                const char* qualities[] = { "8 samples", "16 samples", "32 samples", "64 samples" };
+                int quality = ao.quality;
+                if (ImGui::Combo("SSAO quality", &quality, qualities, ARRAY_COUNT(qualities)))
+                    ao.quality = (SsaoQuality)quality;
+                ImGui::Checkbox("Half resolution SSAO", &ao.halfResolution);
+                ImGui::SliderFloat("Sample Radius", &ao.sampleRadius, 0.0f, 100.0f);
+                ImGui::SliderFloat("SSAO Bias", &ao.bias, 0.0f, 100.0f);
+            }
             const char* modes[] = { "Albedo", "Normals", "Position", "ViewDir", "Depth" };
             for (size_t i = 0; i < app->defferedFrameBuffer.colorAttachment.size(); i++)
             {
                 ImGui::Text(modes[i]);
                 ImGui::Image((ImTextureID)app->defferedFrameBuffer.colorAttachment[i], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
             }
-            ImGui::Text("Ambient Occlusion");
-            ImGui::Image((ImTextureID)app->ssaoFrameBuffer.colorAttachment[0], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
-            ImGui::Text("Ambient Occlusion with Blur");
-            ImGui::Image((ImTextureID)app->ssaoBlurFrameBuffer.colorAttachment[0], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
-            ImGui::Text("WaterTexture");
-            ImGui::Image((ImTextureID)app->waterFrameBuffer.colorAttachment[0], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
-        }
-        else if (app->renderBuffers == 1)
-        {
-            const char* modes[] = { "Albedo", "Normals", "Position", "ViewDir", "Depth" };
-            for (size_t i = 0; i < app->waterRefractionFrameBuffer.colorAttachment.size(); i++)
+            // frame graph transients share textures unless they are kept for this
+            ImGui::Checkbox("Inspect transient targets", &app->inspectTransientTargets);
+            if (app->inspectTransientTargets)
             {
-                ImGui::Text(modes[i]);
-                ImGui::Image((ImTextureID)app->waterRefractionFrameBuffer.colorAttachment[i], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
+                ImGui::Text("Ambient Occlusion");
+                ImGui::Image((ImTextureID)FrameGraph::Texture(app->frameGraph, "AO"), ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
+                ImGui::Text("Ambient Occlusion with Blur");
+                ImGui::Image((ImTextureID)FrameGraph::Texture(app->frameGraph, "Blurred AO"), ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
+                if (app->ambientOcclusion.halfResolution)
+                {
+                    ImGui::Text("Ambient Occlusion upsampled");
+                    ImGui::Image((ImTextureID)FrameGraph::Texture(app->frameGraph, "Upsampled AO"), ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
+                }
+                ImGui::Text("Scene color, what the water refracts");
+                ImGui::Image((ImTextureID)FrameGraph::Texture(app->frameGraph, "Scene color"), ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
             }
-            ImGui::Text("Deffered Refraction");
-            ImGui::Image((ImTextureID)app->waterRefractionDefferedFrameBuffer.colorAttachment[0], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
         }
         else
         {
@@ -393,7 +644,7 @@ void Gui(App* app)
                 ImGui::Image((ImTextureID)app->waterReflectionFrameBuffer.colorAttachment[i], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
             }
             ImGui::Text("Deffered Reflection");
-            ImGui::Image((ImTextureID)app->waterReflectionDefferedFrameBuffer.colorAttachment[0], ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
+            ImGui::Image((ImTextureID)app->reflectionLitView, ImVec2(300, 150), ImVec2(0, 1), ImVec2(1, 0));
         }
     }
     
@@ -402,6 +653,8 @@ void Gui(App* app)
 
 void Update(App* app)
 {
+    app->cpuFrameStart = glfwGetTime();
+
     // You can handle app->input keyboard/mouse here
     bool movingCam = false;
     float sensivity = 1.4f;
@@ -436,6 +689,10 @@ void Update(App* app)
     app->cam.up = normalize(cross(app->cam.front, app->cam.right));
     app->cam.target = app->cam.position + app->cam.front;
 
+    // every projection of the frame is built from these, the reflection camera copies them
+    app->cam.aspRatio = (float)app->displaySize.x / (float)glm::max(app->displaySize.y, 1);
+    app->cam.fovYRad = glm::radians(60.0f);
+
     app->camInv = app->cam;
     app->camInv.position.y *= -1;
     app->camInv.pitch *= -1;
@@ -450,411 +707,705 @@ void Update(App* app)
     app->camInv.right = normalize(cross(glm::vec3(0.0f, 1.0f, 0.0f), app->camInv.front));
     app->camInv.up = normalize(cross(app->camInv.front, app->camInv.right));
     app->camInv.target = app->camInv.position + app->camInv.front;
+
+    // the reflection view clips at the water plane with the near plane of its projection
+    app->camInv.clipPlane = vec4(0, 1, 0, WATER_CLIP_PLANE_OFFSET);
+
+    StressTest::StepSweep(app, app->stressSweep);
+    StressTest::Animate(app, app->stressScene, app->deltaTime);
+
+    // the spectrum is solved in Render, once it is known whether the water is on screen
+    if (app->useOcean && app->mode == Mode_Deferred)
+        app->iTime += app->deltaTime;
+
+    app->ApplyTransformChanges();
+
+    if (app->cullingBatchesDirty)
+    {
+        app->BuildCullingBatches(app->programs[app->renderToFrameBufferIndirect]);
+        app->cullingBatchesDirty = false;
+
+        // entities came or went, their old bounds are gone
+        ShadowCascades::Invalidate(app->shadowMap);
+        PointShadows::Invalidate(app->pointShadows);
+    }
 }
 
 
 void Render(App* app)
 {
+    GLState::BeginFrame();
+    app->UpdateRenderTargetSize();
+    GpuProfiler::BeginFrame(app->gpuTimers);
+    u32 frameScope = GpuProfiler::Begin(app->gpuTimers, "Frame");
+    BufferManager::BeginRingRegion(app->localUniformBuffer);
+
     switch (app->mode)
     {
     case Mode_Forward:
     {
+        app->BuildDrawList(app->drawList, app->programs[app->renderToBackBuffer]);
         app->UpdateEntityBuffer(&app->cam);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 
-        glClearColor(0.f, 0.f, 0.f, .0f);
+        GLState::ClearColor(0.f, 0.f, 0.f, .0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
-        //glBindFramebuffer(GL_FRAMEBUFFER, app->defferedFrameBuffer.fbHandle);
+        GLState::Viewport(0, 0, app->displaySize.x, app->displaySize.y);
+        //GLState::BindFramebuffer(GL_FRAMEBUFFER, app->defferedFrameBuffer.fbHandle);
 
         const Program& ForwardProgram = app->programs[app->renderToBackBuffer];
-        glUseProgram(ForwardProgram.handle);
+        GLState::UseProgram(ForwardProgram.handle);
+        glUniform3f(glGetUniformLocation(ForwardProgram.handle, "uAttenuation"), LIGHT_ATTENUATION_CONSTANT, LIGHT_ATTENUATION_LINEAR, LIGHT_ATTENUATION_QUADRATIC);
 
-        app->RenderGeometry(ForwardProgram, vec4(0.0f));
+        app->RenderGeometry(ForwardProgram);
 
         //BufferManager::UnindBuffer(app->localUniformBuffer);
     }
     break;
     case Mode_Deferred:
     {
-        // Refraction Pass
-        glEnable(GL_CLIP_DISTANCE0);
-        app->UpdateEntityBuffer(&app->cam);
-
-        //RENDER TO FB COLORaTT
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
-        glBindFramebuffer(GL_FRAMEBUFFER, app->waterRefractionFrameBuffer.fbHandle);
-        glDrawBuffers(app->waterRefractionFrameBuffer.colorAttachment.size(), app->waterRefractionFrameBuffer.colorAttachment.data());
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // recorded once, replayed by the main and reflection passes
+        app->BuildDrawList(app->drawList, app->programs[app->renderToFrameBuffer]);
 
         const Program& DeferredProgram = app->programs[app->renderToFrameBuffer];
-        glUseProgram(DeferredProgram.handle);
-
-        app->RenderGeometry(DeferredProgram, vec4(0, -1, 0, 0));
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        app->WaterPass(&app->cam, GL_COLOR_ATTACHMENT0, false);
+        glm::mat4 view = CameraView(app->cam);
+        glm::mat4 projection = CameraProjection(app->cam);
+
+        app->ScheduleWaterViews(projection * view);
+        // off screen the Water pass is culled and nothing samples the height field
+        if (app->useOcean && app->waterVisible)
+            Ocean::Update(app->ocean, app->iTime);
+        bool planarReflection = app->waterReflectionMode == WaterReflection_Planar;
+        bool restrictWater = app->restrictWaterToScreenArea;
+
+        // Every pass says what it reads and writes, the ones the back buffer does not depend on are culled
+        RenderGraph& frameGraph = app->frameGraph;
+        FrameGraph::Begin(frameGraph);
+
+        u32 reflectionView = FrameGraph::Import(frameGraph, "Reflection G-buffer");
+        u32 reflectionLit = FrameGraph::Import(frameGraph, "Lit reflection", app->reflectionLitView);
+        u32 gBuffer = FrameGraph::Import(frameGraph, "G-buffer");
+        u32 shadowMaps = FrameGraph::Import(frameGraph, "Shadow maps");
+        // at half resolution the AO chain runs on a quarter of the pixels and the upsample brings it back
+        bool halfResolutionAo = app->ambientOcclusion.halfResolution;
+        ivec2 aoSize = Ssao::TargetSize(app->ambientOcclusion, app->renderSize);
+        u32 aoInputs[2] = {
+            FrameGraph::CreateTexture(frameGraph, "AO linear depth", aoSize, GL_R32F),
+            FrameGraph::CreateTexture(frameGraph, "AO normals", aoSize, GL_RGBA8)
+        };
+        u32 ao = FrameGraph::CreateTexture(frameGraph, "AO", aoSize, GL_RGBA8);
+        u32 blurredAo = FrameGraph::CreateTexture(frameGraph, "Blurred AO", aoSize, GL_RGBA8);
+        u32 upsampledAo = halfResolutionAo ? FrameGraph::CreateTexture(frameGraph, "Upsampled AO", app->renderSize, GL_RGBA8) : 0;
+        u32 aoResult = halfResolutionAo ? upsampledAo : blurredAo;
+        u32 lightClusters = FrameGraph::Import(frameGraph, "Light clusters");
+        u32 sceneColor = FrameGraph::CreateTexture(frameGraph, "Scene color", app->renderSize, GL_RGBA8);
+        u32 reflectionDepth = FrameGraph::Import(frameGraph, "Reflection depth pyramid", app->reflectionDepth.depthPyramid);
+        u32 backBuffer = FrameGraph::Import(frameGraph, "Back buffer");
+        FrameGraph::MarkOutput(frameGraph, backBuffer);
+
+        // the buffer viewer shows them after the frame, they cannot share a texture then
+        if (app->inspectTransientTargets)
+        {
+            FrameGraph::MarkOutput(frameGraph, ao);
+            FrameGraph::MarkOutput(frameGraph, blurredAo);
+            if (halfResolutionAo)
+                FrameGraph::MarkOutput(frameGraph, upsampledAo);
+            FrameGraph::MarkOutput(frameGraph, sceneColor);
+        }
 
-        // Reflection Pass
-        app->UpdateEntityBuffer(&app->camInv);
+        // Main Pass, without the water: it is composited over the lit frame after the lighting
+        u32 passIndex = FrameGraph::AddPass(frameGraph, "Geometry", [&](RenderGraph& graph, u32 pass)
+        {
+            app->UpdateEntityBuffer(&app->cam);
 
-        //RENDER TO FB COLORaTT
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
-        glBindFramebuffer(GL_FRAMEBUFFER, app->waterReflectionFrameBuffer.fbHandle);
-        glDrawBuffers(app->waterReflectionFrameBuffer.colorAttachment.size(), app->waterReflectionFrameBuffer.colorAttachment.data());
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // the depth attachment still holds the previous frame, reduce it before clearing
+            if (app->useGpuCulling)
+                OcclusionCulling::BuildDepthPyramid(app->gpuCulling, app->programs[app->hiZBuildShader].handle, app->defferedFrameBuffer.depthHandle);
 
-        glUseProgram(DeferredProgram.handle);
+            //RENDER TO FB COLORaTT
+            GLState::Viewport(0, 0, app->renderSize.x, app->renderSize.y);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, app->defferedFrameBuffer.fbHandle);
+            glDrawBuffers(app->defferedFrameBuffer.colorAttachment.size(), app->defferedFrameBuffer.colorAttachment.data());
+            GLState::ClearColor(0.f, 0.f, 0.f, .0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        app->RenderGeometry(DeferredProgram, vec4(0, 1, 0, 0));
+            if (app->useGpuCulling)
+            {
+                app->RenderMainPassGeometryCulled(app->programs[app->renderToFrameBufferIndirect], &app->cam);
+            }
+            else
+            {
+                GLState::UseProgram(DeferredProgram.handle);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                app->RenderMainPassGeometry(DeferredProgram);
+            }
 
-        app->WaterPass(&app->camInv, GL_COLOR_ATTACHMENT0, true);
+            app->gpuCulling.prevViewProjection = CameraViewProjection(app->cam);
+            app->gpuCulling.hasDepthHistory = true;
 
-        glDisable(GL_CLIP_DISTANCE0);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        });
+        FrameGraph::Write(frameGraph, passIndex, gBuffer);
 
-        // Render Water
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+        // Shadow cascades and point light tiles, the cached ones only when something asks for it
+        passIndex = FrameGraph::AddPass(frameGraph, "Shadows", [&](RenderGraph& graph, u32 pass)
+        {
+            // replays the local params of the main pass, its world matrices are the ones that count
+            app->BuildDrawList(app->shadowDrawList, app->programs[app->shadowDepthShader]);
+            app->RenderShadowCascades();
+            if (app->usePointShadows)
+                app->RenderPointShadows();
+        });
+        FrameGraph::Write(frameGraph, passIndex, shadowMaps);
+
+        // computed once for the three AO passes that rebuild view space from a depth
+        glm::mat4 projectionInv = glm::inverse(projection);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, app->waterFrameBuffer.fbHandle);
-        glDrawBuffers(app->waterFrameBuffer.colorAttachment.size(), app->waterFrameBuffer.colorAttachment.data());
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Linear depth and view space normals at the AO size, the samples read nothing else
+        passIndex = FrameGraph::AddPass(frameGraph, "SSAO downsample", [&](RenderGraph& graph, u32 pass)
+        {
+            GLState::Viewport(0, 0, aoSize.x, aoSize.y);
+            FrameGraph::BindTargets(graph, pass, aoInputs, 2);
 
-        const Program& waterProgram = app->programs[app->waterShader];
-        glUseProgram(waterProgram.handle);
+            Ssao::Downsample(app->ambientOcclusion, app->programs[app->ssaoDownsampleShader].handle, app->defferedFrameBuffer.colorAttachment[1],
+                app->defferedFrameBuffer.depthHandle, view, projectionInv, app->vao);
 
-        vec3 xCam = glm::cross(app->cam.front, vec3(0, 1, 0));
-        vec3 yCam = glm::cross(xCam, app->cam.front);
-        glm::mat4 view = glm::lookAt(app->cam.position, app->cam.target, yCam);
-        glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        });
+        FrameGraph::Read(frameGraph, passIndex, gBuffer);
+        FrameGraph::Write(frameGraph, passIndex, aoInputs[0]);
+        FrameGraph::Write(frameGraph, passIndex, aoInputs[1]);
 
-        glm::mat4 waterMatrix = glm::rotate(glm::scale(app->water.worldMatrix, glm::vec3(40, 0, 40)), glm::radians(-90.0f), glm::vec3(1, 0, 0));
-        glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "modelViewMatrix"), 1, GL_FALSE, &waterMatrix[0][0]);
+        //RENDER SSAO
+        passIndex = FrameGraph::AddPass(frameGraph, "SSAO", [&](RenderGraph& graph, u32 pass)
+        {
+            GLState::Viewport(0, 0, aoSize.x, aoSize.y);
 
-        glm::mat4 projection = glm::perspective(glm::radians(60.0f), app->cam.aspRatio, app->cam.zNear, app->cam.zFar);
-        glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "projectionMatrix"), 1, GL_FALSE, &projection[0][0]);
+            FrameGraph::BindTargets(graph, pass, &ao, 1);
 
-        glUniform2f(glGetUniformLocation(waterProgram.handle, "viewportSize"), app->displaySize.x, app->displaySize.y);
+            Ssao::Compute(app->ambientOcclusion, app->programs[app->ssaoShader].handle, FrameGraph::Texture(graph, aoInputs[0]),
+                FrameGraph::Texture(graph, aoInputs[1]), projection, projectionInv, app->vao);
 
-        glm::mat4 viewInv = glm::inverse(view);
-        glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "viewMatrixInv"), 1, GL_FALSE, &viewInv[0][0]);
-        glm::mat4 projectionInv = glm::inverse(projection);
-        glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "projectionMatrixInv"), 1, GL_FALSE, &projectionInv[0][0]);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        });
+        FrameGraph::Read(frameGraph, passIndex, aoInputs[0]);
+        FrameGraph::Read(frameGraph, passIndex, aoInputs[1]);
+        FrameGraph::Write(frameGraph, passIndex, ao);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, app->waterReflectionDefferedFrameBuffer.colorAttachment[0]);
-        glUniform1i(glGetUniformLocation(waterProgram.handle, "reflectionMap"), 0);
+        //RENDER SSAO Blur
+        passIndex = FrameGraph::AddPass(frameGraph, "SSAO blur", [&](RenderGraph& graph, u32 pass)
+        {
+            GLState::Viewport(0, 0, aoSize.x, aoSize.y);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, app->waterRefractionDefferedFrameBuffer.colorAttachment[0]);
-        glUniform1i(glGetUniformLocation(waterProgram.handle, "refractionMap"), 1);
+            FrameGraph::BindTargets(graph, pass, &blurredAo, 1);
+            GLState::ClearColor(0.f, 0.f, 0.f, .0f);
+            glClear(GL_COLOR_BUFFER_BIT);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[4]);
-        glUniform1i(glGetUniformLocation(waterProgram.handle, "refractionDepth"), 2);
+            const Program& SsaoBlurProgram = app->programs[app->ssaoBlurShader];
+            GLState::UseProgram(SsaoBlurProgram.handle);
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, app->textures[app->waterDudvMap].handle);
-        glUniform1i(glGetUniformLocation(waterProgram.handle, "dudvMap"), 3);
+            GLState::ActiveTexture(GL_TEXTURE0);
+            GLState::BindTexture(GL_TEXTURE_2D, FrameGraph::Texture(graph, ao));
+            glUniform1i(glGetUniformLocation(SsaoBlurProgram.handle, "ssaoTexture"), 0);
 
-        glBindVertexArray(app->vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+            GLState::BindVertexArray(app->vao);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 
-        glBindVertexArray(0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            GLState::BindVertexArray(0);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        });
+        FrameGraph::Read(frameGraph, passIndex, ao);
+        FrameGraph::Write(frameGraph, passIndex, blurredAo);
 
-        // Main Pass
-        app->UpdateEntityBufferWithWater(&app->cam);
+        // Back to the render size, weighted by how close the low resolution depths are to the pixel
+        if (halfResolutionAo)
+        {
+            passIndex = FrameGraph::AddPass(frameGraph, "SSAO upsample", [&](RenderGraph& graph, u32 pass)
+            {
+                GLState::Viewport(0, 0, app->renderSize.x, app->renderSize.y);
+                FrameGraph::BindTargets(graph, pass, &upsampledAo, 1);
+
+                Ssao::Upsample(app->programs[app->ssaoUpsampleShader].handle, FrameGraph::Texture(graph, blurredAo),
+                    FrameGraph::Texture(graph, aoInputs[0]), app->defferedFrameBuffer.depthHandle, projectionInv, app->vao);
+
+                GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+            });
+            FrameGraph::Read(frameGraph, passIndex, gBuffer);
+            FrameGraph::Read(frameGraph, passIndex, blurredAo);
+            FrameGraph::Read(frameGraph, passIndex, aoInputs[0]);
+            FrameGraph::Write(frameGraph, passIndex, upsampledAo);
+        }
 
-        //RENDER TO FB COLORaTT
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
-        glBindFramebuffer(GL_FRAMEBUFFER, app->defferedFrameBuffer.fbHandle);
-        glDrawBuffers(app->defferedFrameBuffer.colorAttachment.size(), app->defferedFrameBuffer.colorAttachment.data());
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Bin the point lights into the clusters of the main camera
+        passIndex = FrameGraph::AddPass(frameGraph, "Light binning", [&](RenderGraph& graph, u32 pass)
+        {
+            ClusteredLighting::UploadLights(app->lightClusters, app->lights);
+            ClusteredLighting::BuildClusters(app->lightClusters, app->programs[app->lightClusterShader].handle, view, projection, app->cam.zNear, app->cam.zFar);
+        });
+        FrameGraph::Write(frameGraph, passIndex, lightClusters);
 
-        glUseProgram(DeferredProgram.handle);
+        //RENDER TO bb FROM cOLORaTT
+        u32 lightAccumulation = app->useLightVolumes ? FrameGraph::CreateTexture(frameGraph, "Light accumulation", app->renderSize, GL_RGBA16F) : 0;
+        u32 lightStencil = app->useLightVolumes ? FrameGraph::CreateTexture(frameGraph, "Light stencil", app->renderSize, GL_DEPTH24_STENCIL8) : 0;
+        passIndex = FrameGraph::AddPass(frameGraph, "Lighting", [&](RenderGraph& graph, u32 pass)
+        {
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+            GLState::ClearColor(0.f, 0.f, 0.f, .0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            GLState::Viewport(0, 0, app->displaySize.x, app->displaySize.y);
 
-        app->RenderGeometryWithWater(DeferredProgram);
+            if (app->useLightVolumes)
+            {
+                const Program& lightVolumeProgram = app->programs[app->lightVolumeShader];
+                GLState::UseProgram(lightVolumeProgram.handle);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        
-        //RENDER SSAO
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+                // the accumulation target is a render target, the resolve stretches it while a resize settles
+                GLState::Viewport(0, 0, app->renderSize.x, app->renderSize.y);
+                LightVolumes::SetTargets(app->lightVolumes, FrameGraph::Texture(graph, lightAccumulation), FrameGraph::Texture(graph, lightStencil),
+                    app->defferedFrameBuffer.fbHandle, app->renderSize);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, app->ssaoFrameBuffer.fbHandle);
-        glDrawBuffers(app->ssaoFrameBuffer.colorAttachment.size(), app->ssaoFrameBuffer.colorAttachment.data());
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                app->BindGBuffer(app->defferedFrameBuffer, lightVolumeProgram.handle, app->cam);
 
-        const Program& SsaoProgram = app->programs[app->ssaoShader];
-        glUseProgram(SsaoProgram.handle);
+                GLState::ActiveTexture(GL_TEXTURE4);
+                GLState::BindTexture(GL_TEXTURE_2D, app->displaySSAO ? FrameGraph::Texture(graph, aoResult) : 0);
+                glUniform1i(glGetUniformLocation(lightVolumeProgram.handle, "uAO"), 4);
+                glUniform1i(glGetUniformLocation(lightVolumeProgram.handle, "uUseAO"), app->displaySSAO);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[1]);
-        glUniform1i(glGetUniformLocation(SsaoProgram.handle, "uNormals"), 0);
+                glUniform2f(glGetUniformLocation(lightVolumeProgram.handle, "uViewportSize"), app->renderSize.x, app->renderSize.y);
+                glUniform3f(glGetUniformLocation(lightVolumeProgram.handle, "uAttenuation"), LIGHT_ATTENUATION_CONSTANT, LIGHT_ATTENUATION_LINEAR, LIGHT_ATTENUATION_QUADRATIC);
+                glUniformMatrix4fv(glGetUniformLocation(lightVolumeProgram.handle, "uView"), 1, GL_FALSE, &view[0][0]);
+                ShadowCascades::BindForShading(app->shadowMap, lightVolumeProgram.handle, 5, app->useShadows);
+                PointShadows::BindForShading(app->pointShadows, lightVolumeProgram.handle, 6, app->useShadows && app->usePointShadows);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[2]);
-        glUniform1i(glGetUniformLocation(SsaoProgram.handle, "uPosition"), 1);
+                LightVolumes::Accumulate(app->lightVolumes, lightVolumeProgram.handle, app->lights, projection * view, app->vao);
+                LightVolumes::Resolve(app->lightVolumes, app->renderSize, app->displaySize);
+            }
+            else if (!app->displaySSAO)
+            {
+                const Program& FBToBB = app->programs[app->frameBufferToQuadShader];
+                GLState::UseProgram(FBToBB.handle);
 
-        auto firstSamplePoint = SamplePositionsInTangent();
-        glUniform3fv(glGetUniformLocation(SsaoProgram.handle, "ssaoSamples"), 64, &firstSamplePoint.data()->x);
+                ClusteredLighting::BindForShading(app->lightClusters, FBToBB.handle, view, app->displaySize, app->cam.zNear, app->cam.zFar);
+                ShadowCascades::BindForShading(app->shadowMap, FBToBB.handle, 5, app->useShadows);
+                PointShadows::BindForShading(app->pointShadows, FBToBB.handle, 6, app->useShadows && app->usePointShadows);
 
-        glUniform1f(glGetUniformLocation(SsaoProgram.handle, "sampleRadius"), app->sampleRadius);
+                app->BindGBuffer(app->defferedFrameBuffer, FBToBB.handle, app->cam);
 
-        glUniformMatrix4fv(glGetUniformLocation(SsaoProgram.handle, "projectionMatrix"), 1, GL_FALSE, &projection[0][0]);
+                GLState::BindVertexArray(app->vao);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 
-        glUniform2f(glGetUniformLocation(SsaoProgram.handle, "viewportSize"), app->displaySize.x, app->displaySize.y);
+                GLState::BindVertexArray(0);
+            }
+            else
+            {
+                const Program& FBToBBwithSSAO = app->programs[app->frameBufferToQuadShaderSSAO];
+                GLState::UseProgram(FBToBBwithSSAO.handle);
 
-        glUniform1f(glGetUniformLocation(SsaoProgram.handle, "ssaoBias"), app->ssaoBias);
+                ClusteredLighting::BindForShading(app->lightClusters, FBToBBwithSSAO.handle, view, app->displaySize, app->cam.zNear, app->cam.zFar);
+                ShadowCascades::BindForShading(app->shadowMap, FBToBBwithSSAO.handle, 5, app->useShadows);
+                PointShadows::BindForShading(app->pointShadows, FBToBBwithSSAO.handle, 6, app->useShadows && app->usePointShadows);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, app->ssaoNoiseTexture);
-        glUniform1i(glGetUniformLocation(SsaoProgram.handle, "noiseTexture"), 2);
+                app->BindGBuffer(app->defferedFrameBuffer, FBToBBwithSSAO.handle, app->cam);
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[4]);
-        glUniform1i(glGetUniformLocation(SsaoProgram.handle, "uDepth"), 3);
+                GLState::ActiveTexture(GL_TEXTURE4);
+                GLState::BindTexture(GL_TEXTURE_2D, FrameGraph::Texture(graph, aoResult));
+                glUniform1i(glGetUniformLocation(FBToBBwithSSAO.handle, "uAO"), 4);
 
-        glBindVertexArray(app->vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+                GLState::BindVertexArray(app->vao);
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 
-        glBindVertexArray(0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                GLState::BindVertexArray(0);
+            }
 
-        //RENDER SSAO Blur
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+            GLState::UseProgram(0);
+        });
+        FrameGraph::Read(frameGraph, passIndex, gBuffer);
+        if (app->displaySSAO)
+            FrameGraph::Read(frameGraph, passIndex, aoResult);
+        if (!app->useLightVolumes)
+            FrameGraph::Read(frameGraph, passIndex, lightClusters);
+        if (app->useShadows)
+            FrameGraph::Read(frameGraph, passIndex, shadowMaps);
+        if (app->useLightVolumes)
+        {
+            FrameGraph::Write(frameGraph, passIndex, lightAccumulation);
+            FrameGraph::Write(frameGraph, passIndex, lightStencil);
+        }
+        FrameGraph::Write(frameGraph, passIndex, backBuffer);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, app->ssaoBlurFrameBuffer.fbHandle);
-        glDrawBuffers(app->ssaoBlurFrameBuffer.colorAttachment.size(), app->ssaoBlurFrameBuffer.colorAttachment.data());
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // The lit frame at the render size, before the water covers it. The water refracts it and traces its
+        // reflections through it
+        passIndex = FrameGraph::AddPass(frameGraph, "Scene color", [&](RenderGraph& graph, u32 pass)
+        {
+            FrameGraph::BindTargets(graph, pass, &sceneColor, 1);
+            GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+            // screen space hits land anywhere, the refraction alone stays under the water
+            bool scissor = restrictWater && planarReflection;
+            if (scissor)
+                WaterMask::BeginScissor(app->waterScreenArea, app->renderSize);
+            GLenum filter = app->displaySize == app->renderSize ? GL_NEAREST : GL_LINEAR;
+            glBlitFramebuffer(0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->renderSize.x, app->renderSize.y, GL_COLOR_BUFFER_BIT, filter);
+            if (scissor)
+                WaterMask::EndScissor();
+
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        });
+        FrameGraph::Read(frameGraph, passIndex, backBuffer);
+        FrameGraph::Write(frameGraph, passIndex, sceneColor);
+
+        // Planar reflection, the scene again from below the water at a fraction of the resolution. Only where the
+        // water can look it up, the stencil of its G-buffer keeps the outline for the lighting
+        bool reflectionMasked = false;
+        passIndex = FrameGraph::AddPass(frameGraph, "Reflection view", [&](RenderGraph& graph, u32 pass)
+        {
+            app->SplitWaterViewDrawList(app->drawList);
+            app->UpdateEntityBuffer(&app->camInv);
+
+            vec3 boxMin, boxMax;
+            app->WaterBounds(boxMin, boxMax);
+            app->reflectionScreenArea = WaterMask::Project(CameraViewProjection(app->camInv), boxMin, boxMax, WATER_SCREEN_MARGIN);
+
+            GLState::Viewport(0, 0, app->waterViewSize.x, app->waterViewSize.y);
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, app->waterReflectionFrameBuffer.fbHandle);
+            glDrawBuffers(app->waterReflectionFrameBuffer.colorAttachment.size(), app->waterReflectionFrameBuffer.colorAttachment.data());
+            if (restrictWater)
+                WaterMask::BeginScissor(app->reflectionScreenArea, app->waterViewSize);
+            GLState::ClearColor(0.f, 0.f, 0.f, .0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            reflectionMasked = restrictWater && app->useWaterStencil &&
+                WaterMask::WriteStencil(app->reflectionScreenArea, app->programs[app->waterMaskShader].handle, app->vao);
+            if (reflectionMasked)
+                WaterMask::BeginStencilTest();
+
+            GLState::UseProgram(DeferredProgram.handle);
+
+            app->RenderReflectionGeometry(DeferredProgram);
+
+            if (reflectionMasked)
+                WaterMask::EndStencilTest();
+            if (restrictWater)
+                WaterMask::EndScissor();
+            GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+            // the water shader reprojects into it until the next update
+            app->reflectionViewProjection = CameraViewProjection(app->camInv);
+            app->reflectionProjectionInv = glm::inverse(CameraProjection(app->camInv));
+        });
+        FrameGraph::Write(frameGraph, passIndex, reflectionView);
+
+        u32 reflectionStencil = FrameGraph::CreateTexture(frameGraph, "Reflection stencil", app->waterViewSize, GL_DEPTH24_STENCIL8);
+        passIndex = FrameGraph::AddPass(frameGraph, "Reflection lighting", [&](RenderGraph& graph, u32 pass)
+        {
+            // the lighting samples the reflection depth, so its stencil mask is tested from a copy that holds no depth
+            FrameGraph::BindTargets(graph, pass, &reflectionLit, 1, reflectionMasked ? FrameGraph::Texture(graph, reflectionStencil) : 0);
+            if (reflectionMasked)
+            {
+                GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, app->waterReflectionFrameBuffer.fbHandle);
+                glBlitFramebuffer(0, 0, app->waterViewSize.x, app->waterViewSize.y, 0, 0, app->waterViewSize.x, app->waterViewSize.y, GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+                GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, graph.frameBuffers[pass]);
+            }
+            if (restrictWater)
+                WaterMask::BeginScissor(app->reflectionScreenArea, app->waterViewSize);
+            if (reflectionMasked)
+                WaterMask::BeginStencilTest();
+            glDisable(GL_DEPTH_TEST);
+
+            app->WaterPass(&app->camInv);
+
+            glEnable(GL_DEPTH_TEST);
+            if (reflectionMasked)
+                WaterMask::EndStencilTest();
+            if (restrictWater)
+                WaterMask::EndScissor();
+        });
+        // WaterPass shades with the uploaded lights and the shadows, whatever the main lighting reads. It bins the
+        // clusters again for the reflection camera, so the main lighting has to come before it
+        FrameGraph::Read(frameGraph, passIndex, reflectionView);
+        FrameGraph::Read(frameGraph, passIndex, lightClusters);
+        FrameGraph::Write(frameGraph, passIndex, lightClusters);
+        if (app->useShadows)
+            FrameGraph::Read(frameGraph, passIndex, shadowMaps);
+        FrameGraph::Write(frameGraph, passIndex, reflectionLit);
+        FrameGraph::Write(frameGraph, passIndex, reflectionStencil);
+
+        // Nearest depth pyramid of the main pass for the reflection tracing
+        passIndex = FrameGraph::AddPass(frameGraph, "Reflection depth pyramid", [&](RenderGraph& graph, u32 pass)
+        {
+            ScreenSpaceReflections::BuildDepthPyramid(app->reflectionDepth, app->programs[app->hiZBuildShader].handle, app->defferedFrameBuffer.depthHandle);
+        });
+        FrameGraph::Read(frameGraph, passIndex, gBuffer);
+        FrameGraph::Write(frameGraph, passIndex, reflectionDepth);
+
+        // Render Water over the lit frame, what the main pass drew in front of it hides it. Off screen nothing reads
+        // the passes above, so they are culled
+        if (app->waterVisible)
+        {
+            passIndex = FrameGraph::AddPass(frameGraph, "Water", [&](RenderGraph& graph, u32 pass)
+            {
+                GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+                GLState::Viewport(0, 0, app->displaySize.x, app->displaySize.y);
+                if (restrictWater)
+                    WaterMask::BeginScissor(app->waterScreenArea, app->displaySize);
+                // the lighting quad wrote its own depth, the ocean waves only hide each other
+                glClear(GL_DEPTH_BUFFER_BIT);
 
-        const Program& SsaoBlurProgram = app->programs[app->ssaoBlurShader];
-        glUseProgram(SsaoBlurProgram.handle);
+                const Program& waterProgram = app->programs[app->waterShader];
+                GLState::UseProgram(waterProgram.handle);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, app->ssaoFrameBuffer.colorAttachment[0]);
-        glUniform1i(glGetUniformLocation(SsaoBlurProgram.handle, "ssaoTexture"), 0);
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
 
-        glBindVertexArray(app->vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+                glm::mat4 waterMatrix = app->useOcean ? app->OceanMatrix() : app->WaterMatrix();
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "modelViewMatrix"), 1, GL_FALSE, &waterMatrix[0][0]);
 
-        glBindVertexArray(0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        
-        //RENDER TO bb FROM cOLORaTT
-        glClearColor(0.f, 0.f, 0.f, .0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "projectionMatrix"), 1, GL_FALSE, &projection[0][0]);
 
-        if (!app->displaySSAO)
-        {
-            const Program& FBToBB = app->programs[app->frameBufferToQuadShader];
-            glUseProgram(FBToBB.handle);
+                glUniform2f(glGetUniformLocation(waterProgram.handle, "viewportSize"), app->displaySize.x, app->displaySize.y);
 
-            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->localUniformBuffer.handle, app->globalPatamsOffset, app->globalPatamsSize);
+                glm::mat4 viewInv = glm::inverse(view);
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "viewMatrixInv"), 1, GL_FALSE, &viewInv[0][0]);
+                glm::mat4 projectionInv = glm::inverse(projection);
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "projectionMatrixInv"), 1, GL_FALSE, &projectionInv[0][0]);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[0]);
-            glUniform1i(glGetUniformLocation(FBToBB.handle, "uAlbedo"), 0);
+                GLState::ActiveTexture(GL_TEXTURE0);
+                GLState::BindTexture(GL_TEXTURE_2D, FrameGraph::Texture(graph, reflectionLit));
+                glUniform1i(glGetUniformLocation(waterProgram.handle, "reflectionMap"), 0);
 
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[1]);
-            glUniform1i(glGetUniformLocation(FBToBB.handle, "uNormals"), 1);
+                GLState::ActiveTexture(GL_TEXTURE1);
+                GLState::BindTexture(GL_TEXTURE_2D, FrameGraph::Texture(graph, sceneColor));
+                glUniform1i(glGetUniformLocation(waterProgram.handle, "sceneColor"), 1);
 
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[2]);
-            glUniform1i(glGetUniformLocation(FBToBB.handle, "uPosition"), 2);
+                // the hardware depth is there in both layouts
+                GLState::ActiveTexture(GL_TEXTURE2);
+                GLState::BindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.depthHandle);
+                glUniform1i(glGetUniformLocation(waterProgram.handle, "sceneDepth"), 2);
 
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[3]);
-            glUniform1i(glGetUniformLocation(FBToBB.handle, "uViewDir"), 3);
+                GLState::ActiveTexture(GL_TEXTURE3);
+                GLState::BindTexture(GL_TEXTURE_2D, app->textures[app->waterDudvMap].handle);
+                glUniform1i(glGetUniformLocation(waterProgram.handle, "dudvMap"), 3);
 
-            glBindVertexArray(app->vao);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+                // the depth of the reflection view guides the upsampling of its lit color
+                GLState::ActiveTexture(GL_TEXTURE4);
+                GLState::BindTexture(GL_TEXTURE_2D, app->waterReflectionFrameBuffer.depthHandle);
+                glUniform1i(glGetUniformLocation(waterProgram.handle, "reflectionViewDepth"), 4);
 
-            glBindVertexArray(0);
-        }
-        else
-        {
-            const Program& FBToBBwithSSAO = app->programs[app->frameBufferToQuadShaderSSAO];
-            glUseProgram(FBToBBwithSSAO.handle);
+                // the camera of the last update, the view is looked up through it. Its projection is oblique, the depth
+                // only comes back to view space through it too
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "reflectionViewProjection"), 1, GL_FALSE, &app->reflectionViewProjection[0][0]);
+                glUniformMatrix4fv(glGetUniformLocation(waterProgram.handle, "reflectionProjectionInv"), 1, GL_FALSE, &app->reflectionProjectionInv[0][0]);
 
-            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->localUniformBuffer.handle, app->globalPatamsOffset, app->globalPatamsSize);
+                ScreenSpaceReflections::BindForWater(app->reflectionDepth, waterProgram.handle, 8, projection * view, app->cam.zNear, app->cam.zFar, !planarReflection);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[0]);
-            glUniform1i(glGetUniformLocation(FBToBBwithSSAO.handle, "uAlbedo"), 0);
+                // the ocean grid, or the flat quad
+                glUniform1i(glGetUniformLocation(waterProgram.handle, "uOcean"), app->useOcean);
+                if (app->useOcean)
+                {
+                    GLState::ActiveTexture(GL_TEXTURE6);
+                    GLState::BindTexture(GL_TEXTURE_2D, app->ocean.displacementTexture);
+                    glUniform1i(glGetUniformLocation(waterProgram.handle, "uOceanDisplacement"), 6);
 
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[1]);
-            glUniform1i(glGetUniformLocation(FBToBBwithSSAO.handle, "uNormals"), 1);
+                    GLState::ActiveTexture(GL_TEXTURE7);
+                    GLState::BindTexture(GL_TEXTURE_2D, app->ocean.slopeTexture);
+                    glUniform1i(glGetUniformLocation(waterProgram.handle, "uOceanSlopes"), 7);
 
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[2]);
-            glUniform1i(glGetUniformLocation(FBToBBwithSSAO.handle, "uPosition"), 2);
+                    glUniform1f(glGetUniformLocation(waterProgram.handle, "uOceanPatchSize"), app->ocean.patchSize);
 
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, app->defferedFrameBuffer.colorAttachment[3]);
-            glUniform1i(glGetUniformLocation(FBToBBwithSSAO.handle, "uViewDir"), 3);
+                    GLState::BindVertexArray(app->oceanGrid.vao);
+                    glDrawElements(GL_TRIANGLES, app->oceanGrid.indexCount, GL_UNSIGNED_INT, 0);
+                }
+                else
+                {
+                    GLState::BindVertexArray(app->vao);
+                    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+                }
 
-            glActiveTexture(GL_TEXTURE4);
-            glBindTexture(GL_TEXTURE_2D, app->ssaoFrameBuffer.colorAttachment[0]);
-            glUniform1i(glGetUniformLocation(FBToBBwithSSAO.handle, "uAO"), 4);
+                GLState::BindVertexArray(0);
+                GLState::UseProgram(0);
+                if (restrictWater)
+                    WaterMask::EndScissor();
+            });
+            // a lit reflection of an earlier frame is no reason to run its passes again
+            if (planarReflection && app->updateWaterViews)
+                FrameGraph::Read(frameGraph, passIndex, reflectionLit);
+            if (!planarReflection)
+                FrameGraph::Read(frameGraph, passIndex, reflectionDepth);
+            FrameGraph::Read(frameGraph, passIndex, sceneColor);
+            FrameGraph::Read(frameGraph, passIndex, gBuffer);
+            FrameGraph::Write(frameGraph, passIndex, backBuffer);
+        }
 
-            glBindVertexArray(app->vao);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+        FrameGraph::Compile(frameGraph);
+        FrameGraph::Execute(frameGraph, app->renderTargets, app->gpuTimers);
 
-            glBindVertexArray(0);
+        // the water passes that ran this frame, the GPU timings compare both modes. A culled pass keeps the timing of
+        // the last frame it ran, so it is left out
+        const char* waterPasses[] = { "Scene color", "Reflection view", "Reflection lighting", "Reflection depth pyramid", "Water" };
+        f64 waterMs = 0.0;
+        for (u32 i = 0; i < frameGraph.passes.size(); ++i)
+        {
+            if (frameGraph.passes[i].culled)
+                continue;
+            for (u32 j = 0; j < ARRAY_COUNT(waterPasses); ++j)
+                if (strcmp(frameGraph.passes[i].name, waterPasses[j]) == 0)
+                    waterMs += GpuProfiler::Milliseconds(app->gpuTimers, waterPasses[j]);
         }
-
-        glUseProgram(0);
+        app->waterReflectionMs[app->waterReflectionMode] = waterMs;
     }
     break;
     default:;
     }
+
+    BufferManager::EndRingRegion(app->localUniformBuffer);
+    RenderTargets::EndFrame(app->renderTargets);
+
+    GpuProfiler::End(app->gpuTimers, frameScope);
+    app->cpuFrameMs = (glfwGetTime() - app->cpuFrameStart) * 1000.0;
 }
 
-void App::UpdateEntityBuffer(Camera* camera)
+EntityId App::CreateEntity(u32 modelIndex, const vec3& position, const vec3& scale, u8 passMask, u32 parentNode)
 {
-    camera->aspRatio = (float)displaySize.x / (float)displaySize.y;
-    camera->fovYRad = glm::radians(60.0f);
-    glm::mat4 projection = glm::perspective(glm::radians(60.0f), camera->aspRatio, camera->zNear, camera->zFar);
+    u32 node = SceneGraph::AddNode(transforms, parentNode, position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), scale);
+    EntityId entity = Entities::Create(entityStore, modelIndex, node, passMask);
+    u32 row = Entities::Row(entityStore, entity);
+    entityStore.paramsOffset[row] = row * BufferManager::Align(2 * sizeof(glm::mat4), uniformBlockAlignment);
+
+    // the new node is dirty, ApplyTransformChanges fills its matrix and bounds
+    TransformBatch::Resize(entityTransforms, Entities::Count(entityStore));
+    cullingBatchesDirty = true;
+    return entity;
+}
 
-    vec3 xCam = glm::cross(camera->front, vec3(0, 1, 0));
-    vec3 yCam = glm::cross(xCam, camera->front);
+EntityId App::CreateEntities(u32 count, const u32* modelIndices, u32 firstNode, u8 passMask)
+{
+    u32 firstRow = Entities::Count(entityStore);
+    EntityId firstEntity = Entities::CreateRange(entityStore, count, modelIndices, firstNode, passMask);
 
-    glm::mat4 view = glm::lookAt(camera->position, camera->target, yCam);
-    BufferManager::MapBuffer(localUniformBuffer, GL_WRITE_ONLY);
+    const u32 entityStride = BufferManager::Align(2 * sizeof(glm::mat4), uniformBlockAlignment);
+    for (u32 row = firstRow; row < firstRow + count; ++row)
+        entityStore.paramsOffset[row] = row * entityStride;
 
-    //push lights globals paramas
-    globalPatamsOffset = localUniformBuffer.head;
-    PushVec3(localUniformBuffer, camera->position);
-    PushUInt(localUniformBuffer, lights.size());
-    for (u32 i = 0; i < lights.size(); ++i)
-    {
-        BufferManager::AlignHead(localUniformBuffer, sizeof(vec4));
+    TransformBatch::Resize(entityTransforms, Entities::Count(entityStore));
+    cullingBatchesDirty = true;
+    return firstEntity;
+}
 
-        Light& light = lights[i];
-        PushUInt(localUniformBuffer, light.type);
-        PushVec3(localUniformBuffer, light.color);
-        PushVec3(localUniformBuffer, light.direction);
-        PushVec3(localUniformBuffer, light.position);
+void App::DestroyEntity(EntityId entity)
+{
+    u32 row = Entities::Row(entityStore, entity);
+    u32 movedRow = Entities::Destroy(entityStore, entity);
+
+    // the batched upload follows the rows, the last one moved into the hole
+    if (movedRow != INVALID_ROW)
+    {
+        TransformBatch::SetMatrix(entityTransforms, row, transforms.worldMatrix[entityStore.transformNode[row]]);
+        entityStore.paramsOffset[row] = row * BufferManager::Align(2 * sizeof(glm::mat4), uniformBlockAlignment);
     }
+    TransformBatch::Resize(entityTransforms, Entities::Count(entityStore));
+    cullingBatchesDirty = true;
+}
 
-    globalPatamsSize = localUniformBuffer.head - globalPatamsOffset;
+void App::ApplyTransformChanges()
+{
+    if (SceneGraph::UpdateWorldMatrices(transforms) == 0)
+        return;
 
-    //local parms
-    u32 iteration = 0;
-    for (auto it = entities.begin(); it != entities.end(); ++it)
+    // instance i is row i, they are rebuilt anyway if the rows changed
+    bool updateCullInstances = !cullingBatchesDirty;
+    std::vector<u32> changedRows;
+
+    for (u32 i = 0; i < transforms.changedNodes.size(); ++i)
     {
-        glm::mat4 world = it->worldMatrix;
-        glm::mat4 WVP = projection * view * world; //wordl view projection
-
-        Buffer& localBuffer = localUniformBuffer;
-        BufferManager::AlignHead(localBuffer, uniformBlockAlignment);
-        it->localParamsOffset = localBuffer.head;
-        PushMat4(localBuffer, world);
-        PushMat4(localBuffer, WVP);
-        it->localParamsSize = localBuffer.head - it->localParamsOffset;
-        ++iteration;
+        u32 node = transforms.changedNodes[i];
+        u32 row = node < entityStore.nodeRow.size() ? entityStore.nodeRow[node] : INVALID_ROW;
+        if (row == INVALID_ROW)
+            continue;
+
+        const glm::mat4& world = transforms.worldMatrix[node];
+        TransformBatch::SetMatrix(entityTransforms, row, world);
+
+        // the cascades that had it where it was and the ones that have it now
+        ShadowCascades::MarkChanged(shadowMap, entityStore.boundingSphere[row]);
+        PointShadows::MarkChanged(pointShadows, entityStore.boundingSphere[row]);
+        entityStore.boundingSphere[row] = OcclusionCulling::WorldBoundingSphere(world, models[entityStore.modelIndex[row]]);
+        ShadowCascades::MarkChanged(shadowMap, entityStore.boundingSphere[row]);
+        PointShadows::MarkChanged(pointShadows, entityStore.boundingSphere[row]);
+
+        if (updateCullInstances)
+        {
+            CullInstance& instance = gpuCulling.instances[row];
+            instance.worldMatrix = world;
+            instance.boundingSphere = entityStore.boundingSphere[row];
+            changedRows.push_back(row);
+        }
     }
-    BufferManager::UnmapBuffer(localUniformBuffer);
+
+    if (updateCullInstances && !changedRows.empty())
+        OcclusionCulling::UpdateInstances(gpuCulling, changedRows);
 }
 
-void App::UpdateEntityBufferWithWater(Camera* camera)
+void App::UpdateEntityBuffer(Camera* camera)
 {
-    camera->aspRatio = (float)displaySize.x / (float)displaySize.y;
-    camera->fovYRad = glm::radians(60.0f);
-    glm::mat4 projection = glm::perspective(glm::radians(60.0f), camera->aspRatio, camera->zNear, camera->zFar);
+    glm::mat4 viewProjection = CameraViewProjection(*camera);
 
-    vec3 xCam = glm::cross(camera->front, vec3(0, 1, 0));
-    vec3 yCam = glm::cross(xCam, camera->front);
-
-    glm::mat4 view = glm::lookAt(camera->position, camera->target, yCam);
-    BufferManager::MapBuffer(localUniformBuffer, GL_WRITE_ONLY);
+    BufferManager::MapRing(localUniformBuffer);
+    Buffer& uniformBuffer = localUniformBuffer.buffer;
 
     //push lights globals paramas
-    globalPatamsOffset = localUniformBuffer.head;
-    PushVec3(localUniformBuffer, camera->position);
-    PushUInt(localUniformBuffer, lights.size());
-    for (u32 i = 0; i < lights.size(); ++i)
+    BufferManager::AlignHead(uniformBuffer, uniformBlockAlignment);
+    globalPatamsOffset = uniformBuffer.head;
+    PushVec3(uniformBuffer, camera->position);
+    u32 lightCount = glm::min((u32)lights.size(), (u32)MAX_SHADER_LIGHTS);
+    PushUInt(uniformBuffer, lightCount);
+    for (u32 i = 0; i < lightCount; ++i)
     {
-        BufferManager::AlignHead(localUniformBuffer, sizeof(vec4));
+        BufferManager::AlignHead(uniformBuffer, sizeof(vec4));
 
         Light& light = lights[i];
-        PushUInt(localUniformBuffer, light.type);
-        PushVec3(localUniformBuffer, light.color);
-        PushVec3(localUniformBuffer, light.direction);
-        PushVec3(localUniformBuffer, light.position);
+        PushUInt(uniformBuffer, light.type);
+        PushVec3(uniformBuffer, light.color);
+        PushVec3(uniformBuffer, light.direction);
+        PushVec3(uniformBuffer, light.position);
+        PushFloat(uniformBuffer, light.radius);
     }
 
-    globalPatamsSize = localUniformBuffer.head - globalPatamsOffset;
+    globalPatamsSize = uniformBuffer.head - globalPatamsOffset;
 
     //local parms
-    u32 iteration = 0;
-    for (auto it = entitiesWithWater.begin(); it != entitiesWithWater.end(); ++it)
-    {
-        glm::mat4 world = it->worldMatrix;
-        glm::mat4 WVP = projection * view * world; //wordl view projection
-
-        Buffer& localBuffer = localUniformBuffer;
-        BufferManager::AlignHead(localBuffer, uniformBlockAlignment);
-        it->localParamsOffset = localBuffer.head;
-        PushMat4(localBuffer, world);
-        PushMat4(localBuffer, WVP);
-        it->localParamsSize = localBuffer.head - it->localParamsOffset;
-        ++iteration;
-    }
-    BufferManager::UnmapBuffer(localUniformBuffer);
+    UploadEntityParams(viewProjection);
+    BufferManager::UnmapRing(localUniformBuffer);
 }
 
-void App::ConfigureFrameBuffer(FrameBuffer& aConfigFb)
+void App::UploadEntityParams(const glm::mat4& viewProjection)
 {
-    //GLuint NUMBER_OF_CA = 3; // esto cambeir si se aaden en el shader
-
+    u32 entityCount = Entities::Count(entityStore);
+    ASSERT(entityCount == entityTransforms.count, "Entity transforms out of date");
+
+    // row i lands at entityStore.paramsOffset[i], the passes that skip some rows never bind theirs
+    const u32 entityStride = BufferManager::Align(2 * sizeof(glm::mat4), uniformBlockAlignment);
+    RingAllocation localParams = BufferManager::AllocateRing(localUniformBuffer, entityStride * entityCount, uniformBlockAlignment);
+    if (!localParams.data)
+        return;
+    localParamsOffset = localParams.offset;
+    TransformBatch::WriteWorldViewProjection(entityTransforms, entityCount, viewProjection, localParams.data, entityStride);
+}
 
-    aConfigFb.colorAttachment.push_back(CreateTexture());
-    aConfigFb.colorAttachment.push_back(CreateTexture(true));
-    aConfigFb.colorAttachment.push_back(CreateTexture(true));
-    aConfigFb.colorAttachment.push_back(CreateTexture(true));
-    aConfigFb.colorAttachment.push_back(CreateTexture(true));
-    //aConfigFb.colorAttachment.push_back(CreateTexture());
+void App::ConfigureFrameBuffer(FrameBuffer& aConfigFb, ivec2 size)
+{
+    // albedo and normals first in both layouts
+    const GBufferLayout& layout = GBuffer::Layout(COMPACT_GBUFFER);
+    for (u32 i = 0; i < layout.colorCount; ++i)
+        aConfigFb.colorAttachment.push_back(RenderTargets::Acquire(renderTargets, size, layout.colorFormats[i]));
 
-    glGenTextures(1, &aConfigFb.depthHandle);
-    glBindTexture(GL_TEXTURE_2D, aConfigFb.depthHandle);
     //EL BUFFEER OCUPA MAS,, si hay oproblema scon el z fight aumentar la cantidad de bits
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, displaySize.x, displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);  //RGBA para .si hacemos un resice que vuelva a generar el frame buff
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // with stencil for the water mask, the light volumes and the reflection lighting test against copies
+    aConfigFb.depthHandle = RenderTargets::Acquire(renderTargets, size, GL_DEPTH24_STENCIL8);
 
     glGenFramebuffers(1, &aConfigFb.fbHandle);
-    glBindFramebuffer(GL_FRAMEBUFFER, aConfigFb.fbHandle);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, aConfigFb.fbHandle);
 
     std::vector<GLuint> drawBuffers;
     for (size_t i = 0; i < aConfigFb.colorAttachment.size(); ++i)
@@ -864,7 +1415,7 @@ void App::ConfigureFrameBuffer(FrameBuffer& aConfigFb)
         drawBuffers.push_back(position);
     }
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, aConfigFb.depthHandle, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, aConfigFb.depthHandle, 0);
 
     glDrawBuffers(drawBuffers.size(), drawBuffers.data());
 
@@ -878,257 +1429,410 @@ void App::ConfigureFrameBuffer(FrameBuffer& aConfigFb)
     //GLenum frameBufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     /// Aqui va u nif , TUDU
 // glDrawBuffers(1, &app->colorAttachmentHandle);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 }
 
-void App::ConfigureSingleFrameBuffer(FrameBuffer& ssaoFB)
+void App::CreateRenderTargets()
 {
-    ssaoFB.colorAttachment.push_back(CreateTexture());
+    ConfigureFrameBuffer(defferedFrameBuffer, renderSize);
 
-    glGenTextures(1, &ssaoFB.depthHandle);
-    glBindTexture(GL_TEXTURE_2D, ssaoFB.depthHandle);
-    //EL BUFFEER OCUPA MAS,, si hay oproblema scon el z fight aumentar la cantidad de bits
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, displaySize.x, displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);  //RGBA para .si hacemos un resice que vuelva a generar el frame buff
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // the reflection G-buffer at a fraction of the resolution
+    waterViewSize = glm::max(renderSize / (i32)waterViewDivisor, ivec2(1));
+    ConfigureFrameBuffer(waterReflectionFrameBuffer, waterViewSize);
+    reflectionLitView = RenderTargets::Acquire(renderTargets, waterViewSize, GL_RGBA8);
+    waterViewsValid = false;
+}
 
-    glGenFramebuffers(1, &ssaoFB.fbHandle);
-    glBindFramebuffer(GL_FRAMEBUFFER, ssaoFB.fbHandle);
+static void ReleaseFrameBuffer(RenderTargetPool& pool, FrameBuffer& frameBuffer)
+{
+    for (u32 i = 0; i < frameBuffer.colorAttachment.size(); ++i)
+        RenderTargets::Release(pool, frameBuffer.colorAttachment[i]);
+    RenderTargets::Release(pool, frameBuffer.depthHandle);
 
-    std::vector<GLuint> drawBuffers;
-    for (size_t i = 0; i < ssaoFB.colorAttachment.size(); ++i)
-    {
-        GLuint position = GL_COLOR_ATTACHMENT0 + i;
-        glFramebufferTexture(GL_FRAMEBUFFER, position, ssaoFB.colorAttachment[i], 0);
-        drawBuffers.push_back(position);
-    }
+    glDeleteFramebuffers(1, &frameBuffer.fbHandle);
+    frameBuffer.colorAttachment.clear();
+}
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ssaoFB.depthHandle, 0);
+void App::ReleaseRenderTargets()
+{
+    ReleaseFrameBuffer(renderTargets, defferedFrameBuffer);
+    ReleaseFrameBuffer(renderTargets, waterReflectionFrameBuffer);
+    RenderTargets::Release(renderTargets, reflectionLitView);
 
-    glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+    // deleted names come back from the next glGen calls
+    GLState::Invalidate();
+}
 
-    GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE)
+void App::UpdateRenderTargetSize()
+{
+    // a new water view fraction from the GUI, nothing to wait for
+    if (glm::max(renderSize / (i32)waterViewDivisor, ivec2(1)) != waterViewSize)
     {
-        int i = 0;
+        ReleaseRenderTargets();
+        CreateRenderTargets();
+        cullingBatchesDirty = true;
+    }
+
+    // a minimized window is 0x0, the targets keep their size until it comes back
+    if (displaySize == renderSize || displaySize.x <= 0 || displaySize.y <= 0)
+    {
+        pendingRenderSizeFrames = 0;
+        return;
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // dragging the window border changes the size every frame, only the one it stops at is created
+    if (displaySize != pendingRenderSize)
+    {
+        pendingRenderSize = displaySize;
+        pendingRenderSizeFrames = 0;
+    }
+    if (++pendingRenderSizeFrames < RENDER_TARGET_RESIZE_FRAMES)
+        return;
+
+    // the old ones stay in the pool for a while, going back to that size takes them again
+    ReleaseRenderTargets();
+    renderSize = displaySize;
+    CreateRenderTargets();
+    OcclusionCulling::Resize(gpuCulling, renderSize);
+    ScreenSpaceReflections::Resize(reflectionDepth, renderSize);
+    // the water batch samples the water target by handle
+    cullingBatchesDirty = true;
+    gBufferReport = GBuffer::BandwidthReport(renderSize, 2, COMPACT_GBUFFER);
+    pendingRenderSizeFrames = 0;
+
+    ILOG("Render targets resized to %dx%d, the pool holds %.1f MB", renderSize.x, renderSize.y, renderTargets.bytesHeld / (1024.0 * 1024.0));
 }
 
-void App::RenderGeometry(const Program& aBindedProgram, vec4 clippingPlane)
+void App::BuildDrawList(DrawList& list, const Program& aBindedProgram)
 {
-    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), localUniformBuffer.handle, globalPatamsOffset, globalPatamsSize);
-    for (auto it = entities.begin(); it != entities.end(); ++it)
+    DrawCommands::Begin(list, aBindedProgram.handle);
+
+    // the main view draws a prefix of the list and the water views a suffix, the rows in both sit in between
+    static std::vector<u32> mainOnlyRows;
+    static std::vector<u32> sharedRows;
+    static std::vector<u32> waterViewOnlyRows;
+    mainOnlyRows.clear();
+    sharedRows.clear();
+    waterViewOnlyRows.clear();
+    for (u32 row = 0; row < Entities::Count(entityStore); ++row)
     {
+        u8 passMask = entityStore.passMask[row];
+        if (passMask == RenderPass_Main)
+            mainOnlyRows.push_back(row);
+        else if (passMask == RenderPass_All)
+            sharedRows.push_back(row);
+        else if (passMask == RenderPass_WaterViews)
+            waterViewOnlyRows.push_back(row);
+    }
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), localUniformBuffer.handle, it->localParamsOffset, it->localParamsSize); //todu creo q aqui no va, creo que es modelloading que no va
+    const std::vector<u32>* rowLists[] = { &mainOnlyRows, &sharedRows, &waterViewOnlyRows };
+    for (u32 l = 0; l < ARRAY_COUNT(rowLists); ++l)
+    {
+        const std::vector<u32>& rows = *rowLists[l];
+        for (u32 r = 0; r < rows.size(); ++r)
+        {
+            u32 modelIndex = entityStore.modelIndex[rows[r]];
+            Model& model = models[modelIndex];
+            Mesh& mesh = meshes[model.meshIdx];
 
-        Model& model = models[it->modelIndex];
-        Mesh& mesh = meshes[model.meshIdx];
+            for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+            {
+                const Material& subMeshMaterial = materials[model.materialIdx[i]];
+
+                DrawPacket packet = {};
+                packet.vao = FindVAO(mesh, i, aBindedProgram);
+                packet.textureHandle = textures[subMeshMaterial.albedoTextureIdx].handle;
+                packet.indexCount = mesh.submeshes[i].indices.size();
+                packet.indexOffset = mesh.submeshes[i].indexOffset;
+                packet.indexType = GL_UNSIGNED_INT;
+                packet.paramsOffset = entityStore.paramsOffset[rows[r]];
+                packet.row = rows[r];
+                list.packets.push_back(packet);
+            }
+        }
 
+        if (l == 0)
+            list.waterViewBegin = list.packets.size();
+        else if (l == 1)
+            list.mainViewCount = list.packets.size();
+    }
 
-        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-        {
-            GLuint vao = FindVAO(mesh, i, aBindedProgram);
-            glBindVertexArray(vao);
+    DrawCommands::Sort(list, 0, list.waterViewBegin);
+    DrawCommands::Sort(list, list.waterViewBegin, list.mainViewCount);
+    DrawCommands::Sort(list, list.mainViewCount, list.packets.size());
+}
 
-            u32 subMeshmaterialIdx = model.materialIdx[i];
-            Material subMeshMaterial = materials[subMeshmaterialIdx];
+void App::RenderShadowCascades()
+{
+    u32 lightIndex = 0;
+    while (lightIndex < lights.size() && lights[lightIndex].type != LightType_Directional)
+        ++lightIndex;
+    if (lightIndex == lights.size())
+        return;
+
+    vec3 xCam = glm::cross(cam.front, vec3(0, 1, 0));
+    vec3 yCam = glm::cross(xCam, cam.front);
+    glm::mat4 view = glm::lookAt(cam.position, cam.target, yCam);
+
+    ShadowCascades::Update(shadowMap, view, cam.fovYRad, cam.aspRatio, cam.zNear, lights[lightIndex].direction,
+        shadowDrawList, shadowDrawList.mainViewCount, MakeDrawView(), entityStore.boundingSphere);
+}
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textures[subMeshMaterial.albedoTextureIdx].handle);
-            glUniform1i(texturedMeshProgram_uTexture, 0);
+void App::RenderPointShadows()
+{
+    PointShadows::Update(pointShadows, lights, CameraViewProjection(cam), cam.position,
+        shadowDrawList, shadowDrawList.mainViewCount, MakeDrawView(), entityStore.boundingSphere);
+}
 
-            glUniform4f(glGetUniformLocation(aBindedProgram.handle, "clippingPlane"), clippingPlane.x, clippingPlane.y, clippingPlane.z, clippingPlane.w);
+DrawView App::MakeDrawView()
+{
+    DrawView view = {};
+    view.uniformBuffer = localUniformBuffer.buffer.handle;
+    view.globalParamsOffset = globalPatamsOffset;
+    view.globalParamsSize = globalPatamsSize;
+    view.localParamsOffset = localParamsOffset;
+    view.localParamsSize = 2 * sizeof(glm::mat4);
+
+    vec3 xCam = glm::cross(cam.front, vec3(0, 1, 0));
+    vec3 yCam = glm::cross(xCam, cam.front);
+    view.viewMatrix = glm::lookAt(cam.position, cam.target, yCam);
+    return view;
+}
 
-            vec3 xCam = glm::cross(cam.front, vec3(0, 1, 0));
-            vec3 yCam = glm::cross(xCam, cam.front);
-            glm::mat4 view = glm::lookAt(cam.position, cam.target, yCam);
-            glUniformMatrix4fv(glGetUniformLocation(aBindedProgram.handle, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
+void App::RenderGeometry(const Program& aBindedProgram)
+{
+    ASSERT(drawList.program == aBindedProgram.handle, "The draw list was built for another program");
+    DrawCommands::Replay(drawList, drawList.mainViewCount, MakeDrawView());
+}
 
-            SubMesh& submesh = mesh.submeshes[i];
-            glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-        }
-    }
+void App::SplitWaterViewDrawList(const DrawList& list)
+{
+    DrawCommands::SplitByPlane(list, list.waterViewBegin, list.packets.size(), vec4(0, 1, 0, 0), WATER_CLIP_PLANE_OFFSET, entityStore.boundingSphere,
+        aboveWaterDrawList, belowWaterDrawList, acrossWaterDrawList);
 }
 
-void App::RenderGeometryWithWater(const Program& aBindedProgram)
+void App::RenderReflectionGeometry(const Program& aBindedProgram)
 {
-    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), localUniformBuffer.handle, globalPatamsOffset, globalPatamsSize);
-    for (auto it = entitiesWithWater.begin(); it != entitiesWithWater.end(); ++it)
-    {
+    ASSERT(acrossWaterDrawList.program == aBindedProgram.handle, "The water view lists were split from another program");
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), localUniformBuffer.handle, it->localParamsOffset, it->localParamsSize); //todu creo q aqui no va, creo que es modelloading que no va
+    // the reflection only sees above the water, the near plane cuts the ones across
+    DrawView view = MakeDrawView();
+    DrawCommands::Replay(aboveWaterDrawList, aboveWaterDrawList.packets.size(), view);
+    DrawCommands::Replay(acrossWaterDrawList, acrossWaterDrawList.packets.size(), view);
+}
 
-        Model& model = models[it->modelIndex];
+void App::RenderMainPassGeometry(const Program& aBindedProgram)
+{
+    ASSERT(drawList.program == aBindedProgram.handle, "The draw list was built for another program");
+    DrawCommands::Replay(drawList, drawList.mainViewCount, MakeDrawView());
+}
+
+void App::BuildCullingBatches(const Program& aBindedProgram)
+{
+    gpuCulling.batches.clear();
+    gpuCulling.instances.clear();
+
+    const u32 entityCount = Entities::Count(entityStore);
+    const u32* modelIndices = entityStore.modelIndex.data();
+    const u8* passMasks = entityStore.passMask.data();
+
+    std::vector<u32> instancesPerModel(models.size(), 0);
+    for (u32 row = 0; row < entityCount; ++row)
+        if (passMasks[row] & RenderPass_Main)
+            ++instancesPerModel[modelIndices[row]];
+
+    // every submesh of a used model becomes one batch, sized for all its entities
+    std::vector<u32> modelFirstBatch(models.size(), 0);
+    u32 firstInstance = 0;
+    for (u32 modelIdx = 0; modelIdx < models.size(); ++modelIdx)
+    {
+        if (instancesPerModel[modelIdx] == 0)
+            continue;
+
+        Model& model = models[modelIdx];
         Mesh& mesh = meshes[model.meshIdx];
+        modelFirstBatch[modelIdx] = gpuCulling.batches.size();
 
         for (u32 i = 0; i < mesh.submeshes.size(); ++i)
         {
-            GLuint vao = FindVAO(mesh, i, aBindedProgram);
-            glBindVertexArray(vao);
+            const Material& subMeshMaterial = materials[model.materialIdx[i]];
+
+            CullBatch batch = {};
+            batch.vao = FindVAO(mesh, i, aBindedProgram);
+            batch.textureHandle = textures[subMeshMaterial.albedoTextureIdx].handle;
+            batch.indexCount = mesh.submeshes[i].indices.size();
+            batch.firstIndex = mesh.submeshes[i].indexOffset / sizeof(u32);
+            batch.firstInstance = firstInstance;
+            batch.instanceCapacity = instancesPerModel[modelIdx];
+            gpuCulling.batches.push_back(batch);
+
+            firstInstance += instancesPerModel[modelIdx];
+        }
+    }
 
-            u32 subMeshmaterialIdx = model.materialIdx[i];
-            Material subMeshMaterial = materials[subMeshmaterialIdx];
+    // instance i is row i, rows outside the main pass get no batches so they never draw
+    for (u32 row = 0; row < entityCount; ++row)
+    {
+        const Model& model = models[modelIndices[row]];
+
+        CullInstance instance = {};
+        instance.worldMatrix = transforms.worldMatrix[entityStore.transformNode[row]];
+        instance.boundingSphere = entityStore.boundingSphere[row];
+        instance.firstBatch = modelFirstBatch[modelIndices[row]];
+        instance.batchCount = (passMasks[row] & RenderPass_Main) ? meshes[model.meshIdx].submeshes.size() : 0;
+        gpuCulling.instances.push_back(instance);
+    }
 
-            glActiveTexture(GL_TEXTURE0);
-            if (it->modelIndex != water.modelIndex) glBindTexture(GL_TEXTURE_2D, textures[subMeshMaterial.albedoTextureIdx].handle);
-            else
-            {
-                glBindTexture(GL_TEXTURE_2D, waterFrameBuffer.colorAttachment[0]);
-            }
-            glUniform1i(texturedMeshProgram_uTexture, 0);
+    OcclusionCulling::UploadInstances(gpuCulling);
+}
 
-            glUniform4f(glGetUniformLocation(aBindedProgram.handle, "clippingPlane"), 0, 0, 0, 0);
+void App::RenderMainPassGeometryCulled(const Program& aBindedProgram, Camera* camera)
+{
+    glm::mat4 viewProjection = CameraViewProjection(*camera);
 
-            vec3 xCam = glm::cross(cam.front, vec3(0, 1, 0));
-            vec3 yCam = glm::cross(xCam, cam.front);
-            glm::mat4 view = glm::lookAt(cam.position, cam.target, yCam);
-            glUniformMatrix4fv(glGetUniformLocation(aBindedProgram.handle, "viewMatrix"), 1, GL_FALSE, &view[0][0]);
+    OcclusionCulling::CullInstances(gpuCulling, programs[hiZCullShader].handle, viewProjection);
 
-            SubMesh& submesh = mesh.submeshes[i];
-            glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-        }
-    }
+    GLState::UseProgram(aBindedProgram.handle);
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), localUniformBuffer.buffer.handle, globalPatamsOffset, globalPatamsSize);
+    glUniformMatrix4fv(glGetUniformLocation(aBindedProgram.handle, "uViewProjection"), 1, GL_FALSE, &viewProjection[0][0]);
+
+    OcclusionCulling::DrawBatches(gpuCulling, aBindedProgram.handle);
 }
 
-const GLuint App::CreateTexture(const bool isFloatingPoint)
+glm::mat4 App::OceanMatrix()
 {
-    GLuint textureHandle;
-
-    GLenum internalFormat = isFloatingPoint ? GL_RGBA16F : GL_RGBA8;
-    GLenum format = GL_RGBA;
-    GLenum dataType = isFloatingPoint ? GL_FLOAT : GL_UNSIGNED_BYTE;
-
-    glGenTextures(1, &textureHandle);
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, displaySize.x, displaySize.y, 0, format, dataType, NULL);  //RGBA para .si hacemos un resice que vuelva a generar el frame buff
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return textureHandle;
+    const glm::mat4& waterWorldMatrix = transforms.worldMatrix[entityStore.transformNode[Entities::Row(entityStore, waterEntity)]];
+    return Ocean::GridMatrix(oceanGrid, cam.position, waterWorldMatrix[3].y);
 }
 
-float Lerp(float a, float b, float f)
+glm::mat4 App::WaterMatrix()
 {
-    return a + f * (b - a);
+    // the square the ocean grid covers, its views are scheduled by it too
+    if (useOcean)
+    {
+        f32 extent = Ocean::GridExtent(oceanGrid);
+        return glm::rotate(glm::scale(OceanMatrix(), glm::vec3(extent, 0, extent)), glm::radians(-90.0f), glm::vec3(1, 0, 0));
+    }
+
+    // the unit quad of vao, laid flat and stretched over the water entity
+    const glm::mat4& waterWorldMatrix = transforms.worldMatrix[entityStore.transformNode[Entities::Row(entityStore, waterEntity)]];
+    return glm::rotate(glm::scale(waterWorldMatrix, glm::vec3(40, 0, 40)), glm::radians(-90.0f), glm::vec3(1, 0, 0));
 }
 
-std::vector<vec3> SamplePositionsInTangent()
+void App::WaterBounds(vec3& boxMin, vec3& boxMax)
 {
-    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
-    std::default_random_engine generator;
-    std::vector<glm::vec3> ssaoKernel;
-    for (unsigned int i = 0; i < 64; ++i)
+    glm::mat4 waterMatrix = WaterMatrix();
+    boxMin = vec3(FLT_MAX);
+    boxMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < 4; ++i)
     {
-        glm::vec3 sample(
-            randomFloats(generator) * 2.0 - 1.0,
-            randomFloats(generator) * 2.0 - 1.0,
-            randomFloats(generator)
-        );
-        sample = glm::normalize(sample);
-        sample *= randomFloats(generator);
-
-        float scale = (float)i / 64.0;
-        scale = Lerp(0.1f, 1.0f, scale * scale);
-        sample *= scale;
-
-        ssaoKernel.push_back(sample);
+        vec3 corner = vec3(waterMatrix * vec4(vertices[i].pos, 1.0f));
+        boxMin = glm::min(boxMin, corner);
+        boxMax = glm::max(boxMax, corner);
     }
-    return ssaoKernel;
+
+    // the ocean waves leave the plane
+    f32 waveHeight = useOcean ? WATER_WAVE_HEIGHT_BOUND : 0.0f;
+    boxMin.y -= waveHeight;
+    boxMax.y += waveHeight;
 }
 
-void App::KernelRotationVectors()
+void App::ScheduleWaterViews(const glm::mat4& viewProjection)
 {
-    std::uniform_real_distribution<float> randomFloats(0.0, 1.0);
-    std::default_random_engine generator;
-    std::vector<glm::vec3> ssaoNoise;
-    for (unsigned int i = 0; i < 16; i++)
+    // the water passes of the main view are restricted to this area too
+    vec3 boxMin, boxMax;
+    WaterBounds(boxMin, boxMax);
+    waterScreenArea = WaterMask::Project(viewProjection, boxMin, boxMax, WATER_SCREEN_MARGIN);
+    waterVisible = waterScreenArea.visible;
+    waterCoverage = WaterMask::Coverage(waterScreenArea);
+
+    waterViewInterval = waterCoverage >= WATER_VIEW_FULL_RATE_COVERAGE ? 1 : waterCoverage >= WATER_VIEW_HALF_RATE_COVERAGE ? 2 : WATER_VIEW_MAX_INTERVAL;
+    if (!amortizeWaterViews)
+        waterViewInterval = 1;
+
+    // a turn reprojects exactly, travel shows as parallax in what the water reflects
+    f32 travel = glm::length(cam.position - waterUpdatePosition) / glm::max(glm::abs(cam.position.y), 1.0f);
+    f32 turn = glm::degrees(glm::acos(glm::clamp(glm::dot(cam.front, waterUpdateFront), -1.0f, 1.0f)));
+    bool moved = travel > WATER_VIEW_MAX_TRAVEL || turn > WATER_VIEW_MAX_TURN_DEG;
+
+    // only the planar reflection renders the views, in screen space they stay invalid until it is picked
+    bool planar = waterReflectionMode == WaterReflection_Planar;
+    updateWaterViews = planar && waterVisible && (!waterViewsValid || moved || waterViewAge + 1 >= waterViewInterval);
+    if (updateWaterViews)
     {
-        glm::vec3 noise(
-            randomFloats(generator) * 2.0 - 1.0,
-            randomFloats(generator) * 2.0 - 1.0,
-            0.0f);
-        ssaoNoise.push_back(noise);
+        waterViewAge = 0;
+        waterUpdatePosition = cam.position;
+        waterUpdateFront = cam.front;
+        waterViewsValid = true;
+    }
+    else
+    {
+        ++waterViewAge;
     }
-
-    glGenTextures(1, &ssaoNoiseTexture);
-    glBindTexture(GL_TEXTURE_2D, ssaoNoiseTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 }
 
-void App::WaterPass(Camera* camera, GLenum ca, bool isReflectionPart)
+void App::WaterPass(Camera* camera)
 {
-    glClearColor(0.f, 0.f, 0.f, .0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, displaySize.x, displaySize.y);
+    // into the target the frame graph bound
+    GLState::Viewport(0, 0, waterViewSize.x, waterViewSize.y);
 
-    if (isReflectionPart) glBindFramebuffer(GL_FRAMEBUFFER, waterReflectionDefferedFrameBuffer.fbHandle);
-    else glBindFramebuffer(GL_FRAMEBUFFER, waterRefractionDefferedFrameBuffer.fbHandle);
+    GLState::ClearColor(0.f, 0.f, 0.f, .0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    glDrawBuffer(ca);
-    glClearColor(0.f, 0.f, 0.f, .0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // the main lighting is done with the clusters, they are binned again for this camera. Its oblique near plane
+    // leaves the screen tiles where they are, the plain projection bins the same
+    glm::mat4 view = CameraView(*camera);
+    glm::mat4 projection = glm::perspective(camera->fovYRad, camera->aspRatio, camera->zNear, camera->zFar);
+    ClusteredLighting::BuildClusters(lightClusters, programs[lightClusterShader].handle, view, projection, camera->zNear, camera->zFar);
 
     const Program& program = programs[frameBufferToQuadShader];
-    glUseProgram(program.handle);
+    GLState::UseProgram(program.handle);
 
-    if (isReflectionPart)
-    {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, waterReflectionFrameBuffer.colorAttachment[0]);
-        glUniform1i(glGetUniformLocation(program.handle, "uAlbedo"), 0);
+    ClusteredLighting::BindForShading(lightClusters, program.handle, view, waterViewSize, camera->zNear, camera->zFar);
+    // the shadow samplers have to leave unit 0 even when disabled, it holds the albedo
+    ShadowCascades::BindForShading(shadowMap, program.handle, 5, useShadows);
+    PointShadows::BindForShading(pointShadows, program.handle, 6, useShadows && usePointShadows);
+    BindGBuffer(waterReflectionFrameBuffer, program.handle, *camera);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, waterReflectionFrameBuffer.colorAttachment[1]);
-        glUniform1i(glGetUniformLocation(program.handle, "uNormals"), 1);
+    GLState::BindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, waterReflectionFrameBuffer.colorAttachment[2]);
-        glUniform1i(glGetUniformLocation(program.handle, "uPosition"), 2);
+    GLState::BindVertexArray(0);
+    GLState::UseProgram(0);
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, waterReflectionFrameBuffer.colorAttachment[3]);
-        glUniform1i(glGetUniformLocation(program.handle, "uViewDir"), 3);
-    }
-    else
-    {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, waterRefractionFrameBuffer.colorAttachment[0]);
-        glUniform1i(glGetUniformLocation(program.handle, "uAlbedo"), 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, waterRefractionFrameBuffer.colorAttachment[1]);
-        glUniform1i(glGetUniformLocation(program.handle, "uNormals"), 1);
+void App::BindGBuffer(const FrameBuffer& gBuffer, GLuint program, const Camera& camera)
+{
+    GLState::ActiveTexture(GL_TEXTURE0);
+    GLState::BindTexture(GL_TEXTURE_2D, gBuffer.colorAttachment[0]);
+    glUniform1i(glGetUniformLocation(program, "uAlbedo"), 0);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, waterRefractionFrameBuffer.colorAttachment[2]);
-        glUniform1i(glGetUniformLocation(program.handle, "uPosition"), 2);
+    GLState::ActiveTexture(GL_TEXTURE1);
+    GLState::BindTexture(GL_TEXTURE_2D, gBuffer.colorAttachment[1]);
+    glUniform1i(glGetUniformLocation(program, "uNormals"), 1);
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, waterRefractionFrameBuffer.colorAttachment[3]);
-        glUniform1i(glGetUniformLocation(program.handle, "uViewDir"), 3);
+    if (COMPACT_GBUFFER)
+    {
+        // position and view direction come back from the depth and the camera that rendered it
+        GLState::ActiveTexture(GL_TEXTURE2);
+        GLState::BindTexture(GL_TEXTURE_2D, gBuffer.depthHandle);
+        glUniform1i(glGetUniformLocation(program, "uDepth"), 2);
+
+        glm::mat4 inverseViewProjection = glm::inverse(CameraViewProjection(camera));
+        glUniformMatrix4fv(glGetUniformLocation(program, "uInverseViewProjection"), 1, GL_FALSE, &inverseViewProjection[0][0]);
+        glUniform3fv(glGetUniformLocation(program, "uCameraPosition"), 1, glm::value_ptr(camera.position));
     }
+    else
+    {
+        GLState::ActiveTexture(GL_TEXTURE2);
+        GLState::BindTexture(GL_TEXTURE_2D, gBuffer.colorAttachment[2]);
+        glUniform1i(glGetUniformLocation(program, "uPosition"), 2);
 
-    glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
-
-    glBindVertexArray(0);
-    glUseProgram(0);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::ActiveTexture(GL_TEXTURE3);
+        GLState::BindTexture(GL_TEXTURE_2D, gBuffer.colorAttachment[3]);
+        glUniform1i(glGetUniformLocation(program, "uViewDir"), 3);
+    }
 }
\ No newline at end of file
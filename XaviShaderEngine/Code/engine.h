@@ -7,8 +7,73 @@
 #include "platform.h"
 #include "BufferSupFuncs.h"
 #include "ModelLoadingFuncs.h"
+#include "OcclusionCullingFuncs.h"
+#include "TransformBatchFuncs.h"
+#include "JobSystemFuncs.h"
+#include "DrawListFuncs.h"
+#include "GLStateFuncs.h"
+#include "SceneGraphFuncs.h"
+#include "EntityStoreFuncs.h"
+#include "SceneLoadingFuncs.h"
+#include "GpuProfilerFuncs.h"
+#include "ClusteredLightingFuncs.h"
+#include "LightVolumeFuncs.h"
+#include "GBufferLayoutFuncs.h"
+#include "RenderTargetFuncs.h"
+#include "FrameGraphFuncs.h"
+#include "ShadowCascadeFuncs.h"
+#include "PointShadowFuncs.h"
+#include "StressSceneFuncs.h"
+#include "OceanFuncs.h"
+#include "ScreenSpaceReflectionFuncs.h"
+#include "WaterMaskFuncs.h"
+#include "AmbientOcclusionFuncs.h"
 #include "Globals.h"
 
+// Uniform ring: one region per frame in flight, sized for the passes that upload per frame
+#define UNIFORM_RING_FRAMES 3
+#define UNIFORM_PASSES_PER_FRAME 2
+
+// The reflection view keeps this much past the water plane, so the distorted lookups still find the shore
+#define WATER_CLIP_PLANE_OFFSET 0.05f
+
+// The water views update every frame above the first screen coverage, every other frame above the second and every
+// WATER_VIEW_MAX_INTERVAL frames below it. The water shader reprojects the last update in between
+#define WATER_VIEW_FULL_RATE_COVERAGE 0.5f
+#define WATER_VIEW_HALF_RATE_COVERAGE 0.15f
+#define WATER_VIEW_MAX_INTERVAL 4
+// Camera travel since the last update, relative to its height over the water, and turn that force an update
+#define WATER_VIEW_MAX_TRAVEL 0.05f
+#define WATER_VIEW_MAX_TURN_DEG 10.0f
+
+// Screen area of the water: grown by the most the water shader distorts its lookups, in texture coordinates, and
+// with the ocean waves up to this height above and below the plane
+#define WATER_SCREEN_MARGIN 0.06f
+#define WATER_WAVE_HEIGHT_BOUND 1.0f
+
+// Where the water reflection comes from. The planar view renders the scene again and is kept for the high quality
+// setting, screen space traces the main pass
+enum WaterReflectionMode
+{
+    WaterReflection_ScreenSpace,
+    WaterReflection_Planar,
+    WaterReflection_Count
+};
+
+// Size of uLight in the forward and G-buffer shaders, the deferred lighting reads every light from clusters
+#define MAX_SHADER_LIGHTS 16
+
+// Albedo, octahedral normals and the hardware depth instead of the five attachment G-buffer, 0 for the old layout.
+// Every shader is compiled with COMPACT_GBUFFER defined when it is set
+#define COMPACT_GBUFFER 1
+
+// Frames a new window size has to hold before the render targets follow it
+#define RENDER_TARGET_RESIZE_FRAMES 10
+
+// Authoring scene and the binary one compiled from it, relative to the working directory
+#define SCENE_TEXT_FILE "Assets/Default.scene"
+#define SCENE_BINARY_FILE "Assets/Default.sceneb"
+
 const VertexV3V2 vertices[] = {
 	{glm::vec3(-1.0,-1.0,0.0), glm::vec2(0.0,0.0)},
 	{glm::vec3(1.0,-1.0,0.0), glm::vec2(1.0,0.0)},
@@ -42,20 +107,41 @@ struct App
         float zFar = 1000.0;
         float zNear = 0.1;
 
+        vec4 clipPlane = vec4(0.0f); // world space, replaces the near plane when set
     };
     bool firstClick;
 
+    EntityId CreateEntity(u32 modelIndex, const vec3& position, const vec3& scale, u8 passMask = RenderPass_All, u32 parentNode = SCENE_NO_PARENT);
+    EntityId CreateEntities(u32 count, const u32* modelIndices, u32 firstNode, u8 passMask);
+    void DestroyEntity(EntityId entity);
+    void ApplyTransformChanges();
+
     void UpdateEntityBuffer(Camera* camera);
-    void UpdateEntityBufferWithWater(Camera* camera);
+    void UploadEntityParams(const glm::mat4& viewProjection);
+
+    void ConfigureFrameBuffer(FrameBuffer& aConfigFb, ivec2 size);
+    void BindGBuffer(const FrameBuffer& gBuffer, GLuint program, const Camera& camera);
 
-    void ConfigureFrameBuffer(FrameBuffer& aConfigFb);
+    void BuildDrawList(DrawList& list, const Program& aBindedProgram);
+    DrawView MakeDrawView();
 
-    void RenderGeometry(const Program& aBindedProgram, vec4 clippingPlane);
-    void RenderGeometryWithWater(const Program& aBindedProgram);
+    void RenderGeometry(const Program& aBindedProgram);
+    // every packet of the draw list, the rows the water views share and the main only ones
+    void RenderMainPassGeometry(const Program& aBindedProgram);
 
-    const GLuint CreateTexture(const bool isFloatingPoint = false);
+    void SplitWaterViewDrawList(const DrawList& list);
+    void RenderReflectionGeometry(const Program& aBindedProgram);
 
-    void ConfigureSingleFrameBuffer(FrameBuffer& ssaoFB);
+    void RenderShadowCascades();
+    void RenderPointShadows();
+
+    void BuildCullingBatches(const Program& aBindedProgram);
+    void RenderMainPassGeometryCulled(const Program& aBindedProgram, Camera* camera);
+
+    // Every screen sized target, taken from and given back to renderTargets
+    void CreateRenderTargets();
+    void ReleaseRenderTargets();
+    void UpdateRenderTargetSize();
 
     // Loop
     f32  deltaTime;
@@ -71,6 +157,17 @@ struct App
 
     ivec2 displaySize;
 
+    // Screen targets are renderSize, it follows displaySize once a resize settles. Until then the passes that
+    // reach the back buffer stretch them
+    RenderTargetPool renderTargets;
+
+    // Passes of the deferred path, the SSAO, blur, scene color and light accumulation are its transients
+    RenderGraph frameGraph;
+    bool inspectTransientTargets = false;
+    ivec2 renderSize;
+    ivec2 pendingRenderSize;
+    u32 pendingRenderSizeFrames = 0;
+
     std::vector<Texture>    textures;
     std::vector<Material>   materials;
     std::vector<Mesh>       meshes;
@@ -81,10 +178,19 @@ struct App
     GLuint renderToBackBuffer;
     GLuint renderToFrameBuffer;
     GLuint frameBufferToQuadShader;
+    GLuint ssaoDownsampleShader;
     GLuint ssaoShader;
     GLuint ssaoBlurShader;
+    GLuint ssaoUpsampleShader;
     GLuint frameBufferToQuadShaderSSAO;
     GLuint waterShader;
+    GLuint renderToFrameBufferIndirect;
+    GLuint hiZBuildShader;
+    GLuint hiZCullShader;
+    GLuint lightClusterShader;
+    GLuint lightVolumeShader;
+    GLuint shadowDepthShader;
+    GLuint waterMaskShader;
     u32 patricioModel = 0;
     GLuint texturedMeshProgram_uTexture;
 
@@ -114,45 +220,112 @@ struct App
 
     GLint maxUniformBufferSize;
     GLint uniformBlockAlignment;//alignemnt entre uniform block no entre las variables
-    Buffer localUniformBuffer;//donde estan todos las variables de los patricios
-    std::vector<Entity> entities; // iteracion rapida
+    RingBuffer localUniformBuffer;//donde estan todos las variables de los patricios
     std::vector<Entity> lightEntities; // iteracion rapida
     std::vector<Light> lights; // iteracion rapida
-    Entity water;
-    std::vector<Entity> entitiesWithWater; // iteracion rapida
+    EntityStore entityStore;
+    EntityId waterEntity;
+    TransformHierarchy transforms;
+    TransformSoA entityTransforms; // world matrices by entity row, for the batched upload
+    bool cullingBatchesDirty = true;
+    std::string transformBenchmarkReport;
+    std::string entityBenchmarkReport;
+    StressSceneParams stressParams = { 1000, 16, false, false, 1 };
+    StressScene stressScene;
+    StressSweep stressSweep;
+    DrawList drawList;
+    // the packets of the reflection view by side of the water plane, it skips the ones below
+    DrawList aboveWaterDrawList;
+    DrawList belowWaterDrawList;
+    DrawList acrossWaterDrawList;
 
     GLuint globalPatamsOffset;
     GLuint globalPatamsSize;
+    u32 localParamsOffset; // start of the entity blocks of the last UploadEntityParams
 
     FrameBuffer defferedFrameBuffer;
-    FrameBuffer ssaoFrameBuffer;
-    FrameBuffer ssaoBlurFrameBuffer;
+    std::string gBufferReport;
 
     Camera cam; // camera
-    Camera camInv;
-
-    float iTime = 0;
-
-    // SSAO variables
-    float sampleRadius = 0.5f;
-    float ssaoBias = 0.02f;
+    Camera camInv; // mirrored below the water plane, clipped at it
 
-    void KernelRotationVectors();
-    GLuint ssaoNoiseTexture;
+    float iTime = 0; // seconds of ocean animation
 
+    // SSAO
+    AmbientOcclusion ambientOcclusion;
     bool displaySSAO = true;
 
     // Water
+    // The water is drawn over the lit frame and refracts a copy of it, the main pass is rendered without it
     FrameBuffer waterReflectionFrameBuffer;
-    FrameBuffer waterRefractionFrameBuffer;
-    FrameBuffer waterReflectionDefferedFrameBuffer;
-    FrameBuffer waterRefractionDefferedFrameBuffer;
-    FrameBuffer waterFrameBuffer;
+    u32 waterViewDivisor = 2; // 1, 2 or 4, the water shader upsamples it
+    ivec2 waterViewSize;
     u32 waterDudvMap;
-
-    void WaterPass(Camera* camera, GLenum ca, bool isReflectionPart);
+    GLuint reflectionLitView; // after lighting, kept for the frames without an update
+
+    // without the planar reflection no water view is rendered
+    WaterReflectionMode waterReflectionMode = WaterReflection_ScreenSpace;
+    ReflectionDepth reflectionDepth;
+    f64 waterReflectionMs[WaterReflection_Count] = {}; // GPU time of the water passes, last measured in each mode
+
+    // water view schedule, from the main frustum and camera motion
+    bool amortizeWaterViews = true;
+    bool waterVisible = true;
+    bool updateWaterViews = true; // this frame
+    bool waterViewsValid = false; // nothing to reproject after the targets are recreated
+    f32 waterCoverage = 1.0f; // of the screen, by the bounds of the water box
+    u32 waterViewInterval = 1;
+    u32 waterViewAge = 0; // frames since the last update
+    glm::mat4 reflectionViewProjection; // of the last update, the water shader reprojects into it
+    glm::mat4 reflectionProjectionInv;
+    vec3 waterUpdatePosition; // main camera at the last update
+    vec3 waterUpdateFront;
+
+    // the passes of the water shade only the rectangle it can reach, the reflection view also only the outline
+    bool restrictWaterToScreenArea = true;
+    bool useWaterStencil = true;
+    WaterScreenArea waterScreenArea; // main view, this frame
+    WaterScreenArea reflectionScreenArea; // reflection view, its last update
+
+    // FFT ocean on a camera centered grid in place of the water quad, deferred mode only
+    bool useOcean = true;
+    OceanSimulation ocean;
+    OceanGrid oceanGrid;
+    std::string oceanBenchmarkReport;
+
+    glm::mat4 OceanMatrix();
+
+    glm::mat4 WaterMatrix();
+    void WaterBounds(vec3& boxMin, vec3& boxMax);
+    void ScheduleWaterViews(const glm::mat4& viewProjection);
+    void WaterPass(Camera* camera);
 
     u32 renderBuffers = 0;
+
+    // Frame timings, the CPU one from the start of Update to the end of Render
+    GpuTimers gpuTimers;
+    f64 cpuFrameStart;
+    f64 cpuFrameMs;
+
+    // Point lights binned into view-space clusters for the deferred lighting pass
+    LightClusters lightClusters;
+
+    // Stencil-masked point light spheres instead, for when compute is not an option
+    bool useLightVolumes = false;
+    LightVolumeRenderer lightVolumes;
+
+    // Cascaded shadows of the first directional light
+    bool useShadows = true;
+    CascadedShadowMap shadowMap;
+    DrawList shadowDrawList;
+
+    // Point light cube shadows in a shared atlas, a few lights rendered per frame
+    bool usePointShadows = true;
+    PointShadowAtlas pointShadows;
+
+    // GPU occlusion culling of the main G-buffer pass
+    bool useGpuCulling = true;
+    GpuCulling gpuCulling;
 };
 
 void Init(App* app);
@@ -163,6 +336,4 @@ void Update(App* app);
 
 void Render(App* app);
 
-
-// SSAO
-std::vector<vec3> SamplePositionsInTangent();
\ No newline at end of file
+void Shutdown(App* app);
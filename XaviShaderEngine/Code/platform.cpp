@@ -12,6 +12,8 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -145,7 +147,7 @@ void OnGlfwCloseWindow(GLFWwindow* window)
     app->isRunning = false;
 }
 
-int main()
+int main(int argc, char** argv)
 {
     App app = {};
     app.deltaTime = 1.0f / 60.0f;
@@ -231,6 +233,7 @@ int main()
     GlobalFrameArenaMemory = (u8*)malloc(GLOBAL_FRAME_ARENA_SIZE);
 
     Init(&app);
+    StressTest::ParseCommandLine(&app, argc, argv);
 
     while (app.isRunning)
     {
@@ -293,6 +296,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    Shutdown(&app);
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -430,6 +435,91 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     return 0;
 }
 
+MappedFile MapFile(const char* filepath)
+{
+    MappedFile file = {};
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        ELOG("CreateFileA() failed mapping file %s", filepath);
+        return file;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(fileHandle, &fileSize);
+
+    HANDLE mappingHandle = fileSize.QuadPart > 0 ? CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    const u8* data = mappingHandle ? (const u8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data)
+    {
+        ELOG("MapViewOfFile() failed mapping file %s", filepath);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.data = data;
+    file.size = fileSize.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mappingHandle = mappingHandle;
+#else
+    // NOTE: This has not been tested in unix-like systems
+    int fd = open(filepath, O_RDONLY);
+    struct stat attrib;
+    if (fd < 0 || fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        ELOG("open() failed mapping file %s", filepath);
+        if (fd >= 0) close(fd);
+        return file;
+    }
+
+    void* data = mmap(NULL, attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        ELOG("mmap() failed mapping file %s", filepath);
+        return file;
+    }
+
+    file.data = (const u8*)data;
+    file.size = attrib.st_size;
+#endif
+
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (!file.data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = {};
+}
+
+bool WriteBinaryFile(const char* filepath, const void* data, u64 size)
+{
+    FILE* file = fopen(filepath, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing file %s", filepath);
+        return false;
+    }
+
+    bool written = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    return written;
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
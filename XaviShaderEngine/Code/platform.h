@@ -33,6 +33,27 @@ String ReadTextFile(const char *filepath);
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+struct MappedFile
+{
+    const u8* data;
+    u64       size;
+    void*     fileHandle;
+    void*     mappingHandle;
+};
+
+/**
+ * Maps a whole file read-only into memory, data is NULL if it could not be opened.
+ * The view stays valid until UnmapFile, nothing is copied.
+ */
+MappedFile MapFile(const char *filepath);
+
+void UnmapFile(MappedFile& file);
+
+/**
+ * Writes (or overwrites) a file with the given bytes. Returns false on failure.
+ */
+bool WriteBinaryFile(const char *filepath, const void *data, u64 size);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
@@ -14,87 +14,250 @@ void main()
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
+// same grid as ClusteredLightingFuncs.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 256
+
 struct Light
 {
-    uint type;
-    vec3 color;
-    vec3 direction;
-    vec3 position;
+    vec4 positionRadius;
+    vec4 colorType;
+    vec4 direction;
 };
 
-layout(binding = 0, std140) uniform GlobalsParams
+layout(binding = 3, std430) readonly buffer Lights
 {
-    vec3 uCamPosition;
-    uint uLightCount;
-    Light uLight[16];
+    Light uLights[];
 };
 
+layout(binding = 4, std430) readonly buffer ClusterLightCounts
+{
+    uint uClusterCounts[];
+};
+
+layout(binding = 5, std430) readonly buffer ClusterLightIndices
+{
+    uint uClusterIndices[];
+};
+
+uniform uint uDirectionalLightCount;
+uniform mat4 uView;
+uniform vec2 uViewportSize;
+uniform float uZNear;
+uniform float uZFar;
+uniform vec3 uAttenuation; // constant, linear and quadratic
+
+// same as ShadowCascadeFuncs.h
+#define SHADOW_CASCADE_COUNT 4
+
+uniform sampler2DArrayShadow uShadowMap;
+uniform mat4 uShadowMatrices[SHADOW_CASCADE_COUNT];
+uniform vec4 uCascadeSplits; // view depth where each cascade ends
+uniform bool uShadowsEnabled;
+
+// same as PointShadowFuncs.h, by index in the light list of the scene
+struct PointShadow
+{
+    vec4 faceRects[6]; // atlas uv offset and size of each cube face
+    vec4 params; // near, far, 1 when the tiles hold a shadow
+};
+
+layout(binding = 6, std430) readonly buffer PointShadows
+{
+    PointShadow uPointShadows[];
+};
+
+uniform sampler2DShadow uPointShadowAtlas;
+uniform bool uPointShadowsEnabled;
+
 in vec2 vTexCoord;
 
 uniform sampler2D uAlbedo;
 uniform sampler2D uNormals;
+#ifdef COMPACT_GBUFFER
+uniform sampler2D uDepth;
+uniform mat4 uInverseViewProjection; // of the camera that rendered the G-buffer
+uniform vec3 uCameraPosition;
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    vec2 e = encoded * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+
+vec3 GBufferNormal(vec2 texCoord)
+{
+    return DecodeNormal(texture(uNormals, texCoord).xy);
+}
+
+vec3 GBufferPosition(vec2 texCoord)
+{
+    vec4 position = uInverseViewProjection * vec4(vec3(texCoord, texture(uDepth, texCoord).x) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+vec3 GBufferViewDir(vec2 texCoord, vec3 position)
+{
+    return uCameraPosition - position;
+}
+#else
 uniform sampler2D uPosition;
 uniform sampler2D uViewDir;
+
+vec3 GBufferNormal(vec2 texCoord)
+{
+    return texture(uNormals, texCoord).xyz;
+}
+
+vec3 GBufferPosition(vec2 texCoord)
+{
+    return texture(uPosition, texCoord).xyz;
+}
+
+vec3 GBufferViewDir(vec2 texCoord, vec3 position)
+{
+    return texture(uViewDir, texCoord).xyz;
+}
+#endif
+
 uniform sampler2D uAO;
 
 layout(location = 0) out vec4 oColor; // aqui se podria añadir mas como onormals
 
-void CalculateBlitVars(in Light light, out vec3 ambient, out vec3 diffuse, out vec3 specular)
+// 1 lit, 0 in shadow. A cached cascade may not cover the pixel yet, then the next one is tried
+float ShadowFactor(vec3 position, float viewDepth)
 {
-    vec3 vNormal = texture(uNormals, vTexCoord).xyz;
-    vec3 vViewDir = texture(uViewDir, vTexCoord).xyz;
-    vec3 lightDir = normalize(light.direction);
+    if (!uShadowsEnabled)
+        return 1.0;
+
+    int firstCascade = SHADOW_CASCADE_COUNT;
+    for (int c = SHADOW_CASCADE_COUNT - 1; c >= 0; --c)
+        if (viewDepth <= uCascadeSplits[c])
+            firstCascade = c;
+
+    for (int c = firstCascade; c < SHADOW_CASCADE_COUNT; ++c)
+    {
+        vec4 shadowPosition = uShadowMatrices[c] * vec4(position, 1.0);
+        vec3 shadowCoord = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+        if (any(lessThan(shadowCoord, vec3(0.0))) || any(greaterThan(shadowCoord, vec3(1.0))))
+            continue;
+
+        // 3x3 taps, the comparison sampler already filters each one 2x2
+        vec2 texelSize = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+        float lit = 0.0;
+        for (int x = -1; x <= 1; ++x)
+            for (int y = -1; y <= 1; ++y)
+                lit += texture(uShadowMap, vec4(shadowCoord.xy + vec2(x, y) * texelSize, float(c), shadowCoord.z - 0.0005));
+        return lit / 9.0;
+    }
+    return 1.0;
+}
+
+// same faces as PointShadowFuncs.cpp
+const vec3 cubeFaceForward[6] = vec3[](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 cubeFaceUp[6] = vec3[](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+// 1 lit, 0 in shadow. The face is the major axis from the light, projected the way its tile was rendered
+float PointShadowFactor(uint shadowIndex, vec3 lightPosition, vec3 position)
+{
+    if (!uPointShadowsEnabled)
+        return 1.0;
+
+    PointShadow shadow = uPointShadows[shadowIndex];
+    if (shadow.params.z == 0.0)
+        return 1.0;
+
+    vec3 fromLight = position - lightPosition;
+    vec3 axis = abs(fromLight);
+    int face = axis.x >= axis.y && axis.x >= axis.z ? (fromLight.x > 0.0 ? 0 : 1) : (axis.y >= axis.z ? (fromLight.y > 0.0 ? 2 : 3) : (fromLight.z > 0.0 ? 4 : 5));
 
+    vec3 forward = cubeFaceForward[face];
+    vec3 side = normalize(cross(forward, cubeFaceUp[face]));
+    vec3 up = cross(side, forward);
+    float depth = dot(forward, fromLight);
+    vec2 faceCoord = vec2(dot(side, fromLight), dot(up, fromLight)) / depth * 0.5 + 0.5;
+
+    // perspective depth of the face projection, near and far as in the tile render
+    float n = shadow.params.x;
+    float f = shadow.params.y;
+    float windowDepth = ((f + n) / (f - n) - 2.0 * f * n / ((f - n) * depth)) * 0.5 + 0.5;
+
+    // half a texel inside the tile, the filter never reads the next one
+    vec4 rect = shadow.faceRects[face];
+    vec2 halfTexel = 0.5 / vec2(textureSize(uPointShadowAtlas, 0));
+    vec2 atlasCoord = rect.xy + clamp(faceCoord * rect.zw, halfTexel, rect.zw - halfTexel);
+    return texture(uPointShadowAtlas, vec3(atlasCoord, windowDepth - 0.0005));
+}
+
+void CalculateBlitVars(vec3 color, vec3 lightDir, vec3 vNormal, vec3 vViewDir, out vec3 ambient, out vec3 diffuse, out vec3 specular)
+{
     float ambientStrenght = 0.2;
-    ambient = ambientStrenght * light.color * texture(uAO, vTexCoord).z;
+    ambient = ambientStrenght * color * texture(uAO, vTexCoord).z;
 			
     float diff = max(dot(vNormal,lightDir),0.0f);
-    diffuse = diff * light.color;
+    diffuse = diff * color;
 
     float specularStrenght = 0.1f;
     vec3 reflectDir = reflect(-lightDir,vNormal);
     vec3 normalViewDir = normalize(vViewDir);
     float spec = pow(max(dot(normalViewDir, reflectDir),0.0f),32);
-    specular = specularStrenght * spec * light.color;
+    specular = specularStrenght * spec * color;
 
 }
 
 void main()
 {
     vec4 textureColor = texture(uAlbedo, vTexCoord);
+    vec3 position = GBufferPosition(vTexCoord);
+    vec3 normal = GBufferNormal(vTexCoord);
+    vec3 viewDir = GBufferViewDir(vTexCoord, position);
     vec4 finalColor = vec4(0.0f);
 
-    for(int i = 0; i < uLightCount; ++i)
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+
+    float viewDepth = max(-(uView * vec4(position, 1.0)).z, uZNear);
+
+    //directional lights light every pixel, the first one casts the shadows
+    for(uint i = 0; i < uDirectionalLightCount; ++i)
+    {
+        Light light = uLights[i];
+        CalculateBlitVars(light.colorType.rgb, normalize(light.direction.xyz), normal, viewDir, ambient, diffuse, specular);
+
+        float shadow = i == 0 ? ShadowFactor(position, viewDepth) : 1.0;
+        vec3 lightResult = ambient + (diffuse + specular) * shadow;
+        finalColor += vec4(lightResult, 1.0) * textureColor;
+    }
+
+    //point lights, only the ones binned in the cluster of this pixel
+    uint slice = min(uint(log(viewDepth / uZNear) / log(uZFar / uZNear) * CLUSTER_GRID_Z), uint(CLUSTER_GRID_Z - 1));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / uViewportSize * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    uint cluster = tile.x + tile.y * CLUSTER_GRID_X + slice * CLUSTER_GRID_X * CLUSTER_GRID_Y;
+
+    uint lightCount = uClusterCounts[cluster];
+    for(uint i = 0; i < lightCount; ++i)
     {
-        Light light = uLight[i];
-        vec3 lightResult = vec3(0.0f);
+        Light light = uLights[uClusterIndices[cluster * CLUSTER_MAX_LIGHTS + i]];
+
+        vec3 toLight = light.positionRadius.xyz - position;
+        float distance = length(toLight);
+        float attenuation = 1.0 / (uAttenuation.x + uAttenuation.y * distance + uAttenuation.z * (distance * distance));
 
-        vec3 ambient = vec3(0.0);
-        vec3 diffuse = vec3(0.0);
-        vec3 specular = vec3(0.0);
-        if(uLight[i].type == 0) //directional light
-        {
-        CalculateBlitVars(light, ambient, diffuse, specular);
+        // fades to zero at the radius, so the lights outside the cluster add nothing
+        float window = clamp(1.0 - pow(distance / light.positionRadius.w, 4.0), 0.0, 1.0);
+        attenuation *= window * window;
 
-        lightResult = ambient + diffuse + specular;
+        CalculateBlitVars(light.colorType.rgb, toLight / max(distance, 0.0001), normal, viewDir, ambient, diffuse, specular);
+
+        float shadow = PointShadowFactor(uint(light.direction.w), light.positionRadius.xyz, position);
+        vec3 lightResult = (ambient + (diffuse + specular) * shadow) * attenuation;
         finalColor += vec4(lightResult, 1.0) * textureColor;
-			
-        }
-        else //point light, Todo podria ser una funcio
-        {
-            //Light light = uLight[i];
-
-            float constant = 1.0f;
-            float lineal = 0.09f;
-            float quadratic = 0.032f;
-            float distance = length(light.position - texture(uPosition, vTexCoord).xyz);
-            float attenuation = 1.0 / (constant + lineal * distance + quadratic * (distance * distance));
-
-            CalculateBlitVars(light, ambient, diffuse, specular);
-
-            lightResult = (ambient * attenuation) + (diffuse * attenuation) + (specular * attenuation);
-            finalColor += vec4(lightResult, 1.0) * textureColor;
-        }
     }
     oColor = finalColor;
 }
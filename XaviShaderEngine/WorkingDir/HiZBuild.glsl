@@ -0,0 +1,56 @@
+#ifdef HIZ_BUILD
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D uSource;
+uniform int uSourceLevel; // -1 reads the depth attachment
+uniform ivec2 uSourceSize;
+uniform bool uKeepNearest; // the reflection tracer skips what is in front of the nearest depth, culling needs the farthest
+layout(binding = 0, r32f) writeonly uniform image2D uDestination;
+
+float FetchDepth(ivec2 texel)
+{
+    return texelFetch(uSource, min(texel, uSourceSize - 1), uSourceLevel).r;
+}
+
+float Reduce(float a, float b)
+{
+    return uKeepNearest ? min(a, b) : max(a, b);
+}
+
+void main()
+{
+    ivec2 destinationSize = imageSize(uDestination);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= destinationSize.x || texel.y >= destinationSize.y)
+        return;
+
+    float depth;
+    if (uSourceLevel < 0)
+    {
+        depth = texelFetch(uSource, texel, 0).r;
+    }
+    else
+    {
+        ivec2 base = texel * 2;
+        depth = Reduce(Reduce(FetchDepth(base), FetchDepth(base + ivec2(1, 0))),
+                       Reduce(FetchDepth(base + ivec2(0, 1)), FetchDepth(base + ivec2(1, 1))));
+
+        // odd sized levels fold the extra row and column into the last texel
+        bool extraColumn = (uSourceSize.x & 1) != 0 && texel.x == destinationSize.x - 1;
+        bool extraRow = (uSourceSize.y & 1) != 0 && texel.y == destinationSize.y - 1;
+        if (extraColumn)
+            depth = Reduce(depth, Reduce(FetchDepth(base + ivec2(2, 0)), FetchDepth(base + ivec2(2, 1))));
+        if (extraRow)
+            depth = Reduce(depth, Reduce(FetchDepth(base + ivec2(0, 2)), FetchDepth(base + ivec2(1, 2))));
+        if (extraColumn && extraRow)
+            depth = Reduce(depth, FetchDepth(base + ivec2(2, 2)));
+    }
+
+    imageStore(uDestination, texel, vec4(depth));
+}
+
+#endif
+#endif
@@ -0,0 +1,113 @@
+#ifdef HIZ_CULL
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 64) in;
+
+struct InstanceData
+{
+    mat4 worldMatrix;
+    vec4 boundingSphere;
+    uint firstBatch;
+    uint batchCount;
+    uint padding0;
+    uint padding1;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout(binding = 0, std430) readonly buffer Instances
+{
+    InstanceData uInstances[];
+};
+
+layout(binding = 1, std430) writeonly buffer VisibleInstances
+{
+    uint uVisible[];
+};
+
+layout(binding = 2, std430) buffer DrawCommands
+{
+    DrawCommand uCommands[];
+};
+
+uniform uint uInstanceCount;
+uniform vec4 uFrustumPlanes[6];
+uniform mat4 uPrevViewProjection;
+uniform bool uUseOcclusion;
+uniform sampler2D uHiZ;
+uniform vec2 uHiZSize;
+uniform int uHiZMaxLevel;
+
+bool IsOccluded(vec4 sphere)
+{
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearestDepth = 1.0;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clipPosition = uPrevViewProjection * vec4(corner, 1.0);
+
+        // crossing the near plane, the screen rect is unbounded
+        if (clipPosition.w <= 0.0)
+            return false;
+
+        vec3 ndc = clipPosition.xyz / clipPosition.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+    }
+
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+
+    // pick the level where the rect covers at most 2x2 texels
+    vec2 extent = (uvMax - uvMin) * uHiZSize;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, uHiZMaxLevel);
+    ivec2 levelSize = textureSize(uHiZ, level);
+    ivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float farthestDepth = max(max(texelFetch(uHiZ, texelMin, level).r, texelFetch(uHiZ, ivec2(texelMax.x, texelMin.y), level).r),
+                              max(texelFetch(uHiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(uHiZ, texelMax, level).r));
+
+    return nearestDepth > farthestDepth;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uInstanceCount)
+        return;
+
+    vec4 sphere = uInstances[index].boundingSphere;
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(uFrustumPlanes[i].xyz, sphere.xyz) + uFrustumPlanes[i].w < -sphere.w)
+            return;
+    }
+
+    if (uUseOcclusion && IsOccluded(sphere))
+        return;
+
+    uint firstBatch = uInstances[index].firstBatch;
+    uint lastBatch = firstBatch + uInstances[index].batchCount;
+    for (uint batch = firstBatch; batch < lastBatch; ++batch)
+    {
+        uint slot = atomicAdd(uCommands[batch].instanceCount, 1u);
+        uVisible[uCommands[batch].baseInstance + slot] = index;
+    }
+}
+
+#endif
+#endif
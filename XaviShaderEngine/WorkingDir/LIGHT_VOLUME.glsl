@@ -0,0 +1,215 @@
+#ifdef LIGHT_VOLUME
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+
+uniform mat4 uWorldViewProjection;
+uniform bool uFullscreen; // directional lights draw the screen quad, point lights their sphere
+
+void main()
+{
+    gl_Position = uFullscreen ? vec4(aPosition, 1.0) : uWorldViewProjection * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+uniform sampler2D uAlbedo;
+uniform sampler2D uNormals;
+uniform sampler2D uAO;
+uniform bool uUseAO;
+
+#ifdef COMPACT_GBUFFER
+uniform sampler2D uDepth;
+uniform mat4 uInverseViewProjection; // of the camera that rendered the G-buffer
+uniform vec3 uCameraPosition;
+
+vec3 DecodeNormal(vec2 encoded)
+{
+    vec2 e = encoded * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+
+vec3 GBufferNormal(vec2 texCoord)
+{
+    return DecodeNormal(texture(uNormals, texCoord).xy);
+}
+
+vec3 GBufferPosition(vec2 texCoord)
+{
+    vec4 position = uInverseViewProjection * vec4(vec3(texCoord, texture(uDepth, texCoord).x) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+vec3 GBufferViewDir(vec2 texCoord, vec3 position)
+{
+    return uCameraPosition - position;
+}
+#else
+uniform sampler2D uPosition;
+uniform sampler2D uViewDir;
+
+vec3 GBufferNormal(vec2 texCoord)
+{
+    return texture(uNormals, texCoord).xyz;
+}
+
+vec3 GBufferPosition(vec2 texCoord)
+{
+    return texture(uPosition, texCoord).xyz;
+}
+
+vec3 GBufferViewDir(vec2 texCoord, vec3 position)
+{
+    return texture(uViewDir, texCoord).xyz;
+}
+#endif
+
+uniform vec2 uViewportSize;
+uniform vec3 uAttenuation; // constant, linear and quadratic
+uniform mat4 uView;
+
+// same as ShadowCascadeFuncs.h
+#define SHADOW_CASCADE_COUNT 4
+
+uniform sampler2DArrayShadow uShadowMap;
+uniform mat4 uShadowMatrices[SHADOW_CASCADE_COUNT];
+uniform vec4 uCascadeSplits; // view depth where each cascade ends
+uniform bool uShadowsEnabled;
+uniform bool uCastsShadow;
+
+// same as PointShadowFuncs.h, by index in the light list of the scene
+struct PointShadow
+{
+    vec4 faceRects[6]; // atlas uv offset and size of each cube face
+    vec4 params; // near, far, 1 when the tiles hold a shadow
+};
+
+layout(binding = 6, std430) readonly buffer PointShadows
+{
+    PointShadow uPointShadows[];
+};
+
+uniform sampler2DShadow uPointShadowAtlas;
+uniform bool uPointShadowsEnabled;
+
+uniform uint uLightType;
+uniform vec3 uLightColor;
+uniform vec3 uLightDirection;
+uniform vec4 uLightPositionRadius;
+uniform uint uLightIndex;
+
+layout(location = 0) out vec4 oColor;
+
+// 1 lit, 0 in shadow. A cached cascade may not cover the pixel yet, then the next one is tried
+float ShadowFactor(vec3 position, float viewDepth)
+{
+    if (!uShadowsEnabled)
+        return 1.0;
+
+    int firstCascade = SHADOW_CASCADE_COUNT;
+    for (int c = SHADOW_CASCADE_COUNT - 1; c >= 0; --c)
+        if (viewDepth <= uCascadeSplits[c])
+            firstCascade = c;
+
+    for (int c = firstCascade; c < SHADOW_CASCADE_COUNT; ++c)
+    {
+        vec4 shadowPosition = uShadowMatrices[c] * vec4(position, 1.0);
+        vec3 shadowCoord = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+        if (any(lessThan(shadowCoord, vec3(0.0))) || any(greaterThan(shadowCoord, vec3(1.0))))
+            continue;
+
+        // 3x3 taps, the comparison sampler already filters each one 2x2
+        vec2 texelSize = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+        float lit = 0.0;
+        for (int x = -1; x <= 1; ++x)
+            for (int y = -1; y <= 1; ++y)
+                lit += texture(uShadowMap, vec4(shadowCoord.xy + vec2(x, y) * texelSize, float(c), shadowCoord.z - 0.0005));
+        return lit / 9.0;
+    }
+    return 1.0;
+}
+
+// same faces as PointShadowFuncs.cpp
+const vec3 cubeFaceForward[6] = vec3[](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 cubeFaceUp[6] = vec3[](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+// 1 lit, 0 in shadow. The face is the major axis from the light, projected the way its tile was rendered
+float PointShadowFactor(uint shadowIndex, vec3 lightPosition, vec3 position)
+{
+    if (!uPointShadowsEnabled)
+        return 1.0;
+
+    PointShadow shadow = uPointShadows[shadowIndex];
+    if (shadow.params.z == 0.0)
+        return 1.0;
+
+    vec3 fromLight = position - lightPosition;
+    vec3 axis = abs(fromLight);
+    int face = axis.x >= axis.y && axis.x >= axis.z ? (fromLight.x > 0.0 ? 0 : 1) : (axis.y >= axis.z ? (fromLight.y > 0.0 ? 2 : 3) : (fromLight.z > 0.0 ? 4 : 5));
+
+    vec3 forward = cubeFaceForward[face];
+    vec3 side = normalize(cross(forward, cubeFaceUp[face]));
+    vec3 up = cross(side, forward);
+    float depth = dot(forward, fromLight);
+    vec2 faceCoord = vec2(dot(side, fromLight), dot(up, fromLight)) / depth * 0.5 + 0.5;
+
+    // perspective depth of the face projection, near and far as in the tile render
+    float n = shadow.params.x;
+    float f = shadow.params.y;
+    float windowDepth = ((f + n) / (f - n) - 2.0 * f * n / ((f - n) * depth)) * 0.5 + 0.5;
+
+    // half a texel inside the tile, the filter never reads the next one
+    vec4 rect = shadow.faceRects[face];
+    vec2 halfTexel = 0.5 / vec2(textureSize(uPointShadowAtlas, 0));
+    vec2 atlasCoord = rect.xy + clamp(faceCoord * rect.zw, halfTexel, rect.zw - halfTexel);
+    return texture(uPointShadowAtlas, vec3(atlasCoord, windowDepth - 0.0005));
+}
+
+void main()
+{
+    vec2 texCoord = gl_FragCoord.xy / uViewportSize;
+    vec4 textureColor = texture(uAlbedo, texCoord);
+    vec3 position = GBufferPosition(texCoord);
+    vec3 vNormal = GBufferNormal(texCoord);
+    vec3 vViewDir = GBufferViewDir(texCoord, position);
+
+    vec3 lightDir = normalize(uLightDirection);
+    float attenuation = 1.0;
+    if (uLightType != 0) //point light
+    {
+        vec3 toLight = uLightPositionRadius.xyz - position;
+        float distance = length(toLight);
+        lightDir = toLight / max(distance, 0.0001);
+        attenuation = 1.0 / (uAttenuation.x + uAttenuation.y * distance + uAttenuation.z * (distance * distance));
+
+        // same fade to zero at the radius as the clustered path
+        float window = clamp(1.0 - pow(distance / uLightPositionRadius.w, 4.0), 0.0, 1.0);
+        attenuation *= window * window;
+    }
+
+    float ambientStrenght = 0.2;
+    vec3 ambient = ambientStrenght * uLightColor * (uUseAO ? texture(uAO, texCoord).z : 1.0);
+
+    float diff = max(dot(vNormal, lightDir), 0.0f);
+    vec3 diffuse = diff * uLightColor;
+
+    float specularStrenght = 0.1f;
+    vec3 reflectDir = reflect(-lightDir, vNormal);
+    float spec = pow(max(dot(normalize(vViewDir), reflectDir), 0.0f), 32);
+    vec3 specular = specularStrenght * spec * uLightColor;
+
+    float shadow = 1.0;
+    if (uCastsShadow)
+        shadow = ShadowFactor(position, -(uView * vec4(position, 1.0)).z);
+    else if (uLightType != 0)
+        shadow = PointShadowFactor(uLightIndex, uLightPositionRadius.xyz, position);
+    vec3 lightResult = (ambient + (diffuse + specular) * shadow) * attenuation;
+    oColor = vec4(lightResult, 1.0) * textureColor;
+}
+
+#endif
+#endif
@@ -0,0 +1,103 @@
+#ifdef LIGHT_CLUSTERS
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+// one work group per cluster, same grid as ClusteredLightingFuncs.h
+layout(local_size_x = 64) in;
+
+#define CLUSTER_MAX_LIGHTS 256
+
+struct Light
+{
+    vec4 positionRadius;
+    vec4 colorType;
+    vec4 direction;
+};
+
+layout(binding = 3, std430) readonly buffer Lights
+{
+    Light uLights[];
+};
+
+layout(binding = 4, std430) writeonly buffer ClusterLightCounts
+{
+    uint uClusterCounts[];
+};
+
+layout(binding = 5, std430) writeonly buffer ClusterLightIndices
+{
+    uint uClusterIndices[];
+};
+
+uniform mat4 uView;
+uniform mat4 uInverseProjection;
+uniform float uZNear;
+uniform float uZFar;
+uniform uint uFirstPointLight;
+uniform uint uLightCount;
+
+shared uint sLightCount;
+shared vec3 sBoundsMin;
+shared vec3 sBoundsMax;
+
+// view space point of the near plane behind an NDC position, scaled out to the given depth
+vec3 ViewPointAtDepth(vec2 ndc, float viewZ)
+{
+    vec4 nearPoint = uInverseProjection * vec4(ndc, -1.0, 1.0);
+    nearPoint /= nearPoint.w;
+    return nearPoint.xyz * (viewZ / nearPoint.z);
+}
+
+void main()
+{
+    uvec3 grid = gl_NumWorkGroups;
+    uvec3 cell = gl_WorkGroupID;
+    uint cluster = cell.x + cell.y * grid.x + cell.z * grid.x * grid.y;
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        sLightCount = 0;
+
+        // exponential slices, each one covers the same depth ratio
+        float sliceNear = -uZNear * pow(uZFar / uZNear, float(cell.z) / float(grid.z));
+        float sliceFar = -uZNear * pow(uZFar / uZNear, float(cell.z + 1) / float(grid.z));
+        vec2 ndcMin = vec2(cell.xy) / vec2(grid.xy) * 2.0 - 1.0;
+        vec2 ndcMax = vec2(cell.xy + 1) / vec2(grid.xy) * 2.0 - 1.0;
+
+        vec3 boundsMin = vec3(1e30);
+        vec3 boundsMax = vec3(-1e30);
+        for (int i = 0; i < 8; ++i)
+        {
+            vec2 ndc = vec2((i & 1) != 0 ? ndcMax.x : ndcMin.x, (i & 2) != 0 ? ndcMax.y : ndcMin.y);
+            vec3 corner = ViewPointAtDepth(ndc, (i & 4) != 0 ? sliceFar : sliceNear);
+            boundsMin = min(boundsMin, corner);
+            boundsMax = max(boundsMax, corner);
+        }
+        sBoundsMin = boundsMin;
+        sBoundsMax = boundsMax;
+    }
+    barrier();
+
+    for (uint lightIndex = uFirstPointLight + gl_LocalInvocationIndex; lightIndex < uLightCount; lightIndex += gl_WorkGroupSize.x)
+    {
+        vec4 positionRadius = uLights[lightIndex].positionRadius;
+        vec3 center = (uView * vec4(positionRadius.xyz, 1.0)).xyz;
+
+        // sphere against the cluster box
+        vec3 closest = clamp(center, sBoundsMin, sBoundsMax);
+        vec3 offset = center - closest;
+        if (dot(offset, offset) > positionRadius.w * positionRadius.w)
+            continue;
+
+        uint slot = atomicAdd(sLightCount, 1);
+        if (slot < CLUSTER_MAX_LIGHTS)
+            uClusterIndices[cluster * CLUSTER_MAX_LIGHTS + slot] = lightIndex;
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0)
+        uClusterCounts[cluster] = min(sLightCount, uint(CLUSTER_MAX_LIGHTS));
+}
+
+#endif
+#endif
@@ -16,6 +16,7 @@ struct Light
 	vec3 color;
 	vec3 direction;
 	vec3 position;
+	float radius;
 };
 
 layout(binding=0, std140) uniform GlobalsParams
@@ -54,6 +55,7 @@ struct Light
 	vec3 color;
 	vec3 direction;
 	vec3 position;
+	float radius;
 };
 
 layout(binding=0, std140) uniform GlobalsParams
@@ -70,6 +72,7 @@ in vec3 vViewDir;
 
 
 uniform sampler2D uTexture;
+uniform vec3 uAttenuation; // constant, linear and quadratic
 layout(location = 0) out vec4 oColor; // aqui se podria a�adir mas como onormals
 
 void CalculateBlitVars(in Light light, out vec3 ambient, out vec3 diffuse, out vec3 specular)
@@ -117,11 +120,12 @@ vec4 finalColor = vec4(0.0f);
 		else //point light, Todo podria ser una funcio
 		{
 	
-			float constant = 1.0f;
-			float lineal = 0.09f;
-			float quadratic = 0.032f;
 			float distance = length(light.position- vPosition);
-			float attenuation = 1.0/ (constant + lineal * distance + quadratic * (distance * distance));
+			float attenuation = 1.0/ (uAttenuation.x + uAttenuation.y * distance + uAttenuation.z * (distance * distance));
+
+			// same fade to zero at the radius as the deferred lighting
+			float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+			attenuation *= window * window;
 
 			CalculateBlitVars(light, ambient, diffuse, specular);
 
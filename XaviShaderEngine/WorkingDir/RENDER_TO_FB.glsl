@@ -6,9 +6,6 @@ layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 
-uniform vec4 clippingPlane;
-uniform mat4 viewMatrix;
-
 struct Light
 {
     uint type;
@@ -41,8 +38,6 @@ void main()
     vPosition = vec3(uWorldMatrix * vec4(aPosition, 1.0));
     vNormal =  vec3(uWorldMatrix * vec4(aNormal, 0.0));
     vViewDir = uCamPosition - vPosition;
-    vec4 clipDistanceDisplacement = vec4(0.0, 0.0, 0.0, length(vec3(viewMatrix * vec4(aPosition,1.0)) / 100));
-    gl_ClipDistance[0] = dot(uWorldMatrix * vec4(aPosition, 1.0), clippingPlane + clipDistanceDisplacement);
     gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 	
 }
@@ -72,10 +67,14 @@ in vec3 vViewDir;
 
 uniform sampler2D uTexture;
 layout(location = 0) out vec4 oAlbedo; // aqui se podria a�adir mas como onormals
+#ifdef COMPACT_GBUFFER
+layout(location = 1) out vec2 oNormals; // position, view direction and depth come back from the depth buffer
+#else
 layout(location = 1) out vec4 oNormals;
 layout(location = 2) out vec4 oPosition;
 layout(location = 3) out vec4 oViewDir;
 layout(location = 4) out vec4 oDepth;
+#endif
 
 uniform float near = 0.1f;  // Plano cercano de la cámara
 uniform float far = 100.0f;   // Plano lejano de la cámara
@@ -85,13 +84,27 @@ float LinearizeDepth(float depth)
     return (2.0 * near * far) / (far + near - z * (far - near));
 }
 
+#ifdef COMPACT_GBUFFER
+// octahedral normal in [0, 1], DecodeNormal in the shaders that read the G-buffer undoes it
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return (n.z >= 0.0 ? n.xy : folded) * 0.5 + 0.5;
+}
+#endif
+
 void main()
 {
     oAlbedo = texture(uTexture, vTexCoord);
+#ifdef COMPACT_GBUFFER
+    oNormals = EncodeNormal(normalize(vNormal));
+#else
     oNormals = vec4(vNormal, 1.0);
     oPosition = vec4(vPosition, 1.0);
     oViewDir = vec4(vViewDir,1.0);
     oDepth = vec4(vec3(LinearizeDepth(gl_FragCoord.z) / far), 1.0f);
+#endif
 }
 
 #endif
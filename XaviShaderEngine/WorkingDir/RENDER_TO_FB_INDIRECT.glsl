@@ -0,0 +1,115 @@
+#ifdef RENDER_TO_FB_INDIRECT
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec2 aTexCoord;
+
+struct Light
+{
+    uint type;
+    vec3 color;
+    vec3 direction;
+    vec3 position;
+};
+
+layout(binding = 0, std140) uniform GlobalsParams
+{
+    vec3 uCamPosition;
+    uint uLightCount;
+    Light uLight[16];
+};
+
+struct InstanceData
+{
+    mat4 worldMatrix;
+    vec4 boundingSphere;
+    uint firstBatch;
+    uint batchCount;
+    uint padding0;
+    uint padding1;
+};
+
+layout(binding = 0, std430) readonly buffer Instances
+{
+    InstanceData uInstances[];
+};
+
+// written by HiZCull.glsl, one compacted range per batch
+layout(binding = 1, std430) readonly buffer VisibleInstances
+{
+    uint uVisible[];
+};
+
+uniform uint uFirstInstance;
+uniform mat4 uViewProjection;
+
+out vec2 vTexCoord;
+out vec3 vPosition;
+out vec3 vNormal;
+out vec3 vViewDir;
+
+void main()
+{
+    uint instanceIndex = uVisible[uFirstInstance + uint(gl_InstanceID)];
+    mat4 worldMatrix = uInstances[instanceIndex].worldMatrix;
+
+    vTexCoord = aTexCoord;
+    vPosition = vec3(worldMatrix * vec4(aPosition, 1.0));
+    vNormal = vec3(worldMatrix * vec4(aNormal, 0.0));
+    vViewDir = uCamPosition - vPosition;
+    gl_Position = uViewProjection * vec4(vPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+in vec2 vTexCoord;
+in vec3 vPosition;
+in vec3 vNormal;
+in vec3 vViewDir;
+
+uniform sampler2D uTexture;
+layout(location = 0) out vec4 oAlbedo;
+#ifdef COMPACT_GBUFFER
+layout(location = 1) out vec2 oNormals; // position, view direction and depth come back from the depth buffer
+#else
+layout(location = 1) out vec4 oNormals;
+layout(location = 2) out vec4 oPosition;
+layout(location = 3) out vec4 oViewDir;
+layout(location = 4) out vec4 oDepth;
+#endif
+
+uniform float near = 0.1f;  // camera near plane
+uniform float far = 100.0f;   // camera far plane
+float LinearizeDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0; 
+    return (2.0 * near * far) / (far + near - z * (far - near));
+}
+
+#ifdef COMPACT_GBUFFER
+// octahedral normal in [0, 1], DecodeNormal in the shaders that read the G-buffer undoes it
+vec2 EncodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return (n.z >= 0.0 ? n.xy : folded) * 0.5 + 0.5;
+}
+#endif
+
+void main()
+{
+    oAlbedo = texture(uTexture, vTexCoord);
+#ifdef COMPACT_GBUFFER
+    oNormals = EncodeNormal(normalize(vNormal));
+#else
+    oNormals = vec4(vNormal, 1.0);
+    oPosition = vec4(vPosition, 1.0);
+    oViewDir = vec4(vViewDir,1.0);
+    oDepth = vec4(vec3(LinearizeDepth(gl_FragCoord.z) / far), 1.0f);
+#endif
+}
+
+#endif
+#endif
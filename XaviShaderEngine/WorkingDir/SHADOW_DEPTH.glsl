@@ -0,0 +1,27 @@
+#ifdef SHADOW_DEPTH
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+
+layout(binding = 1, std140) uniform localParams
+{
+    mat4 uWorldMatrix;
+    mat4 uWorldViewProjectionMatrix;
+};
+
+uniform mat4 uLightViewProjection; // of the cascade being rendered
+
+void main()
+{
+    gl_Position = uLightViewProjection * uWorldMatrix * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+void main()
+{
+}
+
+#endif
+#endif
@@ -15,59 +15,63 @@ void main()
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
 in vec2 vTexCoord;
-uniform sampler2D uNormals;
-uniform sampler2D uPosition;
+uniform sampler2D uLinearDepth; // view distance along -z, SSAODownsample.glsl writes it at the size of this target
+uniform sampler2D uViewNormals;
+
+// the kernel of the quality tier, only the first uSampleCount are filled
+layout(binding = 2, std140) uniform SsaoKernel
+{
+    vec4 ssaoSamples[64];
+};
+uniform int uSampleCount;
 
-uniform vec3 ssaoSamples[64];
 uniform float sampleRadius;
 uniform mat4 projectionMatrix;
-uniform vec2 viewportSize;
+uniform mat4 uProjectionInv;
 uniform float ssaoBias;
 uniform sampler2D noiseTexture;
 
 layout(location = 0) out vec4 oColor;
 
-vec3 reconstructPixelPosition(float d, vec2 v)
+vec3 ViewPosition(vec2 uv, float linearDepth)
 {
-    mat4 projectionMatrixInv = inverse(projectionMatrix);
-    float xndc = gl_FragCoord.x / v.x * 2.0 - 1.0;
-    float yndc = gl_FragCoord.y / v.y * 2.0 - 1.0;
-    float zndc = d * 2.0 - 1.0;
-    vec4 posNDC = vec4(xndc, yndc, zndc, 1.0);
-    vec4 posView = projectionMatrixInv * posNDC;
-    return posView.xyz / posView.w;
+    vec4 farPoint = uProjectionInv * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+    farPoint.xyz /= farPoint.w;
+    return farPoint.xyz * (linearDepth / -farPoint.z);
 }
 
 void main()
 {
     float occlusion = 0.0;
 
-    vec2 noiseScale = viewportSize / textureSize(noiseTexture, 0);
+    vec2 noiseScale = vec2(textureSize(uLinearDepth, 0)) / vec2(textureSize(noiseTexture, 0));
     vec3 randomVec = texture(noiseTexture, vTexCoord * noiseScale).xyz;
 
-    vec3 vNormal = texture(uNormals, vTexCoord).xyz;
+    vec3 vNormal = normalize(texture(uViewNormals, vTexCoord).xyz * 2.0 - 1.0);
+    vec3 fragPosition = ViewPosition(vTexCoord, texture(uLinearDepth, vTexCoord).x);
+
     vec3 tangent = normalize(randomVec - vNormal * dot(randomVec, vNormal));
     vec3 bitangent = cross(vNormal, tangent);
     mat3 TBN = mat3(tangent, bitangent, vNormal);
 
-    for (int i = 0; i < 64; i++)
+    for (int i = 0; i < uSampleCount; i++)
     {
-        vec3 offsetView = TBN * ssaoSamples[i];
-        vec3 samplePosView = texture(uPosition, vTexCoord).xyz + offsetView * sampleRadius;
-            
+        vec3 offsetView = TBN * ssaoSamples[i].xyz;
+        vec3 samplePosView = fragPosition + offsetView * sampleRadius;
+
         vec4 sampleTexCoord = projectionMatrix * vec4(samplePosView, 1.0);
-        sampleTexCoord.xyz /= sampleTexCoord.w;
-        sampleTexCoord.xyz = sampleTexCoord.xyz * 0.5 + 0.5;
+        sampleTexCoord.xy /= sampleTexCoord.w;
+        sampleTexCoord.xy = sampleTexCoord.xy * 0.5 + 0.5;
 
-        float sampleDepth = texture(uPosition, sampleTexCoord.xy).z;
-        vec3 sampledPosView = reconstructPixelPosition(sampleDepth, viewportSize);
+        // only the depth of the occluder matters, no need to rebuild its position
+        float sampledZ = -texture(uLinearDepth, sampleTexCoord.xy).x;
 
-        float rangeCheck = smoothstep(0.0, 1.0, sampleRadius / abs(samplePosView.z - sampledPosView.z));
+        float rangeCheck = smoothstep(0.0, 1.0, sampleRadius / abs(samplePosView.z - sampledZ));
         rangeCheck *= rangeCheck;
-        occlusion += (samplePosView.z < sampledPosView.z - ssaoBias ? 1.0 : 0.0) * rangeCheck;
+        occlusion += (samplePosView.z < sampledZ - ssaoBias ? 1.0 : 0.0) * rangeCheck;
     }
     
-    oColor = vec4(1.0 - occlusion / 64.0);
+    oColor = vec4(1.0 - occlusion / float(uSampleCount));
 }
 
 #endif
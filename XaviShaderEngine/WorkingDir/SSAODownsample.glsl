@@ -0,0 +1,72 @@
+#ifdef SSAODownsample
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+void main()
+{
+    gl_Position = vec4(aPosition,1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+uniform sampler2D uNormals; // world space in both layouts
+uniform sampler2D uDepth; // hardware depth of the G-buffer
+uniform int uBlockSize; // G-buffer texels per side of every texel of the target
+uniform mat4 viewMatrix;
+uniform mat4 uProjectionInv;
+
+layout(location = 0) out float oLinearDepth;
+layout(location = 1) out vec4 oViewNormal;
+
+float LinearDepth(float depth)
+{
+    vec2 zw = (uProjectionInv * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0)).zw;
+    return -zw.x / zw.y;
+}
+
+#ifdef COMPACT_GBUFFER
+vec3 DecodeNormal(vec2 encoded)
+{
+    vec2 e = encoded * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+#endif
+
+void main()
+{
+    // the nearest texel of the block, depth and normal of the same surface
+    ivec2 lastTexel = textureSize(uDepth, 0) - 1;
+    ivec2 first = ivec2(gl_FragCoord.xy) * uBlockSize;
+    ivec2 nearest = min(first, lastTexel);
+    float nearestDepth = texelFetch(uDepth, nearest, 0).x;
+    for (int y = 0; y < uBlockSize; ++y)
+    {
+        for (int x = 0; x < uBlockSize; ++x)
+        {
+            ivec2 texel = min(first + ivec2(x, y), lastTexel);
+            float depth = texelFetch(uDepth, texel, 0).x;
+            if (depth < nearestDepth)
+            {
+                nearestDepth = depth;
+                nearest = texel;
+            }
+        }
+    }
+
+#ifdef COMPACT_GBUFFER
+    vec3 normal = DecodeNormal(texelFetch(uNormals, nearest, 0).xy);
+#else
+    vec3 normal = texelFetch(uNormals, nearest, 0).xyz;
+#endif
+    oLinearDepth = LinearDepth(nearestDepth);
+    oViewNormal = vec4(normalize(mat3(viewMatrix) * normal) * 0.5 + 0.5, 1.0);
+}
+
+#endif
+#endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifdef SSAOUpsample
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec2 aTexCoord;
+
+void main()
+{
+    gl_Position = vec4(aPosition,1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+uniform sampler2D uAO; // blurred, at the size of uLinearDepth
+uniform sampler2D uLinearDepth;
+uniform sampler2D uDepth; // hardware depth of the G-buffer, the size of this target
+uniform mat4 uProjectionInv;
+
+layout(location = 0) out vec4 oColor;
+
+float LinearDepth(float depth)
+{
+    vec2 zw = (uProjectionInv * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0)).zw;
+    return -zw.x / zw.y;
+}
+
+void main()
+{
+    float depth = LinearDepth(texelFetch(uDepth, ivec2(gl_FragCoord.xy), 0).x);
+
+    // the four low resolution texels around the pixel, bilinear weights scaled down by their depth difference
+    vec2 lowSize = vec2(textureSize(uLinearDepth, 0));
+    vec2 lowCoord = gl_FragCoord.xy / vec2(textureSize(uDepth, 0)) * lowSize - 0.5;
+    ivec2 base = ivec2(floor(lowCoord));
+    vec2 f = lowCoord - vec2(base);
+    ivec2 lastTexel = ivec2(lowSize) - 1;
+
+    float ao = 0.0;
+    float totalWeight = 0.0;
+    float nearestDifference = 1e30;
+    float nearestAo = 1.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), lastTexel);
+        float lowDepth = texelFetch(uLinearDepth, texel, 0).x;
+        float lowAo = texelFetch(uAO, texel, 0).z;
+
+        float difference = abs(lowDepth - depth);
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y * exp(-difference / (0.02 * depth));
+        ao += lowAo * weight;
+        totalWeight += weight;
+
+        if (difference < nearestDifference)
+        {
+            nearestDifference = difference;
+            nearestAo = lowAo;
+        }
+    }
+
+    // every texel on another surface, the closest in depth is the best guess
+    oColor = vec4(totalWeight > 0.05 ? ao / totalWeight : nearestAo);
+}
+
+#endif
+#endif
\ No newline at end of file
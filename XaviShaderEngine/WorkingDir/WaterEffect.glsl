@@ -4,20 +4,45 @@
 
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
+layout(location = 2) in vec3 aGrid; // ocean grid only: xz to the neighbours a seam vertex averages, y the spacing of its level
 
 uniform mat4 viewMatrix;
 uniform mat4 modelViewMatrix;
 uniform mat4 projectionMatrix;
 
+// the FFT ocean grid instead of the flat quad
+uniform bool uOcean;
+uniform sampler2D uOceanDisplacement;
+uniform float uOceanPatchSize;
+
 out Data
 {
     vec3 positionViewspace;
     vec3 normalViewspace;
+    vec2 oceanPosition;
 } VSOut; 
 
+vec3 OceanDisplacement(vec2 position, float lod)
+{
+    return textureLod(uOceanDisplacement, position / uOceanPatchSize, lod).xyz;
+}
+
 void main()
 {
-    VSOut.positionViewspace = vec3(viewMatrix * modelViewMatrix * vec4(aPosition,1.0));
+    vec4 position = modelViewMatrix * vec4(aPosition, 1.0);
+    VSOut.oceanPosition = position.xz;
+    if (uOcean)
+    {
+        // about a texel per quad, the far rings read coarser mips. Seam vertices stay on the straight edge of the
+        // coarser ring next to them
+        float lod = max(log2(aGrid.y * float(textureSize(uOceanDisplacement, 0).x) / uOceanPatchSize), 0.0);
+        vec3 displacement = OceanDisplacement(position.xz, lod);
+        if (aGrid.x != 0.0 || aGrid.z != 0.0)
+            displacement = 0.5 * (OceanDisplacement(position.xz + aGrid.xz, lod) + OceanDisplacement(position.xz - aGrid.xz, lod));
+        position.xyz += displacement;
+    }
+
+    VSOut.positionViewspace = vec3(viewMatrix * position);
     VSOut.normalViewspace = vec3(viewMatrix * vec4(aNormal,0.0));
     gl_Position = projectionMatrix * vec4(VSOut.positionViewspace, 1.0);
 }
@@ -28,6 +53,7 @@ in Data
 {
     vec3 positionViewspace;
     vec3 normalViewspace;
+    vec2 oceanPosition;
 } FSIn; 
 
 uniform vec2 viewportSize;
@@ -35,12 +61,35 @@ uniform vec2 viewportSize;
 uniform mat4 viewMatrixInv;
 uniform mat4 projectionMatrixInv;
 uniform sampler2D reflectionMap;
-uniform sampler2D refractionMap;
-//uniform sampler2D reflectionDepth;
-uniform sampler2D refractionDepth;
 //uniform sampler2D normalMap;
 uniform sampler2D dudvMap;
 
+// the lit frame and the hardware depth of the main pass, which has no water. The water refracts the one and is
+// hidden by the other
+uniform sampler2D sceneColor;
+uniform sampler2D sceneDepth;
+
+// the reflection view is a fraction of the viewport, its depth keeps the upsampling from crossing silhouettes
+uniform sampler2D reflectionViewDepth;
+uniform mat4 reflectionProjectionInv; // oblique, the near plane is the water plane
+// of the frame the view was last rendered, it can be a few frames old
+uniform mat4 reflectionViewProjection;
+
+uniform bool uOcean;
+uniform sampler2D uOceanSlopes;
+uniform float uOceanPatchSize;
+
+// screen space reflections instead of the reflection view, traced through the depth of the main pass and read from
+// its lit image
+uniform bool uScreenSpaceReflection;
+uniform sampler2D ssrDepthPyramid; // nearest depth per texel of every mip
+uniform mat4 ssrViewProjection;
+uniform vec2 ssrNearFar;
+
+#define SSR_MAX_STEPS 80
+#define SSR_MAX_DISTANCE 50.0
+#define SSR_THICKNESS 0.5 // meters behind a depth that still count as a hit
+
 layout(location = 0) out vec4 oColor; // aqui se podria añadir mas como onormals
 
 vec3 fresnelSchlick(float cosTheta, vec3 F0)
@@ -48,15 +97,167 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
     return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
-vec3 reconstructPixelPosition(float depth)
+vec3 reconstructPixelPosition(vec2 textCoords, float depth)
 {
-    vec2 textCoords = gl_FragCoord.xy / viewportSize;
     vec3 positionNDC = vec3(textCoords * 2.0 - vec2(1.0) , depth * 2.0 - 1.0);
     vec4 positionEyespace = projectionMatrixInv * vec4(positionNDC, 1.0);
     positionEyespace.xyz /= positionEyespace.w;
     return positionEyespace.xyz;
 }
 
+// Distance along the view axis to what the main pass drew at uv, the far plane where it drew nothing
+float SceneViewDepth(vec2 uv)
+{
+    return -reconstructPixelPosition(uv, texture(sceneDepth, uv).x).z;
+}
+
+vec2 ViewTexCoord(mat4 viewProjection, vec3 position)
+{
+    vec4 positionClip = viewProjection * vec4(position, 1.0);
+    return positionClip.xy / positionClip.w * 0.5 + 0.5;
+}
+
+float LinearViewDepth(mat4 projectionInv, vec2 uv, float depth)
+{
+    vec4 position = projectionInv * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return -position.z / position.w;
+}
+
+// Bilinear between the four texels around uv, less the ones far in depth from the nearest of them. There is no
+// full resolution depth of the views, the nearest texel stands for it
+vec3 UpsampleView(sampler2D colorMap, sampler2D depthMap, mat4 projectionInv, vec2 uv)
+{
+    ivec2 size = textureSize(colorMap, 0);
+    vec2 texel = uv * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(texel));
+    vec2 f = texel - vec2(base);
+
+    const ivec2 offsets[4] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+    float bilinear[4] = float[]((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    int nearest = (f.x < 0.5 ? 0 : 1) + (f.y < 0.5 ? 0 : 2);
+
+    float depths[4];
+    vec3 colors[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 coord = clamp(base + offsets[i], ivec2(0), size - 1);
+        depths[i] = LinearViewDepth(projectionInv, (vec2(coord) + 0.5) / vec2(size), texelFetch(depthMap, coord, 0).x);
+        colors[i] = texelFetch(colorMap, coord, 0).rgb;
+    }
+
+    // a few percent of the distance apart is another surface
+    float reference = depths[nearest];
+    vec3 color = vec3(0.0);
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; ++i)
+    {
+        float weight = bilinear[i] * exp(-abs(depths[i] - reference) / (0.02 * reference));
+        color += colors[i] * weight;
+        weightSum += weight;
+    }
+    return weightSum > 0.0 ? color / weightSum : colors[nearest];
+}
+
+float PyramidLinearDepth(float depth)
+{
+    return ssrNearFar.x * ssrNearFar.y / (ssrNearFar.y - depth * (ssrNearFar.y - ssrNearFar.x));
+}
+
+// Texels of mip 0 in xy and hardware depth in z
+vec3 PyramidScreen(vec4 positionClip, vec2 size)
+{
+    vec3 ndc = positionClip.xyz / positionClip.w;
+    return vec3((ndc.xy * 0.5 + 0.5) * size, ndc.z * 0.5 + 0.5);
+}
+
+// Walks the ray across the cells of the depth pyramid: up a level after every cell it clears in front of the nearest
+// depth, down one when it reaches that depth. Lines stay lines after the projection, depth included
+bool TraceDepthPyramid(vec3 origin, vec3 direction, out vec2 hitTexCoord)
+{
+    hitTexCoord = vec2(0.0);
+    ivec2 size = textureSize(ssrDepthPyramid, 0);
+    int maxLevel = textureQueryLevels(ssrDepthPyramid) - 1;
+
+    vec4 startClip = ssrViewProjection * vec4(origin, 1.0);
+    vec4 endClip = ssrViewProjection * vec4(origin + direction * SSR_MAX_DISTANCE, 1.0);
+    if (startClip.w <= ssrNearFar.x)
+        return false;
+    // rays towards the camera end at its near plane
+    if (endClip.w < ssrNearFar.x)
+        endClip = mix(startClip, endClip, (startClip.w - ssrNearFar.x) / (startClip.w - endClip.w));
+
+    vec3 start = PyramidScreen(startClip, vec2(size));
+    vec3 delta = PyramidScreen(endClip, vec2(size)) - start;
+    float texelsLength = max(length(delta.xy), 1e-3);
+    bvec2 moves = greaterThan(abs(delta.xy), vec2(1e-5));
+
+    // a couple of texels off the surface it starts on
+    float t = 2.0 / texelsLength;
+    int level = 0;
+    for (int i = 0; i < SSR_MAX_STEPS && t <= 1.0; ++i)
+    {
+        vec3 p = start + delta * t;
+        if (any(lessThan(p.xy, vec2(0.0))) || any(greaterThanEqual(p.xy, vec2(size))))
+            return false;
+
+        ivec2 levelSize = textureSize(ssrDepthPyramid, level);
+        ivec2 cell = min(ivec2(p.xy) >> level, levelSize - 1);
+        float nearest = texelFetch(ssrDepthPyramid, cell, level).r;
+
+        // the last cell of an odd sized mip also covers the rows and columns that did not fit
+        vec2 cellMin = vec2(cell << level);
+        vec2 cellMax = vec2(cell.x == levelSize.x - 1 ? size.x : (cell.x + 1) << level, cell.y == levelSize.y - 1 ? size.y : (cell.y + 1) << level);
+        vec2 boundary = mix(cellMin, cellMax, step(0.0, delta.xy));
+        vec2 tBoundary = mix(vec2(1e30), (boundary - start.xy) / delta.xy, moves);
+        float tExit = min(tBoundary.x, tBoundary.y) + 0.05 / texelsLength;
+
+        if (p.z < nearest)
+        {
+            float tSurface = delta.z > 0.0 ? t + (nearest - p.z) / delta.z : 1e30;
+            if (tSurface >= tExit)
+            {
+                t = tExit;
+                level = min(level + 1, maxLevel);
+                continue;
+            }
+            t = tSurface;
+        }
+        if (level > 0)
+        {
+            --level;
+            continue;
+        }
+
+        // behind the texel by more than a thickness is passing behind an object
+        vec3 hit = start + delta * t;
+        if (PyramidLinearDepth(hit.z) - PyramidLinearDepth(nearest) < SSR_THICKNESS)
+        {
+            hitTexCoord = hit.xy / vec2(size);
+            return true;
+        }
+        t = tExit;
+    }
+    return false;
+}
+
+vec3 SkyColor(vec3 direction)
+{
+    return mix(vec3(0.55, 0.65, 0.75), vec3(0.15, 0.3, 0.55), clamp(direction.y, 0.0, 1.0));
+}
+
+vec3 ScreenSpaceReflection(vec3 origin, vec3 direction)
+{
+    vec3 sky = SkyColor(direction);
+    vec2 hitTexCoord;
+    if (!TraceDepthPyramid(origin, direction, hitTexCoord))
+        return sky;
+
+    // the frame ends at the borders, the sky takes over before them
+    vec2 border = min(hitTexCoord, 1.0 - hitTexCoord);
+    float fade = smoothstep(0.0, 0.1, min(border.x, border.y));
+    return mix(sky, texture(sceneColor, hitTexCoord).rgb, fade);
+}
+
 void main()
 {
     vec3 N = normalize(FSIn.normalViewspace);
@@ -68,17 +269,47 @@ void main()
     const vec2 waveStrength = vec2(0.05);
     const float turbidityDistance = 10.0;
 
+    // the main pass drew no water, what it drew in front of the surface covers it
+    float waterDepth = -FSIn.positionViewspace.z;
+    if (SceneViewDepth(texCoord) < waterDepth)
+        discard;
+
     vec2 distortion = (2.0 * texture(dudvMap, Pw.xy / waveLenght).rg - vec2(1.0)) * waveStrength + waveStrength / 7;
+    vec3 normalWorld = normalize(vec3(distortion.x, 1.0, distortion.y));
+    if (uOcean)
+    {
+        // the slopes bend the lookups instead of the dudv map, the view matrix is the transpose of its inverse
+        vec2 slope = texture(uOceanSlopes, FSIn.oceanPosition / uOceanPatchSize).xy;
+        normalWorld = normalize(vec3(-slope.x, 1.0, -slope.y));
+        N = normalize(transpose(mat3(viewMatrixInv)) * normalWorld);
+        distortion = normalWorld.xz * waveStrength;
+    }
+
+    // the water surface is on the mirror plane, the reflection camera sees it where the main one does, flipped
+    vec3 reflectionColor;
+    if (uScreenSpaceReflection)
+    {
+        vec3 Rw = reflect(normalize(Pw - viewMatrixInv[3].xyz), normalWorld);
+        reflectionColor = ScreenSpaceReflection(Pw, Rw);
+    }
+    else
+    {
+        vec2 reflectionTexCoord = ViewTexCoord(reflectionViewProjection, Pw) + distortion;
+        reflectionColor = UpsampleView(reflectionMap, reflectionViewDepth, reflectionProjectionInv, reflectionTexCoord);
+    }
 
-    vec2 reflectionTexCoord = vec2(texCoord.s, 1.0 - texCoord.t) + distortion;
+    // a distorted lookup that lands on something in front of the water would show it under the surface, the pixel
+    // right below is taken instead
     vec2 refractionTexCoord = texCoord + distortion;
-    vec3 reflectionColor = texture(reflectionMap, reflectionTexCoord).rgb;
-    vec3 refractionColor = texture(refractionMap, refractionTexCoord).rgb;
+    float groundDepth = SceneViewDepth(refractionTexCoord);
+    if (groundDepth < waterDepth)
+    {
+        refractionTexCoord = texCoord;
+        groundDepth = SceneViewDepth(texCoord);
+    }
+    vec3 refractionColor = texture(sceneColor, refractionTexCoord).rgb;
 
-    float distortedGroundDepth = texture(refractionDepth, refractionTexCoord).x;
-    vec3 distortedGroundPosViewspace = reconstructPixelPosition(distortedGroundDepth);
-    float distortedWaterDepth = FSIn.positionViewspace.z - distortedGroundPosViewspace.z;
-    float tintFactor = clamp(distortedWaterDepth / turbidityDistance, 0.0, 1.0);
+    float tintFactor = clamp((groundDepth - waterDepth) / turbidityDistance, 0.0, 1.0);
     vec3 waterColor = vec3(0.25, 0.4, 0.6);
     refractionColor = mix(refractionColor, waterColor, tintFactor);
 
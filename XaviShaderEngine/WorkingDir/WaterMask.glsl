@@ -0,0 +1,21 @@
+#ifdef WATER_MASK
+
+// Convex outline of the water on screen into the stencil, a fan of its corners in texture coordinates
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+uniform vec2 uCorners[8];
+
+void main()
+{
+    gl_Position = vec4(uCorners[gl_VertexID] * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+void main()
+{
+}
+
+#endif
+#endif